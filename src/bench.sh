@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+# Crossword Generator benchmark
+#
+# Usage: bench.sh <crossgen> <wordgen>
+#
+# Runs crossgen on the word lists made by wordgen with fixed seeds and
+# prints one tab separated line per case: the phase times in seconds, the
+# node counts and the peak memory in KB. The first line is the header.
+# A case that fails gets the first line of its error output instead.
+#
+# The pairs-* cases only build the pairs of 1k, 10k and 100k words
+# (crossgen -p). The pairs grow with the square of the words: 1k words give
+# 2M pairs, 10k words 200M pairs in 3 GB. 100k words would give 20G pairs,
+# more than the pair array can count: crossgen stops at about 33k words,
+# so the 100k case fails with "Too many pairs".
+#
+
+CROSSGEN=${1:-../bin/crossgen-bench}
+WORDGEN=${2:-../bin/wordgen}
+TMPDIR=${TMPDIR:-/tmp}
+LIST="$TMPDIR/crossgen-bench.$$"
+OUT="$TMPDIR/crossgen-bench-out.$$"
+ERR="$TMPDIR/crossgen-bench-err.$$"
+
+trap 'rm -f "$LIST" "$OUT" "$ERR"' EXIT INT TERM
+
+# name; wordgen options; crossgen options
+CASES="
+small-full;-n 8 -l 4 -L 7 -s 1;
+small-bound;-n 8 -l 4 -L 7 -s 1;-b
+mid-full;-n 10 -l 3 -L 6 -s 1;
+mid-stream;-n 10 -l 3 -L 6 -s 1;-m stream
+mid-jobs4;-n 10 -l 3 -L 6 -s 1;-j 4
+overlap-full;-n 9 -l 3 -L 5 -a 8 -s 1;
+overlap-bound;-n 9 -l 3 -L 5 -a 8 -s 1;-b
+large-beam;-n 40 -l 4 -L 9 -a 12 -s 1;-m beam -d 2
+pairs-1k;-n 1000 -s 1;-p
+pairs-10k;-n 10000 -s 1;-p
+pairs-100k;-n 100000 -s 1;-p
+"
+
+printf "case\twords\tpairs\tdepth\tnodes\trejected\tbuild_pairs\tsearch\tslowest_root\toutput\tfree\tnodes_per_sec\tpeak_kb\n"
+
+echo "$CASES" | while IFS=';' read -r name genopts opts
+do
+    [ -z "$name" ] && continue
+    # shellcheck disable=SC2086
+    "$WORDGEN" $genopts > "$LIST" || exit 1
+    # shellcheck disable=SC2086
+    if ! "$CROSSGEN" -B $opts "$LIST" > "$OUT" 2> "$ERR"
+    then
+        printf "%s\tfailed: %s\n" "$name" "$(head -n 1 "$ERR")"
+        continue
+    fi
+    awk -v name="$name" '
+        $1 == "bench" && $2 ~ /^build_branch\./ {
+            if ($3 > slowest)
+                slowest = $3
+            next
+        }
+        $1 == "bench" { v[$2] = $3 }
+        END {
+            printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%.6f\t%s\t%s\t%s\t%s\n", name, \
+                v["words"], v["pairs"], v["depth"], v["nodes"], v["rejected"], \
+                v["build_pairs"], v["search"], slowest, v["output"], v["free"], \
+                v["nodes_per_sec"], v["peak_kb"]
+        }' "$OUT"
+done
@@ -0,0 +1,200 @@
+#!/bin/sh
+#
+# Crossword Generator checks
+#
+# Usage: check.sh <crossgen> <paircache> <wordgen>
+#
+# Runs crossgen on small word lists and templates whose right output is
+# known and prints one line per check: "ok" or "FAILED" with the first line
+# of the output that went wrong. Exits with 1 if any check fails.
+#
+
+CROSSGEN=${1:-../bin/crossgen}
+PAIRCACHE=${2:-../bin/paircache}
+WORDGEN=${3:-../bin/wordgen}
+TMPDIR=${TMPDIR:-/tmp}
+DIR="$TMPDIR/crossgen-check.$$"
+FAILED=0
+
+mkdir "$DIR" || exit 1
+trap 'rm -rf "$DIR"' EXIT INT TERM
+
+pass()
+{
+    printf "%s\tok\n" "$1"
+}
+
+fail()
+{
+    printf "%s\tFAILED: %s\n" "$1" "$2"
+    FAILED=1
+}
+
+# expect <name> <text> <command...>: the command succeeds and prints the text
+expect()
+{
+    name=$1
+    text=$2
+    shift 2
+    "$@" > "$DIR/out" 2>&1
+    code=$?
+    if [ $code -ne 0 ]
+    then
+        fail "$name" "exit code $code, $(head -n 1 "$DIR/out")"
+    elif ! grep -q -e "$text" "$DIR/out"
+    then
+        fail "$name" "no \"$text\" in the output"
+    else
+        pass "$name"
+    fi
+}
+
+# same <name> <command> <command>: both commands succeed and print the same
+# but the times
+same()
+{
+    name=$1
+    # shellcheck disable=SC2086
+    if ! $2 > "$DIR/out1" 2>&1
+    then
+        fail "$name" "$2: $(head -n 1 "$DIR/out1")"
+    # shellcheck disable=SC2086
+    elif ! $3 > "$DIR/out2" 2>&1
+    then
+        fail "$name" "$3: $(head -n 1 "$DIR/out2")"
+    elif ! sed 's/[0-9]*\.[0-9]* s/- s/g' "$DIR/out1" > "$DIR/cmp1" || \
+            ! sed 's/[0-9]*\.[0-9]* s/- s/g' "$DIR/out2" > "$DIR/cmp2" || \
+            ! cmp -s "$DIR/cmp1" "$DIR/cmp2"
+    then
+        fail "$name" "$(diff "$DIR/cmp1" "$DIR/cmp2" | sed -n 2p)"
+    else
+        pass "$name"
+    fi
+}
+
+# limits <name> <width> <height> <ratio> <command...>: the command succeeds,
+# prints a crossword after every edit and every crossword fits the box and
+# the ratio of its sides
+limits()
+{
+    name=$1
+    width=$2
+    height=$3
+    ratio=$4
+    shift 4
+    "$@" > "$DIR/out" 2>&1
+    code=$?
+    if [ $code -ne 0 ]
+    then
+        fail "$name" "exit code $code, $(head -n 1 "$DIR/out")"
+        return
+    fi
+    error=$(awk -v w="$width" -v h="$height" -v r="$ratio" '
+        /^Edit / {
+            if (edit && !shown)
+                err = "no crossword after " edit
+            edit = $0
+            shown = 0
+        }
+        /^Generated crossword/ {
+            shown = 1
+        }
+        /^Crossword size:/ {
+            if (!(($3 <= w && $5 <= h) || ($3 <= h && $5 <= w)) || $3 > r * $5 || $5 > r * $3)
+                err = "a crossword of " $3 " x " $5 " after " edit
+        }
+        END {
+            if (!err && edit && !shown)
+                err = "no crossword after " edit
+            print err
+        }' "$DIR/out")
+    if [ -n "$error" ]
+    then
+        fail "$name" "$error"
+    else
+        pass "$name"
+    fi
+}
+
+# A template slot no word of the dictionary is long enough for
+printf 'a.#\n...\n' > "$DIR/short.tpl"
+printf 'cat\ncoin\ntrek\nkid\n' > "$DIR/short.txt"
+expect fill-no-length "can't be filled" "$CROSSGEN" -T "$DIR/short.tpl" "$DIR/short.txt"
+printf 'c..\n' > "$DIR/cat.tpl"
+expect fill-letter "filled in" "$CROSSGEN" -T "$DIR/cat.tpl" "$DIR/short.txt"
+
+# With an objective a single root may be the best crossword, -k 1 keeps it
+printf 'apple\nbanana\ncherry\ndate\nelder\nfig\ngrape\nlemon\n' > "$DIR/fruit.txt"
+for objective in area:-1 words:2,area:-1
+do
+    same "objective-$objective" "$CROSSGEN -o $objective $DIR/fruit.txt" \
+        "$CROSSGEN -o $objective -k 1 $DIR/fruit.txt"
+    same "objective-$objective-bound" "$CROSSGEN -o $objective $DIR/fruit.txt" \
+        "$CROSSGEN -o $objective -b $DIR/fruit.txt"
+done
+expect objective-smallest "score: -15" "$CROSSGEN" -o area:-1 "$DIR/fruit.txt"
+
+# The random search on the first words of a cache takes the same choices
+# as on a list of these words
+"$WORDGEN" -n 60 -s 3 > "$DIR/60.txt" || exit 1
+head -n 30 "$DIR/60.txt" > "$DIR/30.txt"
+if "$PAIRCACHE" "$DIR/60.txt" "$DIR/60.bin" > /dev/null
+then
+    same random-cache-subset "$CROSSGEN -m random -R 20 $DIR/30.txt" \
+        "$CROSSGEN -m random -R 20 -c $DIR/60.bin -n 30"
+else
+    fail random-cache-subset "paircache failed"
+fi
+
+# A cache of UTF-8 words gives the crossword of the list
+printf '\321\221\320\273\320\272\320\260\n\320\201\320\266\320\270\320\272\n\320\272\320\276\321\202\n\321\202\321\221\321\200\320\272\320\260\n' > "$DIR/utf8.txt"
+if "$PAIRCACHE" "$DIR/utf8.txt" "$DIR/utf8.bin" > /dev/null
+then
+    same cache-utf8 "$CROSSGEN $DIR/utf8.txt" "$CROSSGEN -c $DIR/utf8.bin"
+else
+    fail cache-utf8 "paircache failed"
+fi
+
+# Edits bring the crossword up to date within the limits, '!' searches anew
+printf 'ont\nlhsi\neolsdnn\n' > "$DIR/edit.txt"
+printf '+oilt\n+olhset\n-ont\n!\n' > "$DIR/edits"
+limits edit 1000 1000 1000 "$CROSSGEN" -e "$DIR/edit.txt" < "$DIR/edits"
+limits edit-ratio 1000 1000 1.2 "$CROSSGEN" -r 1.2 -e "$DIR/edit.txt" < "$DIR/edits"
+limits edit-box 5 4 1000 "$CROSSGEN" -W 5 -H 4 -e "$DIR/edit.txt" < "$DIR/edits"
+limits edit-all 7 7 1.5 "$CROSSGEN" -W 7 -H 7 -r 1.5 -e "$DIR/edit.txt" < "$DIR/edits"
+printf 'lhsi\neolsdnn\noilt\nolhset\n' > "$DIR/edited.txt"
+if "$CROSSGEN" -e "$DIR/edit.txt" < "$DIR/edits" > "$DIR/out" 2>&1 && \
+        "$CROSSGEN" "$DIR/edited.txt" > "$DIR/out2" 2>&1
+then
+    sed -n '/^Edit !/,$p' "$DIR/out" | sed -n '/^Generated/,$p' > "$DIR/cmp1"
+    sed -n '/^Generated/,$p' "$DIR/out2" > "$DIR/cmp2"
+    if cmp -s "$DIR/cmp1" "$DIR/cmp2"
+    then
+        pass edit-search
+    else
+        fail edit-search "$(diff "$DIR/cmp1" "$DIR/cmp2" | sed -n 2p)"
+    fi
+else
+    fail edit-search "$(head -n 1 "$DIR/out")"
+fi
+
+# A word of wrong UTF-8 fails only its own set of a batch
+printf 'cat\ncoin\n\nk\377id\ntrek\n\nkid\ndog\n' > "$DIR/batch.lines"
+printf '["cat", "coin"]\n["k\377id", "trek"]\n["kid", "dog"]\n' > "$DIR/batch.json"
+for format in lines json
+do
+    "$CROSSGEN" -a $format < "$DIR/batch.$format" > "$DIR/out" 2> /dev/null
+    code=$?
+    if [ $code -ne 0 ]
+    then
+        fail "batch-$format-utf8" "exit code $code, $(head -n 1 "$DIR/out")"
+    elif [ "$(grep -c '"words": 2' "$DIR/out")" -ne 2 ] || \
+            ! grep -q '"set": 1, "error"' "$DIR/out"
+    then
+        fail "batch-$format-utf8" "$(tr '\n' ' ' < "$DIR/out")"
+    else
+        pass "batch-$format-utf8"
+    fi
+done
+
+exit $FAILED
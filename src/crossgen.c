@@ -0,0 +1,4866 @@
+/*
+ * Crossword Generator library: the search itself
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#define _GNU_SOURCE     // qsort_r()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <time.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "crossgen.h"
+#include "grid.h"
+#include "pool.h"
+#include "simd.h"
+
+#define MINDISTANCE 2     /* minimum distance between the crossing words, e.g.
+                           *        0123456
+                           *        |||||||
+                           *        license
+                           *         n    m
+                           *         d<-->a
+                           *         i    i
+                           *         a    l
+                           *
+                           * in this example the distance between the words is
+                           * 6 - 1 = 5
+                           */
+/*
+ * A cursor moved by expand_node(): the number of the first pair of the word
+ * that can be analyzed to create a child. The cursors a node's children were
+ * created with are kept as a list of the moves, the first one is the last
+ * move made, the list goes on with the moves of the parent's cursors.
+ */
+struct cursor_delta {
+    const struct cursor_delta *next;
+    int     word;
+    int     cursor;
+};
+
+/*
+ * A node of the strie. The fields check_pair() reads on every node of the
+ * branch come first and take one cache line, the node pool puts every node
+ * at the beginning of a line.
+ */
+struct strie_pair {
+    struct strie_pair *parent;
+    struct strie_pair *firstchild;
+    struct strie_pair *brother;
+    int     crossed_word[2];
+    int     crossed_word_letter[2];
+    int     word_coord[2][2]; // coordinates of the beginning of the word
+    signed char word_orient[2]; // 1 - horisontal; -1 - vertical
+    int     depth;
+
+    int     procreator;       // the number of the root word
+    int     order;            /* the number of the node among its brothers (among
+                                 all the roots for the root nodes) */
+    int     pairs_left;       /* how many more pairs the subtree may add at most,
+                                 used by the branch-and-bound search */
+    int     words;            // words of the branch, kept only with the weights
+    struct cursor_delta cursor; // the last cursor moved before the node was created
+    int     box[2][2];        // the lowest and the highest x and y of the branch words
+    int     crossings;        // crossed cells of the branch, kept only with the weights
+    int     letters;          // cells with a letter, kept only with the weights
+};
+
+#define BOX_WIDTH(box)  ((box)[1][0] - (box)[0][0] + 1)
+#define BOX_HEIGHT(box) ((box)[1][1] - (box)[0][1] + 1)
+
+// A crossing between two words, crossed_word[0] < crossed_word[1]
+struct cross_pair {
+    int     crossed_word[2];
+    int     crossed_word_letter[2];
+};
+
+struct cross_elem {
+    int     offset;      // the beginning of the word in word_pool
+    int     wordlen;     // number of the letters
+    int     childnum;    // number of pairs of this word with the other words
+    int     firstpair;   // index of the first pair of this word in pairs[]
+    unsigned letters;    // mask of the letters of the word
+};
+
+/*
+ * A word in word_pool is its letter codes, '\0', the word in UTF-8, '\0'.
+ * The codes are compared as chars, equal letters have equal codes.
+ */
+#define WORD(gen, i) ((gen)->word_pool + (gen)->words[i].offset)
+#define TEXT(gen, i) (WORD(gen, i) + (gen)->words[i].wordlen + 1)
+
+#define LETTER_HASH 1024    // slots of the letter hash, a power of 2
+#define LETTER_SLOT(c) (((uint32_t)(c) * 2654435761u) >> 22 & (LETTER_HASH - 1))
+
+/*
+ * The pair cache file, see crossgen_save_cache(): the header, then the
+ * words, the word pool, the letter index and its spots, each at an offset
+ * aligned to CACHE_ALIGN bytes. The words are struct cross_elem records
+ * with only the offset and the length kept, the offsets are counted from
+ * the beginning of the pool, so the file may be mapped anywhere. The
+ * letter index has CROSSGEN_LETTERS + 2 numbers: the spots of the letter
+ * code c are [index[c], index[c + 1]), ordered by the word and the place.
+ * The file grows with the letters of the words, not with their pairs. A
+ * file of another version, byte order or record size is not read.
+ */
+#define CACHE_MAGIC      "CGPAIRS"
+#define CACHE_VERSION    3
+#define CACHE_BYTE_ORDER 0x01020304
+#define CACHE_ALIGN      64
+#define CACHE_ALIGNED(n) (((n) + CACHE_ALIGN - 1) / CACHE_ALIGN * CACHE_ALIGN)
+
+struct cache_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t elem_size;         // sizeof(struct cross_elem)
+    uint32_t spot_size;         // sizeof(struct cache_spot)
+    int32_t  wordnum;
+    int32_t  word_pool_len;
+    int32_t  spotnum;           // letters of all the words
+    int32_t  letternum;
+    uint64_t words_at;          // offsets of the sections in the file
+    uint64_t pool_at;
+    uint64_t index_at;
+    uint64_t spots_at;
+    uint32_t letters[CROSSGEN_LETTERS + 1];     // the alphabet the codes of the words are from
+};
+
+// A letter of a word in the letter index of a cache
+struct cache_spot {
+    int32_t  word;
+    int32_t  pos;
+};
+
+#define EXPORT_BUFFER 4096  // nodes the strie export writes at once
+#define SPLIT_DEPTH   2     /* in parallel search the nodes above this depth
+                               are split into separate tasks */
+#define RANDOM_RESTARTS   100   // rollouts of the random search without a deadline
+#define RANDOM_ROOTS      256   // the roots with the highest bounds a rollout starts from
+#define RANDOM_CANDIDATES 4     // the children with the highest bounds a rollout goes to
+#define PAIR_DEAD(worker, i) ((worker)->dead[(i) / 64] >> ((i) % 64) & 1)
+#define PAIR_KILL(worker, i) ((worker)->dead[(i) / 64] |= 1ULL << ((i) % 64))
+
+// A node to search or, for the roots, a pair to create the root node from
+struct search_task {
+    struct strie_pair *node;
+    int     word;
+    int     index;
+};
+
+// Pool of tasks of a search worker
+struct task_deque {
+    pthread_mutex_t lock;
+    struct search_task *tasks;
+    int     head;           // other workers steal tasks from here
+    int     tail;           // the owner pushes and pops tasks here
+    int     size;
+};
+
+// A node placed on a grid. The node itself may have been already dropped
+// by the stream search when it's removed from the grid.
+struct grid_entry {
+    struct strie_pair *node;
+    int     word[2];
+};
+
+// A word in branch_bound(), valid if its stamp is the current one
+struct bound_word {
+    unsigned placed;        // the word is in the branch
+    unsigned seen;          // the word crosses one of the branch words
+    int     crossed;        // number of the branch words it crosses
+    int     available;      // one of these pairs is after the cursors
+    int     degree;         // number of the words it crosses in the root subtree
+    int     placements;     // most branch words it may cross when placed
+};
+
+/*
+ * Reasons check_pair() rejects a pair for. The conflicts with the words near
+ * the new one are numbered from 1, words_conflict(gen) returns them.
+ */
+#define REJECT_PARALLEL     1   // parallel words touch each other
+#define REJECT_TOUCH        2   // perpendicular words touch without crossing
+#define REJECT_LETTER       3   // perpendicular words cross in different letters
+#define REJECT_CHILD        4   // the same pair is already a child of the node
+#define REJECT_ROOT         5   // the pair belongs to an earlier root
+#define REJECT_BROTHER      6   // the same pair is an elder brother in the branch
+#define REJECT_SAME_WORDS   7   // the branch already has a pair of these words
+#define REJECT_PROCREATOR   8   // the pair has a word earlier than the root word
+#define REJECT_DISTANCE     9   // crossings of a word are closer than MINDISTANCE
+#define REJECT_ORIENT       10  // a word of the pair must have another orientation
+#define REJECT_MOVED        11  // a word of the pair is already placed elsewhere
+#define REJECT_DISCONNECTED 12  // the pair has no words of the branch
+#define REJECT_BOX          13  // the crossword gets bigger than the box
+#define REJECT_REASONS      CROSSGEN_REJECT_REASONS
+
+static const char *reject_names[REJECT_REASONS] = {
+    NULL, "parallel", "touch", "letter", "child", "root", "brother",
+    "same_words", "procreator", "distance", "orient", "moved", "disconnected",
+    "box"
+};
+
+static const char *score_names[CROSSGEN_SCORES] = {
+    "pairs", "words", "crossings", "letters", "area", "density"
+};
+
+/*
+ * Everything a search thread changes while building the strie. In a single
+ * threaded search only the first worker is used.
+ */
+struct search_worker {
+    struct crossgen *gen;
+    int     id;
+    int     wordnum;
+    struct pool node_pool;
+    struct pool cursor_pool;            // the cursor moves shared by the nodes
+    int    *cursors;                    // the cursors of the node being expanded
+    int    *finished;                   // the words expand_node() scanned to the end
+    struct strie_pair *best;            // the best branch found by this worker
+    struct strie_pair *best_snapshot;   // a copy of the best branch in CROSSGEN_MODE_STREAM mode
+    int     best_snapshot_len;
+    struct top_layout *top;             // the best crosswords, a heap with the worst one first
+    int     topnum;
+    struct task_deque deque;
+    pthread_t thread;
+    struct grid grid;                   // the words of the branch being expanded
+    struct grid_entry *grid_branch;     // the nodes placed on the grid from the root down
+    int     grid_depth;                 // number of the nodes placed on the grid
+    int     grid_branch_len;
+    long    nodes;                      // number of the nodes created
+    long    rejects[REJECT_REASONS];    // number of the pairs check_pair() rejected and why
+    long   *depth_nodes;                // number of the nodes created at every depth
+    int     depth_nodes_len;
+    long    pruned;                     // number of the nodes not expanded by the bound
+    long    restarts;                   // rollouts done by the random search
+    unsigned long long *dead;           // the pairs the rollout's branch can't take, see random_rollout()
+    int     dead_size;
+    struct bound_word *bound_words;     // branch_bound() scratch data for every word
+    int    *bound_list;                 // the words of the branch and their partners
+    unsigned bound_stamp;
+};
+
+// A crossword kept by a worker, see keep_top()
+struct top_layout {
+    struct strie_pair *branch;  // a copy of the branch, the last node first
+    int     size;               // size of the branch[] array
+    int     area;               // area of the box
+    unsigned long long shape;   // see layout_shape()
+};
+
+// A root of the random search, see random_search()
+struct random_root {
+    int     word;
+    int     index;
+    long long bound;
+};
+
+// The nodes of one strie level in the beam search
+struct beam_level {
+    struct strie_pair **nodes;
+    int     num;
+    int     size;
+};
+
+/*
+ * The generator: the words, their pairs and everything the search of one
+ * crossword needs
+ */
+struct crossgen {
+    struct crossgen_options options;
+    struct cross_elem *words;
+    int     wordnum;
+    int     wordsize;           // size of the words[] array
+    char   *word_pool;          // all the words one after another, see WORD()
+    int     word_pool_len;
+    int     word_pool_size;
+    /*
+     * The alphabet: the character of every letter code, the codes are given
+     * from 1 up as the letters come, see add_letter()
+     */
+    uint32_t letters[CROSSGEN_LETTERS + 1];
+    int     letternum;
+    char    letter_text[256][2][5];             // every code in UTF-8, as it is and upper case
+    unsigned char letter_hash[LETTER_HASH];     // the codes by their characters, 0 - empty slot
+    uint32_t *fold_map;         // options.fold_letters: every letter followed by the one it's taken as
+    int     fold_num;
+    struct cross_pair *pairs;   // pairs of all the words, word by word
+    int     pairnum;
+    int     pairsize;           // size of the pairs[] array
+    int     last_pair;          // the last pair found by build_pairs
+    int     paired;             // the words the pairs are built for, the first ones
+    int     updatable;          // the result may be brought up to date, see crossgen_update()
+    /*
+     * The pair cache file mapped by crossgen_load_cache(), the word pool is
+     * in it and read only till own_cache() copies it
+     */
+    void   *cache;
+    size_t  cache_size;
+
+    struct crossgen_export_node *export_buf;    // the nodes to write, see export_subtree()
+    int     export_len;
+    long    export_roots;       // roots searched by the run, for the sampling
+    struct strie_pair *best_branch;
+
+    /*
+     * Branch-and-bound data, see build_bounds(gen) and branch_bound()
+     */
+    int     bound_search;       // cut off the subtrees that can't beat the best branch
+    int    *partners_left;      /* for every pair of every word: number of
+                                   different words crossed by this and the
+                                   later pairs of the word */
+    int    *root_partners;      /* for every root word: the same for all the
+                                   later words and only the crossed words
+                                   that are not earlier than the root word */
+    int    *root_crossings;     /* for every root word: number of crossings
+                                   the words not earlier than it can take */
+    int     partners_size;      // size of the partners_left[] array
+    int    *root_letters;       // for every root word: letters of it and the later words
+    int     roots_size;         // size of root_partners[], root_crossings[] and root_letters[]
+    atomic_llong best_score;    // score of the best branch found by any worker
+
+    int     search_mode;
+    int     threadnum;
+    int     beam_width;         // nodes of a level expanded by the first beam pass
+    double  time_limit;         // seconds the beam or random search may take, 0 - no limit
+    long    restarts;           // rollouts of the random search, 0 - till the deadline
+    struct random_root *roots;  // the roots of the random search, the best ones first
+    int     rootnum;
+    atomic_llong reported_score;    // score of the last crossword the random search reported
+    int     top;                // number of the best crosswords to keep
+    int     scoring;            // the weights are set, see node_score()
+    int     score_bounded;      // score_bound() may cut off the subtrees
+    int     box_search;         // the crossword must fit into the box
+    int     max_width;          // the box, INT_MAX if there's no limit
+    int     max_height;
+    struct timespec search_start;
+
+    /*
+     * The pools and the workers are kept from one run to another, they are
+     * made anew only when a run has more words than 'search_size'
+     */
+    int     search_size;
+    struct pool node_pool;      // the root nodes that are not searched by the workers
+    struct search_worker *workers;
+    atomic_long pending_tasks;  // tasks pushed but not yet processed
+    atomic_int  search_failed;
+
+    struct crossgen_stats stats;
+    struct crossgen_result result;
+};
+
+static int init_worker(struct crossgen *gen, struct search_worker *worker, int id, const int size);
+static void reset_worker(struct search_worker *worker, const int wordnum);
+static void free_worker(struct search_worker *worker);
+static int expand_node(struct search_worker *worker, const int wordnum, struct strie_pair *main_node);
+static int build_subtree(struct search_worker *worker, const int wordnum, struct strie_pair *top_node);
+static int build_branch(struct search_worker *worker, const int wordnum, int word);
+static struct strie_pair *make_root(struct crossgen *gen, struct pool *node_pool, int word, int index);
+static int stream_node(struct search_worker *worker, const int wordnum, struct strie_pair *main_node);
+static int stream_branch(struct search_worker *worker, const int wordnum, int word);
+static int copy_branch(struct strie_pair **copy, int *size, struct strie_pair *node);
+static int save_best_branch(struct search_worker *worker, struct strie_pair *node);
+static int compare_branches(const struct crossgen *gen, struct strie_pair *a, struct strie_pair *b);
+static int sort_children(struct crossgen *gen, struct strie_pair *node, struct strie_pair **children);
+static int build_pairs(struct crossgen *gen, int wordnum);
+static void find_last_pair(struct crossgen *gen, int wordnum);
+static void drop_pairs(struct crossgen *gen, int word);
+static int build_bounds(struct crossgen *gen, const int wordnum);
+static int first_partner(const struct crossgen *gen, int word, int procreator);
+static int node_bound(const struct crossgen *gen, struct strie_pair *node);
+static long long score_bound(const struct crossgen *gen, struct strie_pair *node, int depth_bound);
+static int branch_bound(struct search_worker *worker, struct strie_pair *main_node);
+static int placement_crossings(struct search_worker *worker, int word, struct cross_pair *pair);
+static int cells_cross(const struct grid_word *a, int xb, int yb, int orient_b, int len_b);
+static int update_best(struct search_worker *worker, struct strie_pair *node);
+static int keep_top(struct search_worker *worker, struct strie_pair *node);
+static int keep_root(struct search_worker *worker, struct strie_pair *root);
+static void raise_best_score(struct crossgen *gen, long long score);
+static int raise_score(atomic_llong *score, long long value);
+static unsigned long long layout_shape(struct strie_pair *node);
+static void box_add(int box[2][2], int x, int y, int orient, int len);
+static int box_fits(const struct crossgen *gen, int box[2][2]);
+static int layout_fits(const struct crossgen *gen, int box[2][2]);
+static int sync_grid(struct search_worker *worker, struct strie_pair *main_node);
+static void clear_grid(struct search_worker *worker);
+static int words_conflict(const struct crossgen *gen, int word_a, int xa, int ya, int orient_a, \
+        int word_b, int xb, int yb, int orient_b);
+static int parallel_search(struct crossgen *gen, const int wordnum);
+static int beam_pass(struct search_worker *worker, const int wordnum, int width, int *cut);
+static int beam_search(struct search_worker *worker, const int wordnum);
+static int random_search(struct crossgen *gen, const int wordnum);
+static double search_time(const struct crossgen *gen);
+static double seconds_since(const struct timespec *start);
+static void count_node(struct search_worker *worker, int depth);
+static int collect_stats(struct crossgen *gen, struct search_worker *worker);
+static struct strie_pair *check_pair(struct search_worker *worker, struct strie_pair *main_node, struct cross_pair *pair);
+static void drop_cache(struct crossgen *gen);
+static int own_cache(struct crossgen *gen);
+static int finish_layout(struct crossgen *gen, struct crossgen_layout *layout);
+static int cut_layout(struct crossgen *gen, struct crossgen_layout *layout, int word);
+static void tidy_result(struct crossgen *gen);
+static int start_export(struct crossgen *gen);
+static int export_subtree(struct crossgen *gen, struct strie_pair *root);
+static int flush_export(struct crossgen *gen);
+
+// The bit of a letter code in a word's letters mask, the codes after 32 share the bits
+static unsigned letter_bit(unsigned char c)
+{
+    return 1u << ((c - 1) & 31);
+}
+
+/*
+ * Find the crossings of the words added since the pairs were built: the
+ * words [gen->paired, wordnum) with all the words before them. The pairs
+ * of the earlier words are kept, so a run after a few words are added
+ * compares only the new ones.
+ *
+ * Every two words with common letters (by their letter masks) are compared
+ * by the match_letters() kernel: for every letter of one word it gives the
+ * mask of the same letters of the other one. The words are padded for the
+ * kernel once. Most couples of words cross when there are many words, so
+ * going through all of them costs little more than storing the pairs.
+ *
+ * Every crossing between words 'i' and 'j' is stored in both words' pair
+ * lists. The lists are kept in one array in the order the crossings are
+ * searched: for word 'l' first go pairs with the earlier words, then with
+ * the later ones, both ordered by the other word, letter 'i' and letter
+ * 'j', which is the order the masks give them in. The new words are the
+ * last ones, so their pairs go to the ends of the old lists, the same
+ * lists all the words at once would get. The pairs are counted the same
+ * way before they are stored, it's cheaper than keeping the masks.
+ */
+static int build_pairs(struct crossgen *gen, int wordnum)
+{
+    const struct simd_kernels *simd = simd_kernels();
+    int i, j, k, c, len, chunks, first, from = gen->paired;
+    unsigned m;
+    unsigned char *padded = NULL;   // the words padded for the kernel
+    int *padded_at = NULL;          // the beginning of every word in 'padded'
+    unsigned *masks = NULL;         // the result of match_letters()
+    int paddedlen = 0, maxlen = 0, pairsnum = 0;
+    long long total = 0;
+    int *filled = NULL;             // number of pairs already stored for the words
+    struct cross_pair *pair = NULL;
+    int ret = 1;
+
+    // Nothing new, e.g. the pairs of a cache are built already
+    if (from == wordnum)
+    {
+        find_last_pair(gen, wordnum);
+        return 0;
+    }
+    if (!(padded_at = (int *)malloc((wordnum + 1) * sizeof(int))) || \
+            !(filled = (int *)calloc(wordnum + 1, sizeof(int))))
+    {
+        goto out;
+    }
+
+    // Letter masks of the new words and room for the padded words
+    for (i = 0; i < wordnum; i++)
+    {
+        len = gen->words[i].wordlen;
+        if (i < from)
+        {
+            filled[i] = gen->words[i].childnum;
+            total += filled[i];
+        }
+        else
+        {
+            gen->words[i].letters = 0;
+            gen->words[i].childnum = 0;
+            for (k = 0; k < len; k++)
+                gen->words[i].letters |= letter_bit((unsigned char)WORD(gen, i)[k]);
+        }
+        padded_at[i] = paddedlen;
+        paddedlen += SIMD_PADDED(len);
+        if (len > maxlen)
+            maxlen = len;
+    }
+    if (!(padded = (unsigned char *)calloc(paddedlen ? paddedlen : 1, 1)) || \
+            !(masks = (unsigned *)malloc((maxlen ? maxlen * SIMD_CHUNKS(maxlen) : 1) * sizeof(unsigned))))
+    {
+        goto out;
+    }
+    for (i = 0; i < wordnum; i++)
+        memcpy(padded + padded_at[i], WORD(gen, i), gen->words[i].wordlen);
+
+    // Count the new pairs of every word
+    for (j = from; j < wordnum; j++)
+    {
+        for (i = 0; i < j; i++)
+        {
+            if (!(gen->words[i].letters & gen->words[j].letters))
+                continue;
+            k = simd->match_letters(padded + padded_at[i], gen->words[i].wordlen, \
+                    padded + padded_at[j], gen->words[j].wordlen, masks);
+            gen->words[i].childnum += k;
+            gen->words[j].childnum += k;
+            total += 2 * k;
+        }
+        // The pairs grow with the square of the words, they are counted by int
+        if (total > INT_MAX)
+        {
+            fprintf(stderr, "Too many pairs between the words: more than %d with %d words\n", INT_MAX, j + 1);
+            goto out;
+        }
+    }
+    pairsnum = total;
+
+    // The array only grows, the next run may reuse it
+    if (pairsnum > gen->pairsize)
+    {
+        struct cross_pair *tmp = NULL;
+        if (!(tmp = (struct cross_pair *)realloc(gen->pairs, (size_t)pairsnum * sizeof(struct cross_pair))))
+            goto out;
+        gen->pairs = tmp;
+        gen->pairsize = pairsnum;
+    }
+    gen->pairnum = pairsnum;
+
+    // Make room for the new pairs, the old lists only move up
+    for (i = wordnum - 1, first = pairsnum; i >= 0; i--)
+    {
+        first -= gen->words[i].childnum;
+        if (i < from && filled[i])
+            memmove(&gen->pairs[first], &gen->pairs[gen->words[i].firstpair], filled[i] * sizeof(struct cross_pair));
+        gen->words[i].firstpair = first;
+    }
+
+    for (j = from; j < wordnum; j++)
+    {
+        for (i = 0; i < j; i++)
+        {
+            if (!(gen->words[i].letters & gen->words[j].letters) || \
+                    !simd->match_letters(padded + padded_at[i], gen->words[i].wordlen, \
+                        padded + padded_at[j], gen->words[j].wordlen, masks))
+            {
+                continue;
+            }
+            chunks = SIMD_CHUNKS(gen->words[j].wordlen);
+            for (k = 0; k < gen->words[i].wordlen; k++)
+            {
+                for (c = 0; c < chunks; c++)
+                {
+                    for (m = masks[k * chunks + c]; m; m &= m - 1)
+                    {
+                        // Store the pair for word[i] and word[j]
+                        pair = &gen->pairs[gen->words[i].firstpair + filled[i]++];
+                        pair->crossed_word[0] = i;
+                        pair->crossed_word[1] = j;
+                        pair->crossed_word_letter[0] = k;
+                        pair->crossed_word_letter[1] = c * SIMD_CHUNK + __builtin_ctz(m);
+#ifdef DEBUG
+                        printf("crossing between %s and %s: %s, %d, %d\n", \
+                                TEXT(gen, i), \
+                                TEXT(gen, j), \
+                                gen->letter_text[(unsigned char)WORD(gen, i)[pair->crossed_word_letter[0]]][0], \
+                                pair->crossed_word_letter[0], \
+                                pair->crossed_word_letter[1]);
+#endif
+                        gen->pairs[gen->words[j].firstpair + filled[j]++] = *pair;
+                    }
+                }
+            }
+        }
+    }
+    gen->paired = wordnum;
+    find_last_pair(gen, wordnum);
+    ret = 0;
+
+out:
+    if (ret && total <= INT_MAX)
+        fprintf(stderr, "Not enough memory!\n");
+    free(padded);
+    free(padded_at);
+    free(masks);
+    free(filled);
+    return ret;
+}
+
+/*
+ * The last pair found by build_pairs() is the best branch till something
+ * better is found. It's the last crossing of the last word that crosses a
+ * later one, in the later word's list, as if the words were compared in
+ * order.
+ */
+static void find_last_pair(struct crossgen *gen, int wordnum)
+{
+    struct cross_pair *pair = NULL;
+    int i, j, n;
+
+    gen->last_pair = -1;
+    for (i = wordnum - 1; i >= 0; i--)
+    {
+        if (!gen->words[i].childnum)
+            continue;
+        // The list ends with the pairs of the latest partner
+        pair = &gen->pairs[gen->words[i].firstpair + gen->words[i].childnum - 1];
+        if ((j = pair->crossed_word[1]) == i)
+            continue;
+        for (n = gen->words[j].childnum - 1; gen->pairs[gen->words[j].firstpair + n].crossed_word[0] != i; n--)
+            ;
+        gen->last_pair = gen->words[j].firstpair + n;
+        return;
+    }
+}
+
+/*
+ * Drop the pairs of the word from the pair lists, the later words are
+ * numbered one less. The lists only move down.
+ */
+static void drop_pairs(struct crossgen *gen, int word)
+{
+    struct cross_pair pair;
+    int i, n, first, num = 0;
+
+    for (i = 0; i < gen->paired; i++)
+    {
+        first = gen->words[i].firstpair;
+        gen->words[i].firstpair = num;
+        if (i == word)
+        {
+            gen->words[i].childnum = 0;
+            continue;
+        }
+        for (n = 0; n < gen->words[i].childnum; n++)
+        {
+            pair = gen->pairs[first + n];
+            if (pair.crossed_word[0] == word || pair.crossed_word[1] == word)
+                continue;
+            pair.crossed_word[0] -= pair.crossed_word[0] > word;
+            pair.crossed_word[1] -= pair.crossed_word[1] > word;
+            gen->pairs[num++] = pair;
+        }
+        gen->words[i].childnum = num - gen->words[i].firstpair;
+    }
+    gen->pairnum = num;
+    gen->paired--;
+}
+
+// The word crossed by the word's pair
+#define PARTNER(word, pair) \
+    ((pair)->crossed_word[0] == (word) ? (pair)->crossed_word[1] : (pair)->crossed_word[0])
+
+/*
+ * Number of the pairs a word can be in when it crosses 'n' words: the
+ * letters it's crossed in must be at least MINDISTANCE apart
+ */
+static int word_crossings(const struct crossgen *gen, int word, int n)
+{
+    int max = (gen->words[word].wordlen + MINDISTANCE - 1) / MINDISTANCE;
+
+    return n < max ? n : max;
+}
+
+/*
+ * Prepare the upper bounds of the branch-and-bound search.
+ *
+ * A branch has one pair for every two crossed words, so from any node the
+ * subtree can add at most as many pairs as there are different (word,
+ * crossed word) couples in the pair lists after the node's cursors. The
+ * pair lists of a word are ordered by the crossed word, so these numbers
+ * are counted once for every position of every list. The subtree of a root
+ * word can't use the earlier words, the couples with them are skipped with
+ * first_partner(gen).
+ *
+ * Every word takes part in at most word_crossings(gen) pairs, their sum for the
+ * words of a root subtree is what branch_bound() starts from.
+ */
+static int build_bounds(struct crossgen *gen, const int wordnum)
+{
+    int w, p, x, base, later, size;
+    long crossings = 0;     // crossings the words not earlier than the root can take
+    long later_pairs = 0;   // different word pairs of the words after the root
+    int *degree = NULL;     // number of the crossed words not earlier than the root
+    struct cross_pair *pair = NULL;
+
+    // The lists go word by word, the last one ends the array
+    size = (wordnum ? gen->words[wordnum - 1].firstpair + gen->words[wordnum - 1].childnum : 0) + wordnum + 1;
+
+    // The arrays only grow, the next run may reuse them
+    if (size > gen->partners_size)
+    {
+        int *tmp = NULL;
+        if (!(tmp = (int *)realloc(gen->partners_left, size * sizeof(int))))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            return 1;
+        }
+        gen->partners_left = tmp;
+        gen->partners_size = size;
+    }
+    if (wordnum + 1 > gen->roots_size)
+    {
+        int *tmp = NULL;
+        if (!(tmp = (int *)realloc(gen->root_partners, (wordnum + 1) * sizeof(int))))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            return 1;
+        }
+        gen->root_partners = tmp;
+        if (!(tmp = (int *)realloc(gen->root_crossings, (wordnum + 1) * sizeof(int))))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            return 1;
+        }
+        gen->root_crossings = tmp;
+        if (!(tmp = (int *)realloc(gen->root_letters, (wordnum + 1) * sizeof(int))))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            return 1;
+        }
+        gen->root_letters = tmp;
+        gen->roots_size = wordnum + 1;
+    }
+    if (!(degree = (int *)calloc(wordnum + 1, sizeof(int))))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return 1;
+    }
+
+    for (w = 0; w < wordnum; w++)
+    {
+        base = gen->words[w].firstpair + w;
+        pair = gen->pairs + gen->words[w].firstpair;
+        gen->partners_left[base + gen->words[w].childnum] = 0;
+        for (p = gen->words[w].childnum - 1; p >= 0; p--)
+        {
+            gen->partners_left[base + p] = gen->partners_left[base + p + 1];
+            if (p == gen->words[w].childnum - 1 || PARTNER(w, &pair[p]) != PARTNER(w, &pair[p + 1]))
+                gen->partners_left[base + p]++;
+        }
+    }
+
+    // Go from the last root word to the first one, every next root adds
+    // itself and its pairs with the later words
+    for (w = wordnum - 1; w >= 0; w--)
+    {
+        base  = gen->words[w].firstpair + w;
+        pair  = gen->pairs + gen->words[w].firstpair;
+        later = first_partner(gen, w, w);
+        for (p = later; p < gen->words[w].childnum; p++)
+        {
+            x = PARTNER(w, &pair[p]);
+            if (p > later && x == PARTNER(w, &pair[p - 1]))
+                continue;
+            crossings -= word_crossings(gen, x, degree[x]);
+            degree[x]++;
+            crossings += word_crossings(gen, x, degree[x]);
+        }
+        degree[w] = gen->partners_left[base + later];
+        crossings += word_crossings(gen, w, degree[w]);
+        // Every pair of the later words is counted in both its words' lists,
+        // the pairs of the root word only in the crossed word's list
+        gen->root_partners[w]  = 2 * later_pairs + degree[w];
+        later_pairs      += degree[w];
+        gen->root_crossings[w] = crossings;
+        gen->root_letters[w]   = gen->words[w].wordlen + (w + 1 < wordnum ? gen->root_letters[w + 1] : 0);
+    }
+
+    free(degree);
+    return 0;
+}
+
+// The first pair of the word with a word not earlier than the root word
+static int first_partner(const struct crossgen *gen, int word, int procreator)
+{
+    struct cross_pair *pair = gen->pairs + gen->words[word].firstpair;
+    int lo = 0, hi = gen->words[word].childnum, mid;
+
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if (PARTNER(word, &pair[mid]) < procreator)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Number of the words not earlier than the root word crossed by the word
+static int root_degree(const struct crossgen *gen, int word, int procreator)
+{
+    return gen->partners_left[gen->words[word].firstpair + word + first_partner(gen, word, procreator)];
+}
+
+// The deepest branch the node's subtree may have judging by its cursors only
+static int node_bound(const struct crossgen *gen, struct strie_pair *node)
+{
+    int bound = node->depth + node->pairs_left;
+    int max   = gen->root_crossings[node->procreator] / 2 - 1;
+
+    return bound < max ? bound : max;
+}
+
+// Score of a crossword by the weights of the generator
+static long long score_of(const struct crossgen *gen, int pairs, int words, int crossings, int letters, \
+        long long area)
+{
+    const int *w = gen->options.weights;
+
+    return (long long)w[CROSSGEN_SCORE_PAIRS] * pairs + (long long)w[CROSSGEN_SCORE_WORDS] * words + \
+        (long long)w[CROSSGEN_SCORE_CROSSINGS] * crossings + (long long)w[CROSSGEN_SCORE_LETTERS] * letters + \
+        w[CROSSGEN_SCORE_AREA] * area + w[CROSSGEN_SCORE_DENSITY] * (letters * 1000LL / area);
+}
+
+/*
+ * Score of the branch of the node. The words, crossings and letters of a
+ * node are its parent's ones plus what the new pair adds, check_pair() keeps
+ * them, so the branch is never walked. Without the weights it's the depth.
+ */
+static long long node_score(const struct crossgen *gen, struct strie_pair *node)
+{
+    return score_of(gen, node->depth + 1, node->words, node->crossings, node->letters, \
+            (long long)BOX_WIDTH(node->box) * BOX_HEIGHT(node->box));
+}
+
+#define NODE_SCORE(gen, node) ((gen)->scoring ? node_score(gen, node) : (node)->depth)
+
+/*
+ * The best score the node's subtree may have if its branches are at most
+ * 'depth_bound' deep. The pairs, the words, the crossings, the letters and
+ * the area only grow down the branch, so a negative weight takes the value
+ * of the node and a positive one the most the value may grow to:
+ *  - every pair adds one word at most;
+ *  - a crossing is one of the crossings the words from the root word on can
+ *    take, each of them is counted in both its words;
+ *  - the letters are the ones of the words from the root word on less the
+ *    crossings already there.
+ * The density is between 0 and 1000, the area has no bound.
+ */
+static long long score_bound(const struct crossgen *gen, struct strie_pair *node, int depth_bound)
+{
+    const int *w = gen->options.weights;
+    long long area = (long long)BOX_WIDTH(node->box) * BOX_HEIGHT(node->box);
+    int pairs, words, crossings, letters;
+
+    if (!gen->score_bounded)
+        return LLONG_MAX;
+    pairs     = w[CROSSGEN_SCORE_PAIRS] < 0 ? node->depth + 1 : depth_bound + 1;
+    words     = node->words + depth_bound - node->depth;
+    if (words > gen->wordnum - node->procreator)
+        words = gen->wordnum - node->procreator;
+    if (w[CROSSGEN_SCORE_WORDS] < 0)
+        words = node->words;
+    crossings = w[CROSSGEN_SCORE_CROSSINGS] < 0 ? node->crossings : gen->root_crossings[node->procreator] / 2;
+    letters   = w[CROSSGEN_SCORE_LETTERS] < 0 ? node->letters : gen->root_letters[node->procreator] - node->crossings;
+    // The area has a negative weight, take the density out and put its bound in
+    return score_of(gen, pairs, words, crossings, letters, area) - \
+        w[CROSSGEN_SCORE_DENSITY] * (letters * 1000LL / area) + \
+        (w[CROSSGEN_SCORE_DENSITY] > 0 ? w[CROSSGEN_SCORE_DENSITY] * 1000LL : 0);
+}
+
+#define SCORE_BOUND(gen, node, depth_bound) \
+    ((gen)->scoring ? score_bound(gen, node, depth_bound) : (depth_bound))
+
+/*
+ * The deepest branch main_node's subtree may have. The branch words are on
+ * the worker's grid. The subtree may add only two kinds of pairs:
+ *  - between two branch words: their places are fixed, so they must already
+ *    cross each other on the grid without a pair;
+ *  - with a new word: every new word takes part in at most word_crossings(gen)
+ *    pairs. It may cross the branch words it has pairs with and the other
+ *    new words, a pair of two new words is counted a half in each of them.
+ * A new word can't join the branch at all if it has no pairs with the
+ * branch words after the cursors and no partners outside the branch. If it
+ * crosses only the branch words, it may be placed only by these pairs, so
+ * it can't take more pairs than the branch words it crosses on the grid.
+ */
+static int branch_bound(struct search_worker *worker, struct strie_pair *main_node)
+{
+    struct crossgen *gen = worker->gen;
+    struct bound_word *bw = worker->bound_words;
+    struct grid_word *a = NULL, *b = NULL;
+    struct cross_pair *pair = NULL;
+    int *placed = worker->bound_list;
+    int *seen = NULL;
+    int procreator = main_node->procreator;
+    int i, j, k, p, w, x, n, m, max, placednum = 0, seennum = 0;
+    long crossings = gen->root_crossings[procreator];
+    int closed = -(main_node->depth + 1);
+
+    if (!++worker->bound_stamp)
+    {
+        memset(bw, 0, gen->search_size * sizeof(struct bound_word));
+        worker->bound_stamp = 1;
+    }
+
+    for (i = 0; i < worker->grid_depth; i++)
+    {
+        for (k = 0; k < 2; k++)
+        {
+            w = worker->grid_branch[i].word[k];
+            if (bw[w].placed == worker->bound_stamp)
+                continue;
+            bw[w].placed = worker->bound_stamp;
+            placed[placednum++] = w;
+            crossings -= word_crossings(gen, w, root_degree(gen, w, procreator));
+        }
+    }
+    seen = placed + placednum;
+
+    // The branch words that cross each other on the grid, the pairs of the
+    // branch are among them
+    for (i = 0; i < placednum; i++)
+    {
+        a = &worker->grid.placed[placed[i]];
+        for (j = i + 1; j < placednum; j++)
+        {
+            b = &worker->grid.placed[placed[j]];
+            if (a->orient == b->orient)
+                continue;
+            if (1 == b->orient)
+            {
+                struct grid_word *tmp = a;
+                a = b;
+                b = tmp;
+            }
+            if (b->x >= a->x && b->x < a->x + a->len && \
+                    a->y <= b->y && a->y > b->y - b->len)
+            {
+                closed++;
+            }
+            a = &worker->grid.placed[placed[i]];
+        }
+    }
+
+    // The words crossed by the branch words
+    for (i = 0; i < placednum; i++)
+    {
+        w = placed[i];
+        pair = gen->pairs + gen->words[w].firstpair;
+        for (p = first_partner(gen, w, procreator); p < gen->words[w].childnum; p++)
+        {
+            x = PARTNER(w, &pair[p]);
+            if (bw[x].placed == worker->bound_stamp)
+                continue;
+            if (bw[x].seen != worker->bound_stamp)
+            {
+                bw[x].seen = worker->bound_stamp;
+                bw[x].crossed = bw[x].available = bw[x].placements = 0;
+                bw[x].degree = root_degree(gen, x, procreator);
+                seen[seennum++] = x;
+            }
+            if (p == 0 || x != PARTNER(w, &pair[p - 1]))
+                bw[x].crossed++;
+            if (p >= worker->cursors[w])
+                bw[x].available = 1;
+        }
+    }
+
+    // Try the places of the new words that cross only the branch words
+    for (i = 0; i < placednum; i++)
+    {
+        w = placed[i];
+        pair = gen->pairs + gen->words[w].firstpair;
+        p = first_partner(gen, w, procreator);
+        if (p < worker->cursors[w])
+            p = worker->cursors[w];
+        for (; p < gen->words[w].childnum; p++)
+        {
+            x = PARTNER(w, &pair[p]);
+            if (bw[x].placed == worker->bound_stamp || bw[x].degree != bw[x].crossed || \
+                    bw[x].placements >= word_crossings(gen, x, bw[x].crossed))
+            {
+                continue;
+            }
+            n = placement_crossings(worker, x, &pair[p]);
+            if (n > bw[x].placements)
+                bw[x].placements = n;
+        }
+    }
+
+    // Twice the number of the pairs the new words may add
+    for (i = 0; i < seennum; i++)
+    {
+        x = seen[i];
+        n = bw[x].degree;
+        crossings -= word_crossings(gen, x, n);
+        if (n == bw[x].crossed)
+        {
+            crossings += 2 * word_crossings(gen, x, bw[x].placements);
+            continue;
+        }
+        max = word_crossings(gen, x, n);
+        m = bw[x].crossed < max ? bw[x].crossed : max;
+        crossings += 2 * m + (n - bw[x].crossed < max - m ? n - bw[x].crossed : max - m);
+    }
+
+    return main_node->depth + closed + crossings / 2;
+}
+
+/*
+ * Where the word of the pair goes when it crosses the partner placed at
+ * 'pos', 'k' is the partner's side of the pair. Returns the orientation.
+ */
+static short place_by_pair(const struct grid_word *pos, const struct cross_pair *pair, int k, int *x, int *y)
+{
+    if (1 == pos->orient)
+    {
+        *x = pos->x + pair->crossed_word_letter[k];
+        *y = pos->y + pair->crossed_word_letter[1 - k];
+    }
+    else
+    {
+        *x = pos->x - pair->crossed_word_letter[1 - k];
+        *y = pos->y - pair->crossed_word_letter[k];
+    }
+    return -pos->orient;
+}
+
+/*
+ * Place the new word by its pair with a branch word and count the branch
+ * words it crosses there. Returns 0 if the word can't be placed so.
+ */
+static int placement_crossings(struct search_worker *worker, int word, struct cross_pair *pair)
+{
+    struct crossgen *gen = worker->gen;
+    int k = pair->crossed_word[0] == word ? 1 : 0;
+    struct grid_word *pos = &worker->grid.placed[pair->crossed_word[k]];
+    struct grid_word *near = NULL;
+    int x, y, i, num, crossed = 0;
+    short orient = place_by_pair(pos, pair, k, &x, &y);
+
+    num = grid_near_words(&worker->grid, x, y, orient, gen->words[word].wordlen, MINDISTANCE - 1);
+    for (i = 0; i < num; i++)
+    {
+        near = &worker->grid.placed[worker->grid.near[i]];
+        if (words_conflict(gen, worker->grid.near[i], near->x, near->y, near->orient, \
+                    word, x, y, orient))
+        {
+            return 0;
+        }
+        if (cells_cross(near, x, y, orient, gen->words[word].wordlen))
+            crossed++;
+    }
+    return crossed;
+}
+
+/*
+ * Check whether the word b crosses the placed word a. Not conflicting
+ * perpendicular words either cross or don't touch.
+ */
+static int cells_cross(const struct grid_word *a, int xb, int yb, int orient_b, int len_b)
+{
+    return a->orient != orient_b && \
+        (1 == orient_b ? \
+         a->x >= xb && a->x < xb + len_b && yb <= a->y && yb > a->y - a->len : \
+         xb >= a->x && xb < a->x + a->len && a->y <= yb && a->y > yb - len_b);
+}
+
+/*
+ * Make the node the worker's best branch if it's better. A single thread
+ * creates and searches the nodes in order, so it's enough to compare the
+ * depth. Workers of a parallel search and the branch-and-bound search take
+ * the nodes in any order. Returns 1 if out of memory.
+ */
+static int update_best(struct search_worker *worker, struct strie_pair *node)
+{
+    struct crossgen *gen = worker->gen;
+
+    // The box of a smaller crossword is never too big, but its sides may
+    // be out of proportion
+    if (gen->options.max_ratio && !layout_fits(gen, node->box))
+        return 0;
+    if (gen->top > 1 && keep_top(worker, node))
+        return 1;
+    // The score of a node may be lower than the parent's one
+    if (!worker->best || \
+            (gen->scoring ? compare_branches(gen, node, worker->best) < 0 : \
+             worker->best->depth < node->depth || \
+             ((gen->threadnum > 1 || gen->bound_search) && worker->best->depth == node->depth && \
+              compare_branches(gen, node, worker->best) < 0)))
+    {
+        worker->best = node;
+        // The bound of the search is the worst crossword kept then
+        if (gen->top > 1)
+            return 0;
+        raise_best_score(gen, NODE_SCORE(gen, node));
+    }
+    return 0;
+}
+
+// Let the other workers cut off the subtrees that can't reach the score
+static void raise_best_score(struct crossgen *gen, long long score)
+{
+    raise_score(&gen->best_score, score);
+}
+
+// Lock-free maximum of the shared score, returns 1 if the value raised it
+static int raise_score(atomic_llong *score, long long value)
+{
+    long long cur = atomic_load(score);
+
+    while (cur < value)
+    {
+        if (atomic_compare_exchange_weak(score, &cur, value))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * A root is a crossword too, but update_best() only sees the nodes below it.
+ * Without an objective a root is never better than the branches below it,
+ * with one it may be the best crossword: e.g. the smallest one. Most search
+ * modes drop the roots with their subtrees, so the best root is copied.
+ */
+static int keep_root(struct search_worker *worker, struct strie_pair *root)
+{
+    struct crossgen *gen = worker->gen;
+    struct strie_pair *best = worker->best;
+
+    if (!layout_fits(gen, root->box))
+        return 0;
+    if (gen->top > 1)
+        return keep_top(worker, root);
+    if (!gen->scoring)
+        return 0;
+    if (update_best(worker, root))
+        return 1;
+    return best != worker->best && save_best_branch(worker, root);
+}
+
+// Compare the crossword of the node with a kept one, < 0 if the node is better
+static int compare_top(const struct crossgen *gen, struct strie_pair *node, int area, const struct top_layout *top)
+{
+    long long sa, sb;
+
+    if (gen->scoring && (sa = node_score(gen, node)) != (sb = node_score(gen, top->branch)))
+        return sa > sb ? -1 : 1;
+    if (node->depth != top->branch->depth)
+        return top->branch->depth - node->depth;
+    if (area != top->area)
+        return area - top->area;
+    return compare_branches(gen, node, top->branch);
+}
+
+#define TOP_WORSE(worker, i, j) \
+    (compare_top((worker)->gen, (worker)->top[i].branch, (worker)->top[i].area, &(worker)->top[j]) > 0)
+#define TOP_SWAP(worker, i, j) \
+    do { struct top_layout tmp = (worker)->top[i]; (worker)->top[i] = (worker)->top[j]; (worker)->top[j] = tmp; } while (0)
+
+// Move the changed crossword of the heap up or down to its place
+static void sift_top(struct search_worker *worker, int i)
+{
+    int child;
+
+    while (i > 0 && TOP_WORSE(worker, i, (i - 1) / 2))
+    {
+        TOP_SWAP(worker, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    while ((child = 2 * i + 1) < worker->topnum)
+    {
+        if (child + 1 < worker->topnum && TOP_WORSE(worker, child + 1, child))
+            child++;
+        if (!TOP_WORSE(worker, child, i))
+            break;
+        TOP_SWAP(worker, i, child);
+        i = child;
+    }
+}
+
+/*
+ * Keep the crossword of the node if it's one of the 'top' best ones the
+ * worker found. The crosswords are copied, so they outlive the strie in any
+ * search mode and take O(top * depth) memory. A crossword already kept is
+ * kept once. Once the heap is full, the worst crossword kept is the bound
+ * of the search: a subtree is cut off only if it can't give even that one.
+ */
+static int keep_top(struct search_worker *worker, struct strie_pair *node)
+{
+    struct crossgen *gen = worker->gen;
+    struct top_layout *top = NULL;
+    unsigned long long shape;
+    int i, area = BOX_WIDTH(node->box) * BOX_HEIGHT(node->box);
+
+    if (worker->topnum == gen->top && compare_top(gen, node, area, &worker->top[0]) >= 0)
+        return 0;
+    shape = layout_shape(node);
+    for (i = 0; i < worker->topnum && worker->top[i].shape != shape; i++)
+        ;
+    if (i < worker->topnum && compare_top(gen, node, area, &worker->top[i]) >= 0)
+        return 0;
+    // A new crossword takes the place of the worst one if the heap is full
+    if (i == worker->topnum && worker->topnum == gen->top)
+        i = 0;
+    top = &worker->top[i];
+    if (copy_branch(&top->branch, &top->size, node))
+        return 1;
+    top->area  = area;
+    top->shape = shape;
+    if (i == worker->topnum)
+        worker->topnum++;
+    sift_top(worker, i);
+
+    if (worker->topnum == gen->top)
+        raise_best_score(gen, NODE_SCORE(gen, worker->top[0].branch));
+    return 0;
+}
+
+/*
+ * Random-looking 64-bit key of a pair of numbers (splitmix64 finalizer).
+ * The shape keys and the random search seeds are made of it.
+ */
+static unsigned long long zobrist_key(unsigned long long a, unsigned long long b)
+{
+    unsigned long long z = a * 0x9E3779B97F4A7C15ULL + b;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// A word of the crossword in layout_shape()
+struct shape_word {
+    int     word;
+    int     orient;
+    int     x, y;
+};
+
+static int compare_shape_words(const void *a, const void *b)
+{
+    return ((const struct shape_word *)a)->word - ((const struct shape_word *)b)->word;
+}
+
+/*
+ * Key of the crossword's shape: the same words in the same places give the
+ * same key wherever the crossword is and whether it's turned or not, no
+ * matter which pairs put them there. A word is placed once, but it's in
+ * several of the pairs, so the words are sorted to take every word once.
+ */
+static unsigned long long shape_key(struct shape_word *words, int num, int box[2][2])
+{
+    unsigned long long key[2] = {0, 0};
+    int i;
+
+    qsort(words, num, sizeof(struct shape_word), compare_shape_words);
+    for (i = 0; i < num; i++)
+    {
+        if (i && words[i].word == words[i - 1].word)
+            continue;
+        key[0] ^= zobrist_key(2 * (unsigned long long)words[i].word + (1 == words[i].orient), \
+                ((unsigned long long)(unsigned)(words[i].x - box[0][0]) << 32) | \
+                (unsigned)(words[i].y - box[0][1]));
+        // Turned the way save_layout() does it: (x, y) goes to (-y, -x)
+        key[1] ^= zobrist_key(2 * (unsigned long long)words[i].word + (1 == -words[i].orient), \
+                ((unsigned long long)(unsigned)(box[1][1] - words[i].y) << 32) | \
+                (unsigned)(box[1][0] - words[i].x));
+    }
+    return key[0] < key[1] ? key[0] : key[1];
+}
+
+// Key of the shape of the node's branch
+static unsigned long long layout_shape(struct strie_pair *node)
+{
+    struct strie_pair *cur_node = NULL;
+    struct shape_word words[2 * (node->depth + 1)];
+    int j, num = 0;
+
+    for (cur_node = node; cur_node; cur_node = cur_node->parent)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            words[num].word   = cur_node->crossed_word[j];
+            words[num].orient = cur_node->word_orient[j];
+            words[num].x      = cur_node->word_coord[j][0];
+            words[num].y      = cur_node->word_coord[j][1];
+            num++;
+        }
+    }
+    return shape_key(words, num, node->box);
+}
+
+// Extend the box by the word
+static void box_add(int box[2][2], int x, int y, int orient, int len)
+{
+    int x1 = 1 == orient ? x + len - 1 : x;
+    int y0 = 1 == orient ? y : y - len + 1;
+
+    if (x < box[0][0])
+        box[0][0] = x;
+    if (y0 < box[0][1])
+        box[0][1] = y0;
+    if (x1 > box[1][0])
+        box[1][0] = x1;
+    if (y > box[1][1])
+        box[1][1] = y;
+}
+
+/*
+ * Check whether the box fits into the generator's one as it is or turned.
+ * Boxes only grow down the branch, so nothing in the subtree of a node
+ * that doesn't fit can fit.
+ */
+static int box_fits(const struct crossgen *gen, int box[2][2])
+{
+    int w = BOX_WIDTH(box), h = BOX_HEIGHT(box);
+
+    return (w <= gen->max_width && h <= gen->max_height) || \
+        (w <= gen->max_height && h <= gen->max_width);
+}
+
+// Check whether the crossword of the box meets all the size limits
+static int layout_fits(const struct crossgen *gen, int box[2][2])
+{
+    int w = BOX_WIDTH(box), h = BOX_HEIGHT(box);
+
+    if (gen->box_search && !box_fits(gen, box))
+        return 0;
+    return !gen->options.max_ratio || \
+        (w > h ? w <= gen->options.max_ratio * h : h <= gen->options.max_ratio * w);
+}
+
+/*
+ * Create the root node of the strie for the pair 'index' of the word
+ */
+static struct strie_pair *make_root(struct crossgen *gen, struct pool *node_pool, int word, int index)
+{
+    struct strie_pair *root = NULL;
+    struct cross_pair *pair = &gen->pairs[gen->words[word].firstpair + index];
+    int i;
+
+    if (!(root = (struct strie_pair*)pool_alloc(node_pool)))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return NULL;
+    }
+    root->crossed_word[0]    = pair->crossed_word[0];
+    root->crossed_word[1]    = pair->crossed_word[1];
+    root->crossed_word_letter[0] = pair->crossed_word_letter[0];
+    root->crossed_word_letter[1] = pair->crossed_word_letter[1];
+    root->word_orient[0] = 1;
+    root->word_orient[1] = -(root->word_orient[0]);
+    root->word_coord[0][0] = 0;
+    root->word_coord[0][1] = 0;
+    root->word_coord[1][0] = root->crossed_word_letter[0];
+    root->word_coord[1][1] = root->crossed_word_letter[1];
+    root->box[0][0] = root->box[0][1] = INT_MAX;
+    root->box[1][0] = root->box[1][1] = INT_MIN;
+    for (i = 0; i < 2; i++)
+    {
+        box_add(root->box, root->word_coord[i][0], root->word_coord[i][1], root->word_orient[i], \
+                gen->words[root->crossed_word[i]].wordlen);
+    }
+    root->depth = 0;
+    root->words = 2;
+    root->crossings = 1;
+    root->letters = gen->words[root->crossed_word[0]].wordlen + gen->words[root->crossed_word[1]].wordlen - 1;
+    root->procreator = word;
+    root->order = gen->words[word].firstpair + index;
+    root->firstchild = NULL;
+    root->brother    = NULL;
+    root->parent     = NULL;
+    // The pairs before this one have been searched by the previous roots
+    root->cursor.next   = NULL;
+    root->cursor.word   = word;
+    root->cursor.cursor = index + 1;
+    if (gen->bound_search)
+    {
+        int first = first_partner(gen, word, word);
+        root->pairs_left = gen->root_partners[word] + \
+            gen->partners_left[gen->words[word].firstpair + word + (index + 1 > first ? index + 1 : first)];
+    }
+    return root;
+}
+
+// Make the worker for up to 'size' words
+static int init_worker(struct crossgen *gen, struct search_worker *worker, int id, const int size)
+{
+    memset(worker, 0, sizeof(struct search_worker));
+    worker->gen = gen;
+    worker->id = id;
+    if (pool_init(&worker->node_pool, sizeof(struct strie_pair), 0) || \
+            pool_init(&worker->cursor_pool, sizeof(struct cursor_delta), 0) || \
+            !(worker->cursors = (int *)calloc(size, sizeof(int))) || \
+            !(worker->finished = (int *)malloc(size * sizeof(int))) || \
+            pthread_mutex_init(&worker->deque.lock, NULL) || \
+            grid_init(&worker->grid, size) || \
+            (gen->bound_search && \
+             (!(worker->bound_words = (struct bound_word *)calloc(size, sizeof(struct bound_word))) || \
+              !(worker->bound_list = (int *)malloc(size * sizeof(int))))) || \
+            (gen->top > 1 && !(worker->top = (struct top_layout *)calloc(gen->top, sizeof(struct top_layout)))))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Make the worker ready for a new run: forget the best branch, the tasks and
+ * the statistics of the previous one. Its strie is dropped by reset_search().
+ */
+static void reset_worker(struct search_worker *worker, const int wordnum)
+{
+    worker->wordnum = wordnum;
+    worker->best = worker->gen->best_branch;
+    worker->topnum = 0;
+    worker->deque.head = worker->deque.tail = 0;
+    worker->nodes = 0;
+    worker->pruned = 0;
+    worker->restarts = 0;
+    memset(worker->rejects, 0, sizeof(worker->rejects));
+    if (worker->depth_nodes)
+        memset(worker->depth_nodes, 0, worker->depth_nodes_len * sizeof(long));
+}
+
+static void free_worker(struct search_worker *worker)
+{
+    int i;
+
+    pool_destroy(&worker->node_pool);
+    pool_destroy(&worker->cursor_pool);
+    free(worker->cursors);
+    free(worker->finished);
+    free(worker->best_snapshot);
+    for (i = 0; worker->top && i < worker->gen->top; i++)
+        free(worker->top[i].branch);
+    free(worker->top);
+    free(worker->deque.tasks);
+    pthread_mutex_destroy(&worker->deque.lock);
+    grid_free(&worker->grid);
+    free(worker->grid_branch);
+    free(worker->bound_words);
+    free(worker->bound_list);
+    free(worker->depth_nodes);
+}
+
+/*
+ * Count a new node of the worker. The numbers of the nodes at every depth
+ * are only statistics, they are not counted if there's no memory for them.
+ */
+static void count_node(struct search_worker *worker, int depth)
+{
+    worker->nodes++;
+    if (depth >= worker->depth_nodes_len)
+    {
+        long *tmp = NULL;
+        int len = 2 * depth + 16;
+        if (!(tmp = (long *)realloc(worker->depth_nodes, len * sizeof(long))))
+            return;
+        memset(tmp + worker->depth_nodes_len, 0, (len - worker->depth_nodes_len) * sizeof(long));
+        worker->depth_nodes = tmp;
+        worker->depth_nodes_len = len;
+    }
+    worker->depth_nodes[depth]++;
+}
+
+// Remove all the nodes from the worker's grid
+static void clear_grid(struct search_worker *worker)
+{
+    struct grid_entry *entry = NULL;
+
+    while (worker->grid_depth > 0)
+    {
+        entry = &worker->grid_branch[--worker->grid_depth];
+        grid_remove(&worker->grid, entry->word[0]);
+        grid_remove(&worker->grid, entry->word[1]);
+    }
+}
+
+/*
+ * Put the words of main_node's branch on the worker's grid. Only the nodes
+ * that differ from the previously placed branch are removed and placed, the
+ * search moves from a node to its child, brother or close relative, so
+ * usually it's just a couple of nodes.
+ */
+static int sync_grid(struct search_worker *worker, struct strie_pair *main_node)
+{
+    struct crossgen *gen = worker->gen;
+    struct strie_pair *cur_node = NULL;
+    struct grid_entry *entry = NULL;
+    int i, k, len = main_node->depth + 1;
+
+    if (len > worker->grid_branch_len)
+    {
+        struct grid_entry *tmp = NULL;
+        if (!(tmp = (struct grid_entry *)realloc(worker->grid_branch, 2 * len * sizeof(struct grid_entry))))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            return 1;
+        }
+        worker->grid_branch = tmp;
+        worker->grid_branch_len = 2 * len;
+    }
+
+    // Find the first node on the grid that is not in the branch. The nodes
+    // are compared from the root down, so every node we look at is alive:
+    // the children of a branch node are dropped only after it's searched.
+    // A dropped root must be cleared from the grid by the caller.
+    {
+        struct strie_pair *branch[len];
+
+        for (i = len - 1, cur_node = main_node; cur_node; cur_node = cur_node->parent)
+            branch[i--] = cur_node;
+        for (k = 0; k < worker->grid_depth && k < len; k++)
+        {
+            if (worker->grid_branch[k].node != branch[k])
+                break;
+        }
+
+        while (worker->grid_depth > k)
+        {
+            entry = &worker->grid_branch[--worker->grid_depth];
+            grid_remove(&worker->grid, entry->word[0]);
+            grid_remove(&worker->grid, entry->word[1]);
+        }
+        for (; k < len; k++)
+        {
+            cur_node = branch[k];
+            entry = &worker->grid_branch[worker->grid_depth++];
+            entry->node = cur_node;
+            for (i = 0; i < 2; i++)
+            {
+                entry->word[i] = cur_node->crossed_word[i];
+                if (grid_place(&worker->grid, cur_node->crossed_word[i], \
+                            cur_node->word_coord[i][0], cur_node->word_coord[i][1], \
+                            cur_node->word_orient[i], gen->words[cur_node->crossed_word[i]].wordlen))
+                {
+                    fprintf(stderr, "Not enough memory!\n");
+                    if (i)
+                        grid_remove(&worker->grid, entry->word[0]);
+                    worker->grid_depth--;
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Put the cursors of the node into the worker's cursors array. Only the
+ * words of the node's branch are ever looked up there, they start from
+ * their first pairs and the moves of the node's list move them forward.
+ * A cursor only goes forward down the branch, so the furthest move of a
+ * word is the last one.
+ */
+static void load_cursors(struct search_worker *worker, struct strie_pair *node)
+{
+    const struct cursor_delta *delta = NULL;
+    struct strie_pair *cur_node = NULL;
+    int *cursors = worker->cursors;
+
+    for (cur_node = node; cur_node; cur_node = cur_node->parent)
+    {
+        cursors[cur_node->crossed_word[0]] = 0;
+        cursors[cur_node->crossed_word[1]] = 0;
+    }
+    for (delta = &node->cursor; delta; delta = delta->next)
+    {
+        if (delta->cursor > cursors[delta->word])
+            cursors[delta->word] = delta->cursor;
+    }
+}
+
+/*
+ * Add all possible children to main_node
+ */
+static int expand_node(struct search_worker *worker, const int wordnum, struct strie_pair *main_node)
+{
+    struct crossgen *gen = worker->gen;
+    int order = 0;
+    int  cur_word_num, checking_word_num;
+    struct strie_pair *cur_node = main_node;
+    struct cross_pair *pair     = NULL;
+    struct cross_pair *last     = NULL;
+    struct strie_pair *schild   = NULL;
+    struct strie_pair *latest_child = NULL;
+    int *cur_available_first_children = worker->cursors;
+    int *partners = NULL;
+    int pairs_left = main_node->pairs_left, first = 0, j, start, finishednum = 0;
+    long rejects;
+    const struct cursor_delta *moved = &main_node->cursor;    // the moves the children share
+    struct cursor_delta *delta = NULL;
+
+    // A root may be too big by itself, the children are checked by check_pair
+    if (gen->box_search && !main_node->parent && !box_fits(gen, main_node->box))
+        return 0;
+
+    // Nothing in the subtree can be better than the best branch found
+    if (gen->bound_search && SCORE_BOUND(gen, main_node, node_bound(gen, main_node)) < atomic_load(&gen->best_score))
+    {
+        worker->pruned++;
+        return 0;
+    }
+
+    load_cursors(worker, main_node);
+
+    if (sync_grid(worker, main_node))
+        return 1;
+
+    if (gen->bound_search && \
+            SCORE_BOUND(gen, main_node, branch_bound(worker, main_node)) < atomic_load(&gen->best_score))
+    {
+        worker->pruned++;
+        return 0;
+    }
+
+    // cur_node  - the node, which participants we are trying to scan
+    // main_node - the node _to_ which we are trying to add these participants
+    cur_node = main_node;
+    while (cur_node)
+    {
+        for (cur_word_num = 0; cur_word_num < 2; cur_word_num++)
+        {
+            // The global index of the word to check
+            checking_word_num = cur_node->crossed_word[cur_word_num];
+            // We shouldn't allow to search previous words for pairs
+            if (checking_word_num < main_node->procreator)
+                break;
+
+            if (!gen->words[checking_word_num].childnum)
+                break;
+
+            if (gen->bound_search)
+            {
+                partners = gen->partners_left + gen->words[checking_word_num].firstpair + checking_word_num;
+                first = first_partner(gen, checking_word_num, main_node->procreator);
+            }
+
+            last = gen->pairs + gen->words[checking_word_num].firstpair + gen->words[checking_word_num].childnum;
+            start = cur_available_first_children[checking_word_num];
+            for (pair = gen->pairs + gen->words[checking_word_num].firstpair + cur_available_first_children[checking_word_num]; \
+                    pair < last; pair++)
+            {
+                // Keep the bound of the pairs after the cursors up to date
+                if (gen->bound_search && cur_available_first_children[checking_word_num] >= first)
+                {
+                    pairs_left -= partners[cur_available_first_children[checking_word_num]] - \
+                        partners[cur_available_first_children[checking_word_num] + 1];
+                }
+                cur_available_first_children[checking_word_num]++;
+                if (worker->dead && PAIR_DEAD(worker, pair - gen->pairs))
+                    continue;
+                rejects = worker->rejects[REJECT_CHILD] + worker->rejects[REJECT_DISCONNECTED];
+                if (NULL != (schild = check_pair(worker, main_node, pair)))
+                {
+                    // Add new child to main_node
+                    schild->parent = main_node;
+                    schild->order = order++;
+                    schild->pairs_left = pairs_left;
+                    count_node(worker, schild->depth);
+                    // The words scanned to the end since the previous
+                    // child are the moves of this child and the next ones
+                    for (j = 0; j < finishednum; j++)
+                    {
+                        if (!(delta = (struct cursor_delta *)pool_alloc(&worker->cursor_pool)))
+                        {
+                            fprintf(stderr, "Not enough memory!\n");
+                            return 1;
+                        }
+                        delta->next   = moved;
+                        delta->word   = worker->finished[j];
+                        delta->cursor = cur_available_first_children[delta->word];
+                        moved = delta;
+                    }
+                    finishednum = 0;
+                    schild->cursor.next   = moved;
+                    schild->cursor.word   = checking_word_num;
+                    schild->cursor.cursor = cur_available_first_children[checking_word_num];
+                    // Add child to the parent either as the first
+                    // child or add the brother to the latest child
+                    if (NULL == main_node->firstchild || NULL == latest_child)
+                    {
+                        main_node->firstchild = schild;
+                    }
+                    else
+                    {
+                        latest_child->brother = schild;
+                    }
+                    latest_child = schild;
+                    // Check whether it's better than current best branch
+                    if (update_best(worker, schild))
+                        return 1;
+                }
+                // A rollout's branch only grows, so a conflict with it stays.
+                // A pair that is a child already or doesn't touch the branch
+                // may fit later.
+                else if (worker->dead && \
+                        rejects == worker->rejects[REJECT_CHILD] + worker->rejects[REJECT_DISCONNECTED])
+                {
+                    PAIR_KILL(worker, pair - gen->pairs);
+                }
+            }
+            if (cur_available_first_children[checking_word_num] > start)
+                worker->finished[finishednum++] = checking_word_num;
+        }
+        cur_node = cur_node->parent;
+    }
+    return 0;
+}
+
+/* Its goal is to add all children to the current node, move the current node
+ * pointer and repeat until the whole subtree of top_node is built. The whole
+ * subtree is kept in memory.
+ */
+static int build_subtree(struct search_worker *worker, const int wordnum, struct strie_pair *top_node)
+{
+    struct strie_pair *main_node = top_node;
+
+    while (main_node)
+    {
+        if (expand_node(worker, wordnum, main_node))
+            return 1;
+
+        // Go down or to the brother or to the first !NULL parent's brother
+        // without leaving the subtree
+        if (main_node->firstchild)
+        {
+            main_node = main_node->firstchild;
+        }
+        else
+        {
+            while (main_node != top_node && !main_node->brother)
+                main_node = main_node->parent;
+            if (main_node == top_node)
+            {
+                // We've processed all the subtree
+                break;
+            }
+            main_node = main_node->brother;
+        }
+    }
+    return 0;
+}
+
+static int build_branch(struct search_worker *worker, const int wordnum, int word)
+{
+    struct crossgen *gen = worker->gen;
+    struct strie_pair *root = NULL;
+    int i;
+
+    // Every pair of the word is a root of its own subtree
+    for (i = 0; i < gen->words[word].childnum; i++)
+    {
+        if (!(root = make_root(gen, &worker->node_pool, word, i)) || keep_root(worker, root))
+            return 1;
+        count_node(worker, 0);
+        if (build_subtree(worker, wordnum, root))
+            return 1;
+        if (gen->options.export_file && export_subtree(gen, root))
+            return 1;
+    }
+    // This code is reached only when all pairs for the word have been
+    // processed
+    return 0;
+}
+
+/*
+ * Streaming version of build_subtree: walk the same strie depth-first but
+ * keep only the current branch and the children of its nodes. Each node's
+ * subtree is dropped as soon as it has been searched, so memory depends on
+ * the crossword depth, not on the strie size. The node's children have to
+ * stay while we are under one of them because check_pair looks through the
+ * elder brothers of the branch nodes.
+ */
+static int stream_node(struct search_worker *worker, const int wordnum, struct strie_pair *main_node)
+{
+    struct crossgen *gen = worker->gen;
+    struct pool_mark node_mark, cursor_mark;
+    struct strie_pair *best = worker->best;
+    struct strie_pair *schild = NULL;
+    int i, n;
+
+    pool_mark(&worker->node_pool, &node_mark);
+    pool_mark(&worker->cursor_pool, &cursor_mark);
+
+    if (expand_node(worker, wordnum, main_node))
+        return 1;
+    // The best branch is going to be dropped with the subtree, save it
+    if (best != worker->best && save_best_branch(worker, worker->best))
+        return 1;
+
+    for (n = 0, schild = main_node->firstchild; schild; schild = schild->brother)
+        n++;
+    if (n)
+    {
+        struct strie_pair *children[n];
+
+        n = sort_children(gen, main_node, children);
+        for (i = 0; i < n; i++)
+        {
+            if (stream_node(worker, wordnum, children[i]))
+                return 1;
+        }
+    }
+
+    main_node->firstchild = NULL;
+    pool_rewind(&worker->node_pool, &node_mark);
+    pool_rewind(&worker->cursor_pool, &cursor_mark);
+    return 0;
+}
+
+static int stream_branch(struct search_worker *worker, const int wordnum, int word)
+{
+    struct crossgen *gen = worker->gen;
+    struct pool_mark node_mark, cursor_mark;
+    struct strie_pair *root = NULL;
+    int i;
+
+    // Every pair of the word is a root of its own subtree, drop it along
+    // with the subtree
+    for (i = 0; i < gen->words[word].childnum; i++)
+    {
+        pool_mark(&worker->node_pool, &node_mark);
+        pool_mark(&worker->cursor_pool, &cursor_mark);
+        if (!(root = make_root(gen, &worker->node_pool, word, i)) || keep_root(worker, root))
+            return 1;
+        count_node(worker, 0);
+        if (stream_node(worker, wordnum, root))
+            return 1;
+        pool_rewind(&worker->node_pool, &node_mark);
+        pool_rewind(&worker->cursor_pool, &cursor_mark);
+        // The next root takes the place of this one, so the grid can't
+        // tell them apart
+        clear_grid(worker);
+    }
+    return 0;
+}
+
+/*
+ * Copy the branch from node to the root into the 'copy' array of 'size'
+ * nodes, the array grows if the branch is longer. The copy keeps the orders
+ * of the nodes, so compare_branches() works on it, but not the children and
+ * the cursors.
+ */
+static int copy_branch(struct strie_pair **copy, int *size, struct strie_pair *node)
+{
+    struct strie_pair *cur_node = NULL;
+    int i, len = 0;
+
+    for (cur_node = node; cur_node; cur_node = cur_node->parent)
+        len++;
+
+    if (len > *size)
+    {
+        struct strie_pair *tmp = NULL;
+        if (!(tmp = (struct strie_pair *)realloc(*copy, len * sizeof(struct strie_pair))))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            return 1;
+        }
+        *copy = tmp;
+        *size = len;
+    }
+
+    for (i = 0, cur_node = node; cur_node; i++, cur_node = cur_node->parent)
+    {
+        memcpy(&(*copy)[i], cur_node, sizeof(struct strie_pair));
+        (*copy)[i].firstchild = NULL;
+        (*copy)[i].brother = NULL;
+        (*copy)[i].cursor.next = NULL;
+        (*copy)[i].parent = cur_node->parent ? &(*copy)[i + 1] : NULL;
+    }
+    return 0;
+}
+
+/*
+ * Copy the branch from node to the root into the worker's best_snapshot and
+ * make it the worker's best branch.
+ */
+static int save_best_branch(struct search_worker *worker, struct strie_pair *node)
+{
+    // A root kept by keep_root() is in the snapshot already
+    if (node == worker->best_snapshot)
+        return 0;
+    if (copy_branch(&worker->best_snapshot, &worker->best_snapshot_len, node))
+        return 1;
+    worker->best = worker->best_snapshot;
+    return 0;
+}
+
+static int compare_bounds(const void *a, const void *b, void *arg)
+{
+    const struct crossgen *gen = (const struct crossgen *)arg;
+    struct strie_pair *na = *(struct strie_pair **)a;
+    struct strie_pair *nb = *(struct strie_pair **)b;
+    long long ba = SCORE_BOUND(gen, na, node_bound(gen, na)), bb = SCORE_BOUND(gen, nb, node_bound(gen, nb));
+
+    if (ba != bb)
+        return ba > bb ? -1 : 1;
+    return na->order - nb->order;
+}
+
+/*
+ * Put the node's children into the array in the order they should be
+ * searched: the order of creation or, in the branch-and-bound search, the
+ * highest bound first. The brothers list itself is never reordered, the
+ * elder brothers checks rely on it. Returns the number of the children.
+ */
+static int sort_children(struct crossgen *gen, struct strie_pair *node, struct strie_pair **children)
+{
+    struct strie_pair *schild = NULL;
+    int n = 0;
+
+    for (schild = node->firstchild; schild; schild = schild->brother)
+        children[n++] = schild;
+    if (gen->bound_search)
+        qsort_r(children, n, sizeof(struct strie_pair *), compare_bounds, gen);
+    return n;
+}
+
+/*
+ * Compare two branches the way a single threaded search does: the deeper one
+ * is better and of two branches with the same depth the one created first
+ * wins. A node is created when its parent is expanded and the parents are
+ * expanded in preorder, so compare the parents' positions in the strie and
+ * then the nodes' own orders. Returns < 0 if 'a' is better than 'b'.
+ */
+static int compare_branches(const struct crossgen *gen, struct strie_pair *a, struct strie_pair *b)
+{
+    int i, la, lb;
+    long long sa, sb;
+    struct strie_pair *cur_node = NULL;
+
+    if (gen->scoring && (sa = node_score(gen, a)) != (sb = node_score(gen, b)))
+        return sa > sb ? -1 : 1;
+    if (a->depth != b->depth)
+        return b->depth - a->depth;
+    if (a == b)
+        return 0;
+    // Brothers differ only in the last order
+    if (a->parent && a->parent == b->parent)
+        return a->order - b->order;
+
+    {
+        // Orders of the nodes from the root down to the node
+        int path_a[a->depth + 1], path_b[b->depth + 1];
+
+        for (la = 0, cur_node = a; cur_node; cur_node = cur_node->parent)
+            path_a[a->depth - la++] = cur_node->order;
+        for (lb = 0, cur_node = b; cur_node; cur_node = cur_node->parent)
+            path_b[b->depth - lb++] = cur_node->order;
+
+        // The parents are the first la - 1 and lb - 1 elements, a parent
+        // is expanded before all the nodes of its subtree
+        for (i = 0; i < la - 1 && i < lb - 1; i++)
+        {
+            if (path_a[i] != path_b[i])
+                return path_a[i] - path_b[i];
+        }
+        if (la != lb)
+            return la - lb;
+        return path_a[la - 1] - path_b[lb - 1];
+    }
+}
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Seconds since the search started
+static double search_time(const struct crossgen *gen)
+{
+    return seconds_since(&gen->search_start);
+}
+
+/*
+ * Add the node to the beam level, the array grows twice when it's full
+ */
+static int beam_push(struct beam_level *level, struct strie_pair *node)
+{
+    if (level->num == level->size)
+    {
+        struct strie_pair **tmp = NULL;
+        int size = level->size ? level->size * 2 : 256;
+        if (!(tmp = (struct strie_pair **)realloc(level->nodes, size * sizeof(struct strie_pair *))))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            return 1;
+        }
+        level->nodes = tmp;
+        level->size  = size;
+    }
+    level->nodes[level->num++] = node;
+    return 0;
+}
+
+// The higher bound goes first, the nodes with the same bound go in the
+// order the exhaustive search would create them
+static int compare_beam(const void *a, const void *b, void *arg)
+{
+    const struct crossgen *gen = (const struct crossgen *)arg;
+    struct strie_pair *na = *(struct strie_pair **)a;
+    struct strie_pair *nb = *(struct strie_pair **)b;
+    long long ba = SCORE_BOUND(gen, na, node_bound(gen, na)), bb = SCORE_BOUND(gen, nb, node_bound(gen, nb));
+
+    if (ba != bb)
+        return ba > bb ? -1 : 1;
+    return compare_branches(gen, na, nb);
+}
+
+// Keep only the 'width' nodes of the level with the highest bounds
+static int beam_cut(struct crossgen *gen, struct beam_level *level, int width)
+{
+    if (level->num <= width)
+        return 0;
+    qsort_r(level->nodes, level->num, sizeof(struct strie_pair *), compare_beam, gen);
+    level->num = width;
+    return 1;
+}
+
+/*
+ * One pass of the beam search: the strie is built level by level from all
+ * the roots, but only 'width' nodes of every level with the highest bounds
+ * are expanded. The nodes are made by the same expand_node() as in the
+ * exhaustive search, the whole pass lives in the worker's pools. Sets
+ * 'cut' if some nodes were left out, i.e. the pass wasn't exhaustive.
+ * Returns -1 on error and 1 if the deadline has passed.
+ */
+static int beam_pass(struct search_worker *worker, const int wordnum, int width, int *cut)
+{
+    struct crossgen *gen = worker->gen;
+    struct beam_level level[2];
+    struct beam_level *cur = &level[0], *next = &level[1], *tmp = NULL;
+    struct strie_pair *node = NULL, *schild = NULL, *best = NULL;
+    int i, ret = -1;
+
+    memset(level, 0, sizeof(level));
+    *cut = 0;
+    for (i = 0; i < wordnum; i++)
+    {
+        int j;
+        for (j = 0; j < gen->words[i].childnum; j++)
+        {
+            if (!(node = make_root(gen, &worker->node_pool, i, j)) || \
+                    beam_push(cur, node) || keep_root(worker, node))
+            {
+                goto out;
+            }
+            count_node(worker, 0);
+        }
+    }
+
+    while (cur->num)
+    {
+        *cut |= beam_cut(gen, cur, width);
+        next->num = 0;
+        for (i = 0; i < cur->num; i++)
+        {
+            if (gen->time_limit > 0 && search_time(gen) >= gen->time_limit)
+            {
+                ret = 1;
+                goto out;
+            }
+            best = worker->best;
+            if (expand_node(worker, wordnum, cur->nodes[i]))
+                goto out;
+            // The pass is dropped with the pools, keep the best branch
+            if (best != worker->best)
+            {
+                if (save_best_branch(worker, worker->best))
+                    goto out;
+                if (gen->options.progress)
+                {
+                    gen->options.progress(worker->best->depth + 1, search_time(gen), width, \
+                            gen->options.progress_arg);
+                }
+            }
+            for (schild = cur->nodes[i]->firstchild; schild; schild = schild->brother)
+            {
+                if (beam_push(next, schild))
+                    goto out;
+            }
+        }
+        tmp  = cur;
+        cur  = next;
+        next = tmp;
+    }
+    ret = 0;
+
+out:
+    free(level[0].nodes);
+    free(level[1].nodes);
+    return ret;
+}
+
+/*
+ * Anytime search: run beam passes with the width doubled every time until
+ * a pass leaves nothing out or the deadline passes. Every pass starts from
+ * scratch, the best branch found so far is kept in the worker's snapshot.
+ */
+static int beam_search(struct search_worker *worker, const int wordnum)
+{
+    struct crossgen *gen = worker->gen;
+    int width, cut = 1, ret = 0;
+
+    for (width = gen->beam_width; cut && !ret; width = width > INT_MAX / 2 ? INT_MAX : width * 2)
+    {
+        if ((ret = beam_pass(worker, wordnum, width, &cut)) < 0)
+            return 1;
+        clear_grid(worker);
+        pool_reset(&worker->node_pool);
+        pool_reset(&worker->cursor_pool);
+    }
+    gen->result.timed_out = ret;
+    return 0;
+}
+
+// xorshift64*, the same rollouts on every platform
+static unsigned long long next_random(unsigned long long *random)
+{
+    *random ^= *random >> 12;
+    *random ^= *random << 25;
+    *random ^= *random >> 27;
+    return *random * 0x2545F4914F6CDD1DULL;
+}
+
+// The higher bound goes first, then the order of the exhaustive search
+static int compare_roots(const void *a, const void *b)
+{
+    const struct random_root *ra = (const struct random_root *)a;
+    const struct random_root *rb = (const struct random_root *)b;
+
+    if (ra->bound != rb->bound)
+        return ra->bound > rb->bound ? -1 : 1;
+    if (ra->word != rb->word)
+        return ra->word - rb->word;
+    return ra->index - rb->index;
+}
+
+/*
+ * The roots of all the pairs sorted by their bounds. A root reaches only
+ * the words that are not earlier than its word, so the roots of the
+ * first words usually have the highest bounds.
+ */
+static int sort_roots(struct crossgen *gen, const int wordnum)
+{
+    struct strie_pair *root = NULL;
+    int i, j, n = 0;
+
+    for (i = 0; i < wordnum; i++)
+        n += gen->words[i].childnum;
+    if (!(gen->roots = (struct random_root *)malloc((n ? n : 1) * sizeof(struct random_root))))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return 1;
+    }
+    for (i = 0, n = 0; i < wordnum; i++)
+    {
+        for (j = 0; j < gen->words[i].childnum; j++, n++)
+        {
+            if (!(root = make_root(gen, &gen->node_pool, i, j)))
+                return 1;
+            gen->roots[n].word  = i;
+            gen->roots[n].index = j;
+            gen->roots[n].bound = SCORE_BOUND(gen, root, node_bound(gen, root));
+            pool_unalloc(&gen->node_pool, root);
+        }
+    }
+    qsort(gen->roots, n, sizeof(struct random_root), compare_roots);
+    gen->rootnum = n;
+    return 0;
+}
+
+/*
+ * One randomized greedy rollout: start from one of the RANDOM_ROOTS roots
+ * with the highest bounds and go down the strie, every time to one of the
+ * RANDOM_CANDIDATES children with the highest bounds, until a node has no
+ * children. The children are made by the same expand_node() as in the
+ * exhaustive search, so the rollout ends as soon as its node can't beat
+ * the best crossword of all the workers. The branch only grows, so a pair
+ * check_pair() rejects for a conflict with it is never checked again: the
+ * pair is dead till the end of the rollout. The rollout lives in the
+ * worker's pools, the best branch is kept in the worker's snapshot.
+ * Returns -1 on error and 1 if the deadline has passed.
+ */
+static int random_rollout(struct search_worker *worker, const int wordnum, unsigned long long *random)
+{
+    struct crossgen *gen = worker->gen;
+    struct random_root *start = NULL;
+    struct strie_pair *node = NULL, *schild = NULL, *best = worker->best;
+    int n, ret = -1;
+
+    memset(worker->dead, 0, worker->dead_size * sizeof(unsigned long long));
+    start = &gen->roots[next_random(random) % (gen->rootnum < RANDOM_ROOTS ? gen->rootnum : RANDOM_ROOTS)];
+    if (!(node = make_root(gen, &worker->node_pool, start->word, start->index)) || keep_root(worker, node))
+        goto out;
+    count_node(worker, 0);
+    while (node)
+    {
+        if (gen->time_limit > 0 && search_time(gen) >= gen->time_limit)
+        {
+            ret = 1;
+            break;
+        }
+        if (expand_node(worker, wordnum, node))
+            goto out;
+        for (n = 0, schild = node->firstchild; schild; schild = schild->brother)
+            n++;
+        if (!n)
+            break;
+        {
+            struct strie_pair *children[n];
+
+            n = sort_children(gen, node, children);
+            schild = children[next_random(random) % (n < RANDOM_CANDIDATES ? n : RANDOM_CANDIDATES)];
+            // The brothers are not searched, but check_pair() would look
+            // through them
+            node->firstchild = schild;
+            schild->brother = NULL;
+            node = schild;
+        }
+    }
+    // The rollout is dropped with the pools, keep the best branch
+    if (best != worker->best && save_best_branch(worker, worker->best))
+    {
+        ret = -1;
+        goto out;
+    }
+    if (ret < 0)
+        ret = 0;
+
+out:
+    clear_grid(worker);
+    pool_reset(&worker->node_pool);
+    pool_reset(&worker->cursor_pool);
+    return ret;
+}
+
+/*
+ * Worker w of n runs the restarts w, w + n, w + 2n... Every restart has its
+ * own random numbers seeded by the seed and the restart, so it takes the
+ * same choices on any thread.
+ */
+static void *random_thread(void *arg)
+{
+    struct search_worker *worker = (struct search_worker *)arg;
+    struct crossgen *gen = worker->gen;
+    unsigned long long random;
+    long restart;
+    int ret, last = worker->wordnum - 1;
+
+    // The pairs are numbered up to the end of the last word's list
+    worker->dead_size = ((last < 0 ? 0 : gen->words[last].firstpair + gen->words[last].childnum) + 63) / 64;
+    if (!(worker->dead = (unsigned long long *)malloc((worker->dead_size ? worker->dead_size : 1) * \
+                    sizeof(unsigned long long))))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        atomic_store(&gen->search_failed, 1);
+        return NULL;
+    }
+    for (restart = worker->id; !gen->restarts || restart < gen->restarts; restart += gen->threadnum)
+    {
+        if (atomic_load(&gen->search_failed))
+            break;
+        // xorshift64* never leaves 0
+        random = zobrist_key(gen->options.seed, restart) | 1;
+        if ((ret = random_rollout(worker, worker->wordnum, &random)) < 0)
+        {
+            atomic_store(&gen->search_failed, 1);
+            break;
+        }
+        worker->restarts++;
+        // Report only the crosswords better than the ones of all the
+        // workers reported before
+        if (worker->best && gen->options.progress && \
+                raise_score(&gen->reported_score, NODE_SCORE(gen, worker->best)))
+        {
+            gen->options.progress(worker->best->depth + 1, search_time(gen), (int)restart, \
+                    gen->options.progress_arg);
+        }
+        if (ret)
+            break;
+    }
+    // The other searches check every pair
+    free(worker->dead);
+    worker->dead = NULL;
+    return NULL;
+}
+
+/*
+ * Anytime search for the lists too big to search exhaustively: seeded
+ * independent rollouts on all the workers, see random_rollout(). The
+ * workers share only the score of the best crossword, which cuts off the
+ * rollouts that can't beat it. A cut off rollout can't give the best
+ * crossword, so the result doesn't depend on the timing of the threads.
+ */
+static int random_search(struct crossgen *gen, const int wordnum)
+{
+    int i;
+
+    atomic_store(&gen->search_failed, 0);
+    atomic_store(&gen->reported_score, atomic_load(&gen->best_score));
+    if (sort_roots(gen, wordnum))
+    {
+        free(gen->roots);
+        gen->roots = NULL;
+        return 1;
+    }
+    if (gen->rootnum)
+    {
+        for (i = 1; i < gen->threadnum; i++)
+        {
+            if (pthread_create(&gen->workers[i].thread, NULL, random_thread, &gen->workers[i]))
+            {
+                fprintf(stderr, "Can't create a search thread\n");
+                atomic_store(&gen->search_failed, 1);
+                break;
+            }
+        }
+        // The main thread is the first worker
+        random_thread(&gen->workers[0]);
+        while (--i > 0)
+            pthread_join(gen->workers[i].thread, NULL);
+    }
+    gen->result.timed_out = gen->time_limit > 0 && search_time(gen) >= gen->time_limit;
+    free(gen->roots);
+    gen->roots = NULL;
+    gen->rootnum = 0;
+    return atomic_load(&gen->search_failed);
+}
+
+static int push_task(struct search_worker *worker, struct strie_pair *node, int word, int index)
+{
+    struct crossgen *gen = worker->gen;
+    struct task_deque *deque = &worker->deque;
+
+    atomic_fetch_add(&gen->pending_tasks, 1);
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail == deque->size)
+    {
+        if (deque->head > 0)
+        {
+            // Move the tasks to the beginning
+            memmove(deque->tasks, deque->tasks + deque->head, \
+                    sizeof(struct search_task) * (deque->tail - deque->head));
+            deque->tail -= deque->head;
+            deque->head = 0;
+        }
+        else
+        {
+            struct search_task *tmp = NULL;
+            int size = deque->size ? deque->size * 2 : 64;
+            if (!(tmp = (struct search_task *)realloc(deque->tasks, size * sizeof(struct search_task))))
+            {
+                pthread_mutex_unlock(&deque->lock);
+                atomic_fetch_sub(&gen->pending_tasks, 1);
+                fprintf(stderr, "Not enough memory!\n");
+                return 1;
+            }
+            deque->tasks = tmp;
+            deque->size  = size;
+        }
+    }
+    deque->tasks[deque->tail].node  = node;
+    deque->tasks[deque->tail].word  = word;
+    deque->tasks[deque->tail].index = index;
+    deque->tail++;
+    pthread_mutex_unlock(&deque->lock);
+    return 0;
+}
+
+// Take a task either from the own tail or from someone else's head
+static int pop_task(struct search_worker *worker, int steal, struct search_task *task)
+{
+    struct task_deque *deque = &worker->deque;
+    int found = 0;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail)
+    {
+        *task = steal ? deque->tasks[deque->head++] : deque->tasks[--deque->tail];
+        found = 1;
+    }
+    if (deque->head == deque->tail)
+        deque->head = deque->tail = 0;
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/*
+ * Nodes close to the root are expanded and their children become new tasks
+ * so that idle workers could steal them. Deeper nodes are searched by the
+ * worker itself.
+ */
+static int run_task(struct search_worker *worker, const int wordnum, struct search_task *task)
+{
+    struct crossgen *gen = worker->gen;
+    struct strie_pair *node = task->node;
+    struct strie_pair *schild = NULL;
+    struct strie_pair *best = worker->best;
+    int n;
+
+    if (!node)
+    {
+        if (!(node = make_root(gen, &worker->node_pool, task->word, task->index)) || \
+                keep_root(worker, node))
+            return 1;
+        count_node(worker, 0);
+    }
+
+    if (node->depth >= SPLIT_DEPTH)
+    {
+        if (CROSSGEN_MODE_STREAM == gen->search_mode)
+            return stream_node(worker, wordnum, node);
+        return build_subtree(worker, wordnum, node);
+    }
+
+    if (expand_node(worker, wordnum, node))
+        return 1;
+    // Task nodes are never dropped, but the stream search keeps its best
+    // branch in the snapshot
+    if (CROSSGEN_MODE_STREAM == gen->search_mode && best != worker->best && \
+            save_best_branch(worker, worker->best))
+    {
+        return 1;
+    }
+
+    for (n = 0, schild = node->firstchild; schild; schild = schild->brother)
+        n++;
+    if (n)
+    {
+        struct strie_pair *children[n];
+
+        n = sort_children(gen, node, children);
+        // Push children so that the first one is popped first
+        while (n > 0)
+        {
+            if (push_task(worker, children[--n], 0, 0))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+static void *worker_thread(void *arg)
+{
+    struct search_worker *worker = (struct search_worker *)arg;
+    struct crossgen *gen = worker->gen;
+    struct search_task task;
+    int i, found;
+
+    while (atomic_load(&gen->pending_tasks) > 0 && !atomic_load(&gen->search_failed))
+    {
+        if (!(found = pop_task(worker, 0, &task)))
+        {
+            for (i = 1; i < gen->threadnum && !found; i++)
+                found = pop_task(&gen->workers[(worker->id + i) % gen->threadnum], 1, &task);
+        }
+        if (!found)
+        {
+            sched_yield();
+            continue;
+        }
+        if (run_task(worker, worker->wordnum, &task))
+            atomic_store(&gen->search_failed, 1);
+        atomic_fetch_sub(&gen->pending_tasks, 1);
+    }
+    return NULL;
+}
+
+/*
+ * Search all the roots on 'threadnum' threads. Every root subtree is searched
+ * independently from the others (the procreator rule), so roots and their
+ * subtrees are spread across the workers' task pools and idle workers steal
+ * tasks from the busy ones. Each worker keeps its own best branch and the
+ * best of them is chosen the same way a single thread would choose it.
+ */
+static int parallel_search(struct crossgen *gen, const int wordnum)
+{
+    int i, j, n = 0;
+
+    atomic_store(&gen->pending_tasks, 0);
+    atomic_store(&gen->search_failed, 0);
+
+    // Deal the roots round-robin, each worker takes its tasks from the tail
+    // so push them back to front. Root nodes are created by the workers.
+    for (i = wordnum - 1; i >= 0; i--)
+    {
+        for (j = gen->words[i].childnum - 1; j >= 0; j--)
+        {
+            if (push_task(&gen->workers[n++ % gen->threadnum], NULL, i, j))
+                return 1;
+        }
+    }
+
+    for (i = 1; i < gen->threadnum; i++)
+    {
+        if (pthread_create(&gen->workers[i].thread, NULL, worker_thread, &gen->workers[i]))
+        {
+            fprintf(stderr, "Can't create a search thread\n");
+            atomic_store(&gen->search_failed, 1);
+            break;
+        }
+    }
+    // The main thread is the first worker
+    worker_thread(&gen->workers[0]);
+    while (--i > 0)
+        pthread_join(gen->workers[i].thread, NULL);
+
+    return atomic_load(&gen->search_failed);
+}
+
+static struct strie_pair *check_pair(struct search_worker *worker, struct strie_pair *main_node, struct cross_pair *pair)
+{
+    struct crossgen *gen = worker->gen;
+    struct strie_pair *cur_node = main_node;
+    struct strie_pair *schild = NULL;
+    struct strie_pair *tmp_node = NULL;
+    int i, j, dist, found;
+    int procreator = main_node->procreator;   // the same for the whole branch
+
+    // First we need to check whether the same pair already exists in one of
+    // main_node's children. The pairs of the branch words are scanned, so a
+    // pair is scanned twice only if both its words are in the branch.
+    for (cur_node = grid_word_placed(&worker->grid, pair->crossed_word[0]) && \
+            grid_word_placed(&worker->grid, pair->crossed_word[1]) ? main_node->firstchild : NULL; \
+            cur_node; cur_node = cur_node->brother)
+    {
+        if ((cur_node->crossed_word[0] == pair->crossed_word[0]) && \
+            (cur_node->crossed_word[1] == pair->crossed_word[1]) && \
+            (cur_node->crossed_word_letter[0] == pair->crossed_word_letter[0]) && \
+            (cur_node->crossed_word_letter[1] == pair->crossed_word_letter[1]))
+        {
+            worker->rejects[REJECT_CHILD]++;
+            return NULL;
+        }
+    }
+    // Now check whether it's the same as one of top node's elder brothers
+    // Note, that this check is not necessary - its removal will not lead to
+    // great 'wrong' branch growth. If the current branch is wrong, it won't
+    // last long after adding one of top node's elder brothers. So this check
+    // may be removed if it wastes too much time.
+    cur_node = main_node;
+    while (cur_node->parent)
+        cur_node = cur_node->parent;
+    if ((cur_node->crossed_word[0] == pair->crossed_word[0]) && \
+            (cur_node->crossed_word[1] >= pair->crossed_word[1]))
+    {
+        worker->rejects[REJECT_ROOT]++;
+        return NULL;
+    }
+    // Check whether it's the same as one of main_node's or any its parent's
+    // elder brothers
+    for (cur_node = main_node; cur_node; cur_node = cur_node->parent)
+    {
+        if (cur_node->parent)
+        {
+            for (tmp_node = cur_node->parent->firstchild; \
+                    tmp_node != cur_node; \
+                    tmp_node = tmp_node->brother)
+            {
+                if ((tmp_node->crossed_word[0] == pair->crossed_word[0]) && \
+                        (tmp_node->crossed_word[1] == pair->crossed_word[1]) && \
+                        (tmp_node->crossed_word_letter[0] == pair->crossed_word_letter[0]) && \
+                        (tmp_node->crossed_word_letter[1] == pair->crossed_word_letter[1]))
+                {
+                    worker->rejects[REJECT_BROTHER]++;
+                    return NULL;
+                }
+            }
+        }
+    }
+
+    // Check current main node and all its parents
+    for (cur_node = main_node; cur_node; cur_node = cur_node->parent)
+    {
+        // There can be only one pair of certain words. I.e. word 'i' cann't
+        // cross the word 'j' in two places.
+        if (((cur_node->crossed_word[0] == pair->crossed_word[0]) && \
+            (cur_node->crossed_word[1] == pair->crossed_word[1])) || \
+            (pair->crossed_word[0] < procreator) || \
+            (pair->crossed_word[1] < procreator))
+        {
+            worker->rejects[cur_node->crossed_word[0] == pair->crossed_word[0] && \
+                cur_node->crossed_word[1] == pair->crossed_word[1] ? REJECT_SAME_WORDS : REJECT_PROCREATOR]++;
+            if (schild)
+            {
+                pool_unalloc(&worker->node_pool, schild);
+                schild = NULL;
+            }
+            return schild;
+        }
+        // Find same word in two pairs
+        found = 0;
+        for (i = 0; i < 2 && !found; i++)
+        {
+            for (j = 0; j < 2 && !found; j++)
+            {
+                if (cur_node->crossed_word[i] == pair->crossed_word[j])
+                {
+                    if (!schild)
+                    {
+                        int dx, dy, tmp;
+                        // allocate new child
+                        if (!(schild = (struct strie_pair*)pool_alloc(&worker->node_pool)))
+                        {
+                            fprintf(stderr, "Not enough memory!\n");
+                            return NULL;
+                        }
+                        // The pair is placed as if it were a root
+                        memcpy(schild->crossed_word, pair->crossed_word, sizeof(schild->crossed_word));
+                        memcpy(schild->crossed_word_letter, pair->crossed_word_letter, sizeof(schild->crossed_word_letter));
+                        schild->word_orient[0] = 1;
+                        schild->word_orient[1] = -(schild->word_orient[0]);
+                        schild->word_coord[0][0] = 0;
+                        schild->word_coord[0][1] = 0;
+                        schild->word_coord[1][0] = schild->crossed_word_letter[0];
+                        schild->word_coord[1][1] = schild->crossed_word_letter[1];
+                        schild->depth = main_node->depth + 1;
+                        schild->words = main_node->words;
+                        schild->crossings = main_node->crossings;
+                        schild->letters = main_node->letters;
+                        schild->procreator = main_node->procreator;
+                        if (schild->word_orient[j] != cur_node->word_orient[i])
+                        {
+                            tmp = schild->word_coord[j][0];
+                            schild->word_coord[j][0] = -schild->word_coord[j][1];
+                            schild->word_coord[j][1] = -tmp;
+                            tmp = schild->word_coord[(j - 1) * (j - 1)][0];
+                            schild->word_coord[(j - 1) * (j - 1)][0] = -schild->word_coord[(j - 1) * (j - 1)][1];
+                            schild->word_coord[(j - 1) * (j - 1)][1] = -tmp;
+                        }
+                        schild->word_orient[j] = cur_node->word_orient[i];
+                        schild->word_orient[(j - 1) * (j - 1)] = -(schild->word_orient[j]);
+                        dx = cur_node->word_coord[i][0] - schild->word_coord[j][0] ;
+                        dy = cur_node->word_coord[i][1] - schild->word_coord[j][1] ;
+                        schild->word_coord[0][0] += dx;
+                        schild->word_coord[0][1] += dy;
+                        schild->word_coord[1][0] += dx;
+                        schild->word_coord[1][1] += dy;
+
+                        memcpy(schild->box, main_node->box, sizeof(schild->box));
+                        for (tmp = 0; tmp < 2; tmp++)
+                        {
+                            box_add(schild->box, schild->word_coord[tmp][0], schild->word_coord[tmp][1], \
+                                    schild->word_orient[tmp], gen->words[schild->crossed_word[tmp]].wordlen);
+                        }
+                        // It's cheaper than the checks of the crossings
+                        if (gen->box_search && !box_fits(gen, schild->box))
+                        {
+                            worker->rejects[REJECT_BOX]++;
+                            pool_unalloc(&worker->node_pool, schild);
+                            return NULL;
+                        }
+                    }
+                    // schild now exists, we need to verify orientation and MINDISTANCE
+                    dist = cur_node->crossed_word_letter[i] - pair->crossed_word_letter[j];
+                    dist = dist < 0 ? -dist : dist;
+                    if ((dist < MINDISTANCE) || (cur_node->word_orient[i] != schild->word_orient[j]))
+                    {
+                        worker->rejects[dist < MINDISTANCE ? REJECT_DISTANCE : REJECT_ORIENT]++;
+                        pool_unalloc(&worker->node_pool, schild);
+                        schild = NULL;
+                        return schild;
+                    }
+                    found = 1;
+                }
+            }
+        }
+    }
+
+    // Detect whether our newly added word crosses other words in 'wrong'
+    // letters. All the words of main_node's branch are on the worker's grid,
+    // so only the words close to the new one are checked.
+    if (schild)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            int word = schild->crossed_word[j];
+            int xb = schild->word_coord[j][0];
+            int yb = schild->word_coord[j][1];
+            int num;
+
+            // If the new word is already in the crossword, its
+            // position should be the same. It has already been checked
+            // against all the others.
+            if (grid_word_placed(&worker->grid, word))
+            {
+                struct grid_word *pos = &worker->grid.placed[word];
+                if ((pos->orient != schild->word_orient[j]) || \
+                        (pos->x != xb) || (pos->y != yb))
+                {
+                    worker->rejects[REJECT_MOVED]++;
+                    pool_unalloc(&worker->node_pool, schild);
+                    schild = NULL;
+                    return schild;
+                }
+                continue;
+            }
+
+            num = grid_near_words(&worker->grid, xb, yb, schild->word_orient[j], \
+                    gen->words[word].wordlen, MINDISTANCE - 1);
+            for (i = 0; i < num; i++)
+            {
+                struct grid_word *pos = &worker->grid.placed[worker->grid.near[i]];
+                if ((dist = words_conflict(gen, worker->grid.near[i], pos->x, pos->y, pos->orient, \
+                            word, xb, yb, schild->word_orient[j])))
+                {
+                    worker->rejects[dist]++;
+                    pool_unalloc(&worker->node_pool, schild);
+                    schild = NULL;
+                    return schild;
+                }
+                // The new word crosses its partner and maybe other words
+                if (gen->scoring && cells_cross(pos, xb, yb, schild->word_orient[j], gen->words[word].wordlen))
+                    schild->crossings++, schild->letters--;
+            }
+            if (gen->scoring)
+            {
+                schild->words++;
+                schild->letters += gen->words[word].wordlen;
+            }
+        }
+    }
+    else
+    {
+        // The pair has no words of the branch
+        worker->rejects[REJECT_DISCONNECTED]++;
+    }
+
+    return schild;
+}
+
+/*
+ * Check whether the new word 'b' can't be placed next to the word 'a' in the
+ * crossword: parallel words shouldn't touch each other, perpendicular ones
+ * should either be far enough or cross each other in the same letter.
+ * Returns the reason of the conflict (one of REJECT_PARALLEL, REJECT_TOUCH,
+ * REJECT_LETTER) or 0.
+ */
+static int words_conflict(const struct crossgen *gen, int word_a, int xa, int ya, int orient_a, \
+        int word_b, int xb, int yb, int orient_b)
+{
+    int la = gen->words[word_a].wordlen;
+    int lb = gen->words[word_b].wordlen;
+    int dist;
+
+    // Check intersection based on orientation
+    if (1 == orient_a)
+    {
+        if (1 == orient_b)
+        {
+            // Both horizontal - they should have no intersections
+            dist = ya - yb;
+            dist = dist < 0 ? -dist : dist;
+            if (!((dist >= MINDISTANCE) || \
+                        (xb >= xa + la - 1 + MINDISTANCE) || \
+                        (xa >= xb + lb - 1 + MINDISTANCE)))
+            {
+                return REJECT_PARALLEL;
+            }
+        }
+        else
+        {
+            // The word in the crossword (a) - horizontal,
+            // the new word (b) - vertical
+            if (!((xa >= xb + MINDISTANCE) || \
+                    (xb >= xa + la - 1 + MINDISTANCE) || \
+                    (ya >= yb + MINDISTANCE) || \
+                    (ya <= yb - lb + 1 - MINDISTANCE)))
+            {
+                // Determine the letter position in each word
+                int apos = xb - xa;
+                int bpos = yb - ya;
+                if ((apos < 0) || (bpos < 0) || (apos >= la) || (bpos >= lb))
+                    return REJECT_TOUCH;
+                if (WORD(gen, word_a)[apos] != WORD(gen, word_b)[bpos])
+                    return REJECT_LETTER;
+            }
+        }
+    }
+    else
+    {
+        if (1 == orient_b)
+        {
+            // Original (a) - vertical
+            // New (b) - horizontal
+            if (!((xb >= xa + MINDISTANCE) || \
+                        (xa >= xb + lb -1 + MINDISTANCE) || \
+                        (yb >= ya + MINDISTANCE) || \
+                        (yb <= ya - la + 1 - MINDISTANCE)))
+            {
+                // Determine the letter position in each word
+                int bpos = xa - xb;
+                int apos = ya - yb;
+                if ((apos < 0) || (bpos < 0) || (apos >= la) || (bpos >= lb))
+                    return REJECT_TOUCH;
+                if (WORD(gen, word_a)[apos] != WORD(gen, word_b)[bpos])
+                    return REJECT_LETTER;
+            }
+        }
+        else
+        {
+            // Both are vertical - there should be no intersections
+            dist = xa - xb;
+            dist = dist < 0 ? -dist : dist;
+            if (!((dist >= MINDISTANCE) || \
+                        (yb <= ya - la + 1 - MINDISTANCE) || \
+                        (ya <= yb - lb + 1 - MINDISTANCE)))
+            {
+                return REJECT_PARALLEL;
+            }
+        }
+    }
+    // If we reach this code, it means that 'a' and 'b' words either don't
+    // touch each other or cross in the same letter
+    return 0;
+}
+
+// Start the export of a run with the header
+static int start_export(struct crossgen *gen)
+{
+    struct crossgen_export_header header;
+
+    memset(&header, 0, sizeof(struct crossgen_export_header));
+    memcpy(header.magic, CROSSGEN_EXPORT_MAGIC, sizeof(header.magic));
+    header.version    = CROSSGEN_EXPORT_VERSION;
+    header.byte_order = CROSSGEN_EXPORT_BYTE_ORDER;
+    header.node_size  = sizeof(struct crossgen_export_node);
+    header.wordnum    = gen->wordnum;
+    gen->export_len   = 0;
+    gen->export_roots = 0;
+    if (1 != fwrite(&header, sizeof(struct crossgen_export_header), 1, gen->options.export_file))
+    {
+        fprintf(stderr, "Error writing the strie\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Write the buffered nodes of the export
+static int flush_export(struct crossgen *gen)
+{
+    if (gen->export_len && \
+            (size_t)gen->export_len != fwrite(gen->export_buf, sizeof(struct crossgen_export_node), \
+                gen->export_len, gen->options.export_file))
+    {
+        fprintf(stderr, "Error writing the strie\n");
+        return 1;
+    }
+    gen->export_len = 0;
+    return 0;
+}
+
+/*
+ * Export the searched subtree of the root in pre-order. The parent, the
+ * first child and the brother links are enough to walk the subtree without
+ * a stack, so a subtree of any depth and size takes no more memory than
+ * the buffer. Only the subtrees of every export_sample-th root and only
+ * the nodes up to export_depth are written.
+ */
+static int export_subtree(struct crossgen *gen, struct strie_pair *root)
+{
+    struct crossgen_export_node *out = NULL;
+    struct strie_pair *node = root;
+    int k;
+
+    if (gen->options.export_sample > 1 && gen->export_roots++ % gen->options.export_sample)
+        return 0;
+    while (node)
+    {
+        if (EXPORT_BUFFER == gen->export_len && flush_export(gen))
+            return 1;
+        out = &gen->export_buf[gen->export_len++];
+        memset(out, 0, sizeof(struct crossgen_export_node));
+        out->depth = node->depth;
+        for (k = 0; k < 2; k++)
+        {
+            out->word[k]     = node->crossed_word[k];
+            out->coord[k][0] = node->word_coord[k][0];
+            out->coord[k][1] = node->word_coord[k][1];
+            out->letter[k]   = node->crossed_word_letter[k];
+            out->orient[k]   = node->word_orient[k];
+        }
+        gen->stats.exported++;
+
+        // Go down, or to the brother of the node or of its first parent
+        // that has one
+        if (node->firstchild && (!gen->options.export_depth || node->depth < gen->options.export_depth))
+        {
+            node = node->firstchild;
+            continue;
+        }
+        while (node != root && !node->brother)
+            node = node->parent;
+        node = node == root ? NULL : node->brother;
+    }
+    return 0;
+}
+
+// Add the worker's counters to the search statistics
+static int collect_stats(struct crossgen *gen, struct search_worker *worker)
+{
+    int i;
+
+    gen->stats.nodes      += worker->nodes;
+    gen->stats.pruned     += worker->pruned;
+    gen->stats.restarts   += worker->restarts;
+    for (i = 0; i < REJECT_REASONS; i++)
+        gen->stats.rejects[i] += worker->rejects[i];
+    if (worker->depth_nodes_len > gen->stats.depth_nodes_len)
+    {
+        long *tmp = NULL;
+        if (!(tmp = (long *)realloc(gen->stats.depth_nodes, worker->depth_nodes_len * sizeof(long))))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            return 1;
+        }
+        memset(tmp + gen->stats.depth_nodes_len, 0, \
+                (worker->depth_nodes_len - gen->stats.depth_nodes_len) * sizeof(long));
+        gen->stats.depth_nodes = tmp;
+        gen->stats.depth_nodes_len = worker->depth_nodes_len;
+    }
+    for (i = 0; i < worker->depth_nodes_len; i++)
+        gen->stats.depth_nodes[i] += worker->depth_nodes[i];
+    return 0;
+}
+
+/*
+ * Upper case letters that have a lower case pair: from 'first' to 'last'
+ * every 'step'-th one, the lower case one is 'delta' after it
+ */
+static const struct case_range
+{
+    uint32_t first, last;
+    int     delta, step;
+} case_ranges[] = {
+    { 0x0041, 0x005A,    32, 1 },   // Latin
+    { 0x00C0, 0x00D6,    32, 1 },
+    { 0x00D8, 0x00DE,    32, 1 },
+    { 0x0100, 0x012F,     1, 2 },
+    { 0x0132, 0x0137,     1, 2 },
+    { 0x0139, 0x0148,     1, 2 },
+    { 0x014A, 0x0177,     1, 2 },
+    { 0x0178, 0x0178, -0x79, 1 },
+    { 0x0179, 0x017E,     1, 2 },
+    { 0x0218, 0x021B,     1, 2 },
+    { 0x0386, 0x0386,    38, 1 },   // Greek
+    { 0x0388, 0x038A,    37, 1 },
+    { 0x038C, 0x038C,    64, 1 },
+    { 0x038E, 0x038F,    63, 1 },
+    { 0x0391, 0x03A1,    32, 1 },
+    { 0x03A3, 0x03AB,    32, 1 },
+    { 0x0400, 0x040F,    80, 1 },   // Cyrillic
+    { 0x0410, 0x042F,    32, 1 },
+    { 0x0460, 0x0481,     1, 2 },
+    { 0x048A, 0x04BF,     1, 2 },
+    { 0x04C1, 0x04CE,     1, 2 },
+    { 0x04D0, 0x052F,     1, 2 },
+    { 0x0531, 0x0556,    48, 1 },   // Armenian
+    { 0x1E00, 0x1E95,     1, 2 },   // Latin Extended Additional
+    { 0x1EA0, 0x1EFF,     1, 2 },
+};
+
+/*
+ * Lower case letters with a diacritic: the letter is 'base' with the
+ * combining 'mark' after it. The upper case ones are found by their lower
+ * case pairs.
+ */
+static const struct letter_mark
+{
+    uint32_t letter, base, mark;
+} letter_marks[] = {
+    { 0x00E0, 'a', 0x300 }, { 0x00E1, 'a', 0x301 }, { 0x00E2, 'a', 0x302 }, { 0x00E3, 'a', 0x303 },
+    { 0x00E4, 'a', 0x308 }, { 0x00E5, 'a', 0x30A }, { 0x00E7, 'c', 0x327 }, { 0x00E8, 'e', 0x300 },
+    { 0x00E9, 'e', 0x301 }, { 0x00EA, 'e', 0x302 }, { 0x00EB, 'e', 0x308 }, { 0x00EC, 'i', 0x300 },
+    { 0x00ED, 'i', 0x301 }, { 0x00EE, 'i', 0x302 }, { 0x00EF, 'i', 0x308 }, { 0x00F1, 'n', 0x303 },
+    { 0x00F2, 'o', 0x300 }, { 0x00F3, 'o', 0x301 }, { 0x00F4, 'o', 0x302 }, { 0x00F5, 'o', 0x303 },
+    { 0x00F6, 'o', 0x308 }, { 0x00F9, 'u', 0x300 }, { 0x00FA, 'u', 0x301 }, { 0x00FB, 'u', 0x302 },
+    { 0x00FC, 'u', 0x308 }, { 0x00FD, 'y', 0x301 }, { 0x00FF, 'y', 0x308 },
+    { 0x0101, 'a', 0x304 }, { 0x0103, 'a', 0x306 }, { 0x0105, 'a', 0x328 }, { 0x0107, 'c', 0x301 },
+    { 0x0109, 'c', 0x302 }, { 0x010B, 'c', 0x307 }, { 0x010D, 'c', 0x30C }, { 0x010F, 'd', 0x30C },
+    { 0x0113, 'e', 0x304 }, { 0x0115, 'e', 0x306 }, { 0x0117, 'e', 0x307 }, { 0x0119, 'e', 0x328 },
+    { 0x011B, 'e', 0x30C }, { 0x011D, 'g', 0x302 }, { 0x011F, 'g', 0x306 }, { 0x0121, 'g', 0x307 },
+    { 0x0123, 'g', 0x327 }, { 0x0125, 'h', 0x302 }, { 0x0129, 'i', 0x303 }, { 0x012B, 'i', 0x304 },
+    { 0x012D, 'i', 0x306 }, { 0x012F, 'i', 0x328 }, { 0x0130, 'I', 0x307 }, { 0x0135, 'j', 0x302 },
+    { 0x0137, 'k', 0x327 }, { 0x013A, 'l', 0x301 }, { 0x013C, 'l', 0x327 }, { 0x013E, 'l', 0x30C },
+    { 0x0144, 'n', 0x301 }, { 0x0146, 'n', 0x327 }, { 0x0148, 'n', 0x30C }, { 0x014D, 'o', 0x304 },
+    { 0x014F, 'o', 0x306 }, { 0x0151, 'o', 0x30B }, { 0x0155, 'r', 0x301 }, { 0x0157, 'r', 0x327 },
+    { 0x0159, 'r', 0x30C }, { 0x015B, 's', 0x301 }, { 0x015D, 's', 0x302 }, { 0x015F, 's', 0x327 },
+    { 0x0161, 's', 0x30C }, { 0x0163, 't', 0x327 }, { 0x0165, 't', 0x30C }, { 0x0169, 'u', 0x303 },
+    { 0x016B, 'u', 0x304 }, { 0x016D, 'u', 0x306 }, { 0x016F, 'u', 0x30A }, { 0x0171, 'u', 0x30B },
+    { 0x0173, 'u', 0x328 }, { 0x0175, 'w', 0x302 }, { 0x0177, 'y', 0x302 }, { 0x017A, 'z', 0x301 },
+    { 0x017C, 'z', 0x307 }, { 0x017E, 'z', 0x30C }, { 0x0219, 's', 0x326 }, { 0x021B, 't', 0x326 },
+    { 0x0390, 0x03CA, 0x301 }, { 0x03AC, 0x03B1, 0x301 }, { 0x03AD, 0x03B5, 0x301 },
+    { 0x03AE, 0x03B7, 0x301 }, { 0x03AF, 0x03B9, 0x301 }, { 0x03B0, 0x03CB, 0x301 },
+    { 0x03CA, 0x03B9, 0x308 }, { 0x03CB, 0x03C5, 0x308 }, { 0x03CC, 0x03BF, 0x301 },
+    { 0x03CD, 0x03C5, 0x301 }, { 0x03CE, 0x03C9, 0x301 },
+    { 0x0439, 0x0438, 0x306 }, { 0x0450, 0x0435, 0x300 }, { 0x0451, 0x0435, 0x308 },
+    { 0x0453, 0x0433, 0x301 }, { 0x0457, 0x0456, 0x308 }, { 0x045C, 0x043A, 0x301 },
+    { 0x045D, 0x0438, 0x300 }, { 0x045E, 0x0443, 0x306 },
+};
+
+#define COMBINING_MARK(c) ((c) >= 0x300 && (c) <= 0x36F)
+
+/*
+ * Decode the UTF-8 character at the beginning of the text, returns its
+ * length or 0 if it's not valid: overlong, a surrogate, beyond U+10FFFF or
+ * the '\0'
+ */
+static int decode_utf8(const char *text, int len, uint32_t *c)
+{
+    const unsigned char *s = (const unsigned char *)text;
+    static const uint32_t least[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    int i, n;
+
+    if (len < 1 || !s[0])
+        return 0;
+    if (s[0] < 0x80)
+    {
+        *c = s[0];
+        return 1;
+    }
+    if (0xC0 == (s[0] & 0xE0))
+        n = 2;
+    else if (0xE0 == (s[0] & 0xF0))
+        n = 3;
+    else if (0xF0 == (s[0] & 0xF8))
+        n = 4;
+    else
+        return 0;
+    if (len < n)
+        return 0;
+    *c = s[0] & (0x7F >> n);
+    for (i = 1; i < n; i++)
+    {
+        if (0x80 != (s[i] & 0xC0))
+            return 0;
+        *c = *c << 6 | (s[i] & 0x3F);
+    }
+    if (*c < least[n] || (*c >= 0xD800 && *c <= 0xDFFF) || *c > 0x10FFFF)
+        return 0;
+    return n;
+}
+
+// Write the character in UTF-8 with '\0' after it, returns its length
+static int encode_utf8(uint32_t c, char *text)
+{
+    int n = c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+    int i;
+
+    if (1 == n)
+        text[0] = c;
+    else
+    {
+        for (i = n - 1; i > 0; i--, c >>= 6)
+            text[i] = 0x80 | (c & 0x3F);
+        text[0] = (0xFF00 >> n & 0xFF) | c;
+    }
+    text[n] = '\0';
+    return n;
+}
+
+// The letter in upper or lower case, the letter itself if it has no pair
+static uint32_t change_case(uint32_t c, int upper)
+{
+    const struct case_range *r;
+    uint32_t u;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(case_ranges) / sizeof(case_ranges[0])); i++)
+    {
+        r = &case_ranges[i];
+        u = upper ? c - r->delta : c;
+        if (u >= r->first && u <= r->last && !((u - r->first) % r->step))
+            return upper ? u : c + r->delta;
+    }
+    return c;
+}
+
+// The entry of the letter with a diacritic in letter_marks[], NULL if none
+static const struct letter_mark *find_mark(uint32_t c)
+{
+    uint32_t lower = change_case(c, 0);
+    int i;
+
+    for (i = 0; i < (int)(sizeof(letter_marks) / sizeof(letter_marks[0])); i++)
+    {
+        if (letter_marks[i].letter == c || letter_marks[i].letter == lower)
+            return &letter_marks[i];
+    }
+    return NULL;
+}
+
+// The letter 'c' with the combining mark, 0 if there's no such letter
+static uint32_t add_mark(uint32_t c, uint32_t mark)
+{
+    uint32_t lower = change_case(c, 0);
+    int i;
+
+    for (i = 0; i < (int)(sizeof(letter_marks) / sizeof(letter_marks[0])); i++)
+    {
+        if (letter_marks[i].base == lower && letter_marks[i].mark == mark)
+            return lower == c ? letter_marks[i].letter : change_case(letter_marks[i].letter, 1);
+    }
+    return 0;
+}
+
+/*
+ * Fold the letter as the options say: to lower case, then by
+ * options.fold_letters, then without diacritics
+ */
+static uint32_t fold_letter(const struct crossgen *gen, uint32_t c)
+{
+    const struct letter_mark *m;
+    int i;
+
+    if (gen->options.fold & CROSSGEN_FOLD_CASE)
+    {
+        c = change_case(c, 0);
+        // Greek final sigma is the same letter
+        if (0x3C2 == c)
+            c = 0x3C3;
+    }
+    for (i = 0; i < gen->fold_num; i++)
+    {
+        if (gen->fold_map[2 * i] == c)
+        {
+            c = gen->fold_map[2 * i + 1];
+            break;
+        }
+    }
+    if (gen->options.fold & CROSSGEN_FOLD_MARKS)
+    {
+        while ((m = find_mark(c)))
+            c = m->letter == c ? m->base : change_case(m->base, 1);
+    }
+    return c;
+}
+
+/*
+ * Read a letter of the text with its combining marks and fold it, returns
+ * the bytes read or 0 if the text is not valid UTF-8 or a mark belongs to
+ * no letter
+ */
+static int read_letter(const struct crossgen *gen, const char *text, int len, uint32_t *c)
+{
+    uint32_t mark;
+    int n, k;
+
+    if (!(n = decode_utf8(text, len, c)) || COMBINING_MARK(*c))
+        return 0;
+    while (n < len && (k = decode_utf8(text + n, len - n, &mark)) && COMBINING_MARK(mark))
+    {
+        if (!(gen->options.fold & CROSSGEN_FOLD_MARKS) && !(*c = add_mark(*c, mark)))
+            return 0;
+        n += k;
+    }
+    *c = fold_letter(gen, *c);
+    return n;
+}
+
+// The code of the letter, 0 if it has none yet
+static int find_letter(const struct crossgen *gen, uint32_t c)
+{
+    int slot;
+
+    for (slot = LETTER_SLOT(c); gen->letter_hash[slot]; slot = (slot + 1) & (LETTER_HASH - 1))
+    {
+        if (gen->letters[gen->letter_hash[slot]] == c)
+            return gen->letter_hash[slot];
+    }
+    return 0;
+}
+
+// Give the letter the next code, returns it or 0 if the alphabet is full
+static int add_letter(struct crossgen *gen, uint32_t c)
+{
+    int code, slot;
+
+    if (gen->letternum == CROSSGEN_LETTERS)
+        return 0;
+    code = ++gen->letternum;
+    gen->letters[code] = c;
+    encode_utf8(c, gen->letter_text[code][0]);
+    encode_utf8(change_case(c, 1), gen->letter_text[code][1]);
+    for (slot = LETTER_SLOT(c); gen->letter_hash[slot]; slot = (slot + 1) & (LETTER_HASH - 1))
+        ;
+    gen->letter_hash[slot] = code;
+    return code;
+}
+
+// Forget the letters, the next ones get the codes from 1 again
+static void clear_letters(struct crossgen *gen)
+{
+    gen->letternum = 0;
+    memset(gen->letter_hash, 0, sizeof(gen->letter_hash));
+}
+
+/*
+ * Read options.fold_letters into fold_map[], the letters of a pair are
+ * folded by case already. Returns 1 if it's not UTF-8 pairs of letters.
+ */
+static int read_fold_letters(struct crossgen *gen)
+{
+    const char *text = gen->options.fold_letters;
+    int k, step, n = 0, len = text ? strlen(text) : 0;
+    uint32_t c;
+
+    if (!len)
+        return 0;
+    if (!(gen->fold_map = (uint32_t *)malloc(len * sizeof(uint32_t))))
+        return 1;
+    // fold_num is 0 yet, so the letters get only the other folding
+    for (k = 0; k < len; k += step)
+    {
+        if (!(step = read_letter(gen, text + k, len - k, &c)))
+            return 1;
+        gen->fold_map[n++] = c;
+    }
+    if (n % 2)
+        return 1;
+    gen->fold_num = n / 2;
+    return 0;
+}
+
+/*
+ * Add the word to word_pool and the words[] array, both grow twice when
+ * they are full. The letters are read from UTF-8 and folded, the new ones
+ * get their codes. Empty words are skipped. Prints the error, returns -1
+ * if the word can't be taken and 1 if there's not enough memory.
+ */
+static int add_word(struct crossgen *gen, const char *word, int len)
+{
+    uint32_t c;
+    char   *codes, *text;
+    int     j, k, n, letters = 0, need;
+
+    if (!len)
+        return 0;
+    if (own_cache(gen))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return 1;
+    }
+    for (j = 0; j < len; j += n, letters++)
+    {
+        if (!(n = read_letter(gen, word + j, len - j, &c)))
+        {
+            fprintf(stderr, "Wrong letters in the word: %.*s\n", len, word);
+            return -1;
+        }
+    }
+
+    if (gen->wordnum == gen->wordsize)
+    {
+        struct cross_elem *tmp = NULL;
+        int size = gen->wordsize ? gen->wordsize * 2 : 64;
+        if (!(tmp = (struct cross_elem *)realloc(gen->words, size * sizeof(struct cross_elem))))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            return 1;
+        }
+        gen->words = tmp;
+        gen->wordsize = size;
+    }
+    // A folded letter is at most 4 bytes long
+    need = letters + 1 + 4 * letters + 1;
+    if (gen->word_pool_len + need > gen->word_pool_size)
+    {
+        char *tmp = NULL;
+        int size = gen->word_pool_size;
+        while (gen->word_pool_len + need > size)
+            size = size ? size * 2 : 1024;
+        if (!(tmp = (char *)realloc(gen->word_pool, size)))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            return 1;
+        }
+        gen->word_pool = tmp;
+        gen->word_pool_size = size;
+    }
+
+    codes = gen->word_pool + gen->word_pool_len;
+    text = codes + letters + 1;
+    for (j = 0, k = 0; j < len; j += n, k++)
+    {
+        n = read_letter(gen, word + j, len - j, &c);
+        if (!(codes[k] = find_letter(gen, c)) && !(codes[k] = add_letter(gen, c)))
+        {
+            fprintf(stderr, "More than %d different letters in the words\n", CROSSGEN_LETTERS);
+            return -1;
+        }
+        text += encode_utf8(c, text);
+    }
+    codes[letters] = '\0';
+    memset(&gen->words[gen->wordnum], 0, sizeof(struct cross_elem));
+    gen->words[gen->wordnum].offset  = gen->word_pool_len;
+    gen->words[gen->wordnum].wordlen = letters;
+    gen->word_pool_len = text + 1 - gen->word_pool;
+    gen->wordnum++;
+    return 0;
+}
+
+// Forget the words, their memory is kept for the next ones
+void crossgen_clear_words(struct crossgen *gen)
+{
+    drop_cache(gen);
+    gen->wordnum = 0;
+    gen->word_pool_len = 0;
+    gen->paired = 0;
+    gen->updatable = 0;
+    clear_letters(gen);
+}
+
+/*
+ * Add the first 'len' letters of the word, an empty word is skipped.
+ * Returns -1 if the letters are wrong or too many, the other words stay.
+ */
+int crossgen_add_word(struct crossgen *gen, const char *word, int len)
+{
+    return add_word(gen, word, len);
+}
+
+/*
+ * Remove the word, the later words are numbered one less. The pairs of the
+ * other words are kept, and so are the crosswords of the result: the word
+ * goes from them with the pairs that were joined to them only through it.
+ */
+int crossgen_remove_word(struct crossgen *gen, int word)
+{
+    int i, len;
+
+    if (word < 0 || word >= gen->wordnum)
+    {
+        fprintf(stderr, "No word %d to remove\n", word);
+        return 1;
+    }
+    if (own_cache(gen))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return 1;
+    }
+    for (i = 0; i < gen->result.layoutnum; i++)
+    {
+        if (cut_layout(gen, &gen->result.layouts[i], word))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            return 1;
+        }
+    }
+    if (word < gen->paired)
+        drop_pairs(gen, word);
+
+    len = gen->words[word].wordlen + 1 + strlen(TEXT(gen, word)) + 1;
+    memmove(WORD(gen, word), WORD(gen, word) + len, gen->word_pool_len - gen->words[word].offset - len);
+    gen->word_pool_len -= len;
+    for (i = word + 1; i < gen->wordnum; i++)
+        gen->words[i].offset -= len;
+    memmove(&gen->words[word], &gen->words[word + 1], (gen->wordnum - word - 1) * sizeof(struct cross_elem));
+    gen->wordnum--;
+
+    // Finish the crosswords with the words renumbered
+    for (i = 0; i < gen->result.layoutnum; i++)
+    {
+        if (finish_layout(gen, &gen->result.layouts[i]))
+            return 1;
+    }
+    tidy_result(gen);
+    return 0;
+}
+
+/*
+ * Take the words from the array instead of the generator's current words.
+ * Empty words are skipped.
+ */
+int crossgen_load_words(struct crossgen *gen, const char *const *list, int num)
+{
+    int i;
+
+    crossgen_clear_words(gen);
+    for (i = 0; i < num; i++)
+    {
+        if (add_word(gen, list[i], strlen(list[i])))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Read the words from the file, one word per line, instead of the
+ * generator's current words. Empty lines are skipped.
+ */
+int crossgen_load_file(struct crossgen *gen, FILE *fwords)
+{
+    char   *line = NULL;
+    size_t  linesize = 0;
+    ssize_t len;
+
+    crossgen_clear_words(gen);
+    while (-1 != (len = getline(&line, &linesize, fwords)))
+    {
+        // Remove newline symbol
+        while (len > 0 && ('\n' == line[len - 1] || '\r' == line[len - 1]))
+            len--;
+        if (add_word(gen, line, len))
+        {
+            free(line);
+            return 1;
+        }
+    }
+    free(line);
+    return 0;
+}
+
+int crossgen_word_count(const struct crossgen *gen)
+{
+    return gen->wordnum;
+}
+
+// The word in UTF-8, folded
+const char *crossgen_word(const struct crossgen *gen, int word)
+{
+    return TEXT(gen, word);
+}
+
+int crossgen_word_length(const struct crossgen *gen, int word)
+{
+    return gen->words[word].wordlen;
+}
+
+// The letter codes of the word, see crossgen_letter()
+const unsigned char *crossgen_word_codes(const struct crossgen *gen, int word)
+{
+    return (const unsigned char *)WORD(gen, word);
+}
+
+/*
+ * The index of the word of the first 'len' bytes of UTF-8 folded as the
+ * words are, -1 if there's no such word
+ */
+int crossgen_find_word(const struct crossgen *gen, const char *word, int len)
+{
+    uint32_t c;
+    int i, j, k, n, code;
+
+    for (i = 0; i < gen->wordnum; i++)
+    {
+        for (j = 0, k = 0; j < len && k < gen->words[i].wordlen; j += n, k++)
+        {
+            if (!(n = read_letter(gen, word + j, len - j, &c)) || !(code = find_letter(gen, c)) || \
+                    code != (unsigned char)WORD(gen, i)[k])
+                break;
+        }
+        if (j == len && k == gen->words[i].wordlen)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Read a letter of the UTF-8 text as the letters of the words are read,
+ * a new letter gets the next code. Returns the bytes read or 0 if it's not
+ * a letter or there's no code for it.
+ */
+int crossgen_letter_code(struct crossgen *gen, const char *text, int len, int *code)
+{
+    uint32_t c;
+    int n;
+
+    if (!(n = read_letter(gen, text, len, &c)) || \
+            (!(*code = find_letter(gen, c)) && !(*code = add_letter(gen, c))))
+        return 0;
+    return n;
+}
+
+// The letter of the code in UTF-8, in upper case if asked, NULL if no letter has the code
+const char *crossgen_letter(const struct crossgen *gen, int code, int upper)
+{
+    return code > 0 && code <= gen->letternum ? gen->letter_text[code][!!upper] : NULL;
+}
+
+// Unmap the cache, the generator has no words then
+static void drop_cache(struct crossgen *gen)
+{
+    if (!gen->cache)
+        return;
+    munmap(gen->cache, gen->cache_size);
+    gen->cache = NULL;
+    gen->cache_size = 0;
+    gen->word_pool = NULL;
+    gen->word_pool_len = gen->word_pool_size = 0;
+}
+
+/*
+ * Copy the word pool of the cache into the generator's own memory before
+ * the words change. The pairs are the generator's own already.
+ */
+static int own_cache(struct crossgen *gen)
+{
+    char *pool = NULL;
+    int len = gen->word_pool_len;
+
+    if (!gen->cache)
+        return 0;
+    if (!(pool = (char *)malloc(len ? len : 1)))
+        return 1;
+    memcpy(pool, gen->word_pool, len);
+    drop_cache(gen);
+    gen->word_pool = pool;
+    gen->word_pool_len = len;
+    gen->word_pool_size = len ? len : 1;
+    return 0;
+}
+
+// Pad a section of 'size' bytes with zeros up to CACHE_ALIGN
+static int write_padding(FILE *fcache, size_t size)
+{
+    static const char zeros[CACHE_ALIGN];
+
+    return CACHE_ALIGNED(size) > size && 1 != fwrite(zeros, CACHE_ALIGNED(size) - size, 1, fcache);
+}
+
+/*
+ * Write the words and their letter index to the cache file, see struct
+ * cache_header. crossgen_load_cache() maps the file and builds the pairs
+ * of the words it takes from the index. The index is sorted by counting
+ * the letters, so the file takes time and memory linear in the letters of
+ * the words, however many pairs they have.
+ */
+int crossgen_save_cache(struct crossgen *gen, const char *path)
+{
+    struct cache_header header;
+    struct cross_elem elem;
+    struct cache_spot *spots = NULL;
+    int32_t index[CROSSGEN_LETTERS + 2], next[CROSSGEN_LETTERS + 2];
+    FILE *fcache = NULL;
+    int i, p, c, spotnum = 0;
+
+    memset(index, 0, sizeof(index));
+    for (i = 0; i < gen->wordnum; i++)
+    {
+        for (p = 0; p < gen->words[i].wordlen; p++)
+            index[(unsigned char)WORD(gen, i)[p] + 1]++;
+        spotnum += gen->words[i].wordlen;
+    }
+    for (c = 1; c <= CROSSGEN_LETTERS + 1; c++)
+        index[c] += index[c - 1];
+    if (!(spots = (struct cache_spot *)malloc((spotnum ? spotnum : 1) * sizeof(struct cache_spot))))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return 1;
+    }
+    memcpy(next, index, sizeof(index));
+    for (i = 0; i < gen->wordnum; i++)
+    {
+        for (p = 0; p < gen->words[i].wordlen; p++)
+        {
+            c = (unsigned char)WORD(gen, i)[p];
+            spots[next[c]].word = i;
+            spots[next[c]++].pos = p;
+        }
+    }
+
+    memset(&header, 0, sizeof(struct cache_header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version       = CACHE_VERSION;
+    header.byte_order    = CACHE_BYTE_ORDER;
+    header.elem_size     = sizeof(struct cross_elem);
+    header.spot_size     = sizeof(struct cache_spot);
+    header.wordnum       = gen->wordnum;
+    header.word_pool_len = gen->word_pool_len;
+    header.spotnum       = spotnum;
+    header.letternum     = gen->letternum;
+    memcpy(header.letters, gen->letters, sizeof(header.letters));
+    header.words_at      = CACHE_ALIGNED(sizeof(struct cache_header));
+    header.pool_at       = header.words_at + CACHE_ALIGNED((uint64_t)gen->wordnum * sizeof(struct cross_elem));
+    header.index_at      = header.pool_at + CACHE_ALIGNED((uint64_t)gen->word_pool_len);
+    header.spots_at      = header.index_at + CACHE_ALIGNED(sizeof(index));
+
+    if (!(fcache = fopen(path, "wb")))
+    {
+        fprintf(stderr, "Can't open %s\n", path);
+        free(spots);
+        return 1;
+    }
+    if (1 != fwrite(&header, sizeof(struct cache_header), 1, fcache) || \
+            write_padding(fcache, sizeof(struct cache_header)))
+    {
+        goto fail;
+    }
+    // Only the places of the words are kept, the pairs are built anew
+    memset(&elem, 0, sizeof(struct cross_elem));
+    for (i = 0; i < gen->wordnum; i++)
+    {
+        elem.offset  = gen->words[i].offset;
+        elem.wordlen = gen->words[i].wordlen;
+        if (1 != fwrite(&elem, sizeof(struct cross_elem), 1, fcache))
+            goto fail;
+    }
+    if (write_padding(fcache, gen->wordnum * sizeof(struct cross_elem)) || \
+            (gen->word_pool_len && 1 != fwrite(gen->word_pool, gen->word_pool_len, 1, fcache)) || \
+            write_padding(fcache, gen->word_pool_len) || \
+            1 != fwrite(index, sizeof(index), 1, fcache) || \
+            write_padding(fcache, sizeof(index)) || \
+            (spotnum && 1 != fwrite(spots, spotnum * sizeof(struct cache_spot), 1, fcache)))
+    {
+        goto fail;
+    }
+    free(spots);
+    if (fclose(fcache))
+    {
+        fprintf(stderr, "Error writing %s\n", path);
+        return 1;
+    }
+    return 0;
+
+fail:
+    fprintf(stderr, "Error writing %s\n", path);
+    free(spots);
+    fclose(fcache);
+    return 1;
+}
+
+/*
+ * Build the pairs of the first 'num' words of a cache from its letter
+ * index instead of comparing the words. The spots of a letter before the
+ * word's one are the letters of the earlier words it crosses there, so
+ * only the crossings are visited. The pairs of word j with the earlier
+ * words are taken from the spots of all its letters at once, the earliest
+ * spot first, which is the order build_pairs() stores them in: the lists
+ * are the ones the words would get from a word list. 'count' is the
+ * number of the spots of every letter in the first 'num' words.
+ */
+static int index_pairs(struct crossgen *gen, const int32_t *index, const int *count, \
+        const struct cache_spot *spots, int num)
+{
+    const struct cache_spot **cur = NULL, *spot = NULL;
+    struct cross_pair *pair = NULL;
+    const char *word = NULL;
+    long long total = 0;
+    int *filled = NULL;
+    int i, j, l, p = 0, len, maxlen = 0, first;
+
+    for (j = 0; j < num; j++)
+    {
+        word = WORD(gen, j);
+        len = gen->words[j].wordlen;
+        gen->words[j].letters = 0;
+        gen->words[j].childnum = 0;
+        // Every letter crosses the same letters of the other words
+        for (l = 0; l < len; l++)
+        {
+            gen->words[j].letters |= letter_bit((unsigned char)word[l]);
+            gen->words[j].childnum += count[(unsigned char)word[l]];
+            for (p = 0; p < len; p++)
+                gen->words[j].childnum -= word[p] == word[l];
+        }
+        total += gen->words[j].childnum;
+        if (len > maxlen)
+            maxlen = len;
+    }
+    if (total > INT_MAX)
+    {
+        fprintf(stderr, "Too many pairs between the words: more than %d with %d words\n", INT_MAX, num);
+        return 1;
+    }
+    if (total > gen->pairsize)
+    {
+        struct cross_pair *tmp = NULL;
+        if (!(tmp = (struct cross_pair *)realloc(gen->pairs, (size_t)total * sizeof(struct cross_pair))))
+            goto nomem;
+        gen->pairs = tmp;
+        gen->pairsize = total;
+    }
+    gen->pairnum = total;
+    for (j = 0, first = 0; j < num; j++)
+    {
+        gen->words[j].firstpair = first;
+        first += gen->words[j].childnum;
+    }
+    if (!(filled = (int *)calloc(num + 1, sizeof(int))) || \
+            !(cur = (const struct cache_spot **)malloc((maxlen + 1) * sizeof(struct cache_spot *))))
+        goto nomem;
+
+    for (j = 0; j < num; j++)
+    {
+        word = WORD(gen, j);
+        len = gen->words[j].wordlen;
+        // A letter's spots reach the word's own one, the spots before it
+        // are of the earlier words
+        for (l = 0; l < len; l++)
+            cur[l] = spots + index[(unsigned char)word[l]];
+        while (1)
+        {
+            spot = NULL;
+            for (l = 0; l < len; l++)
+            {
+                if (cur[l]->word < j && (!spot || cur[l]->word < spot->word || \
+                            (cur[l]->word == spot->word && cur[l]->pos < spot->pos)))
+                {
+                    spot = cur[l];
+                    p = l;
+                }
+            }
+            if (!spot)
+                break;
+            cur[p]++;
+            i = spot->word;
+            pair = &gen->pairs[gen->words[i].firstpair + filled[i]++];
+            pair->crossed_word[0] = i;
+            pair->crossed_word[1] = j;
+            pair->crossed_word_letter[0] = spot->pos;
+            pair->crossed_word_letter[1] = p;
+            gen->pairs[gen->words[j].firstpair + filled[j]++] = *pair;
+        }
+    }
+    free(filled);
+    free(cur);
+    gen->paired = num;
+    return 0;
+
+nomem:
+    fprintf(stderr, "Not enough memory!\n");
+    free(filled);
+    free(cur);
+    return 1;
+}
+
+/*
+ * Take the first 'num' words of the cache file instead of the generator's
+ * current words, all of them if 'num' is 0. The file is mapped read only
+ * and shared with the other processes that use it. The words are read from
+ * the mapping, only the small table of the words is copied, and their
+ * pairs are built from the letter index: the time grows with the pairs of
+ * the words taken, the words after them are not read at all. The word
+ * pool is copied only when the words change.
+ */
+int crossgen_load_cache(struct crossgen *gen, const char *path, int num)
+{
+    const struct cache_header *header = NULL;
+    const struct cross_elem *words = NULL;
+    const struct cache_spot *spots = NULL, *spot = NULL;
+    const int32_t *index = NULL;
+    int count[CROSSGEN_LETTERS + 1];
+    struct stat st;
+    char *map = NULL;
+    int i, c, fd, letters = 0, counted = 0;
+
+    crossgen_clear_words(gen);
+    if (-1 == (fd = open(path, O_RDONLY)))
+    {
+        fprintf(stderr, "Can't open %s\n", path);
+        return 1;
+    }
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct cache_header) || \
+            MAP_FAILED == (map = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)))
+    {
+        fprintf(stderr, "%s is not a pair cache\n", path);
+        close(fd);
+        return 1;
+    }
+    close(fd);
+
+    header = (const struct cache_header *)map;
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) || CACHE_VERSION != header->version || \
+            CACHE_BYTE_ORDER != header->byte_order || sizeof(struct cross_elem) != header->elem_size || \
+            sizeof(struct cache_spot) != header->spot_size)
+    {
+        fprintf(stderr, "%s is not a pair cache of this version\n", path);
+        munmap(map, st.st_size);
+        return 1;
+    }
+    if (header->wordnum < 0 || header->word_pool_len < 0 || header->spotnum < 0 || \
+            header->letternum < 0 || header->letternum > CROSSGEN_LETTERS || \
+            header->words_at % CACHE_ALIGN || header->index_at % CACHE_ALIGN || header->spots_at % CACHE_ALIGN || \
+            header->words_at + (uint64_t)header->wordnum * sizeof(struct cross_elem) > header->pool_at || \
+            header->pool_at + header->word_pool_len > header->index_at || \
+            header->index_at + (CROSSGEN_LETTERS + 2) * sizeof(int32_t) > header->spots_at || \
+            header->spots_at + (uint64_t)header->spotnum * sizeof(struct cache_spot) > (uint64_t)st.st_size || \
+            (header->word_pool_len && map[header->pool_at + header->word_pool_len - 1]))
+    {
+        goto damaged;
+    }
+    words = (const struct cross_elem *)(map + header->words_at);
+    index = (const int32_t *)(map + header->index_at);
+    spots = (const struct cache_spot *)(map + header->spots_at);
+    for (i = 0; i < header->wordnum; i++)
+    {
+        if (words[i].offset < 0 || words[i].wordlen < 1 || \
+                words[i].offset + words[i].wordlen >= header->word_pool_len)
+        {
+            goto damaged;
+        }
+    }
+    if (index[0] || index[1])
+        goto damaged;
+    for (c = 1; c <= CROSSGEN_LETTERS; c++)
+    {
+        if (index[c + 1] < index[c] || index[c + 1] > header->spotnum)
+            goto damaged;
+    }
+    if (num <= 0 || num > header->wordnum)
+        num = header->wordnum;
+
+    /*
+     * The spots of the words taken begin every letter's list. They must be
+     * in order and hold the letter, then as many of them as the letters of
+     * the words are just these letters: index_pairs() counts on it.
+     */
+    for (i = 0; i < num; i++)
+        letters += words[i].wordlen;
+    for (c = 1; c <= CROSSGEN_LETTERS; c++)
+    {
+        for (spot = spots + index[c]; spot < spots + index[c + 1] && spot->word < num; spot++)
+        {
+            if (spot->word < 0 || spot->pos < 0 || spot->pos >= words[spot->word].wordlen || \
+                    c != (unsigned char)map[header->pool_at + words[spot->word].offset + spot->pos] || \
+                    (spot > spots + index[c] && (spot[-1].word > spot->word || \
+                                                (spot[-1].word == spot->word && spot[-1].pos >= spot->pos))))
+            {
+                goto damaged;
+            }
+        }
+        count[c] = spot - (spots + index[c]);
+        counted += count[c];
+    }
+    if (counted != letters)
+        goto damaged;
+
+    if (num > gen->wordsize)
+    {
+        struct cross_elem *tmp = NULL;
+        if (!(tmp = (struct cross_elem *)realloc(gen->words, num * sizeof(struct cross_elem))))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            munmap(map, st.st_size);
+            return 1;
+        }
+        gen->words = tmp;
+        gen->wordsize = num;
+    }
+
+    free(gen->word_pool);
+    gen->cache = map;
+    gen->cache_size = st.st_size;
+    gen->word_pool = map + header->pool_at;
+    gen->word_pool_len = 0;
+    if (num)
+    {
+        // The last word's codes, then its text
+        i = words[num - 1].offset + words[num - 1].wordlen + 1;
+        gen->word_pool_len = i + strlen(gen->word_pool + i) + 1;
+    }
+    gen->word_pool_size = 0;
+    memcpy(gen->words, words, num * sizeof(struct cross_elem));
+    gen->wordnum = num;
+    for (i = 1; i <= header->letternum; i++)
+        add_letter(gen, header->letters[i]);
+    if (index_pairs(gen, index, count, spots, num))
+    {
+        crossgen_clear_words(gen);
+        return 1;
+    }
+    return 0;
+
+damaged:
+    fprintf(stderr, "%s is damaged\n", path);
+    munmap(map, st.st_size);
+    return 1;
+}
+
+const char *crossgen_reject_name(int reason)
+{
+    return reason > 0 && reason < REJECT_REASONS ? reject_names[reason] : NULL;
+}
+
+const char *crossgen_score_name(int score)
+{
+    return score >= 0 && score < CROSSGEN_SCORES ? score_names[score] : NULL;
+}
+
+void crossgen_default_options(struct crossgen_options *options)
+{
+    memset(options, 0, sizeof(struct crossgen_options));
+    options->mode       = CROSSGEN_MODE_FULL;
+    options->threads    = 1;
+    options->beam_width = 64;
+    options->fold       = CROSSGEN_FOLD_CASE;
+}
+
+/*
+ * Make a generator with the options, the default ones if 'options' is NULL.
+ * Returns NULL if the options are wrong or there's not enough memory.
+ */
+struct crossgen *crossgen_new(const struct crossgen_options *options)
+{
+    struct crossgen *gen = NULL;
+    int i;
+
+    if (!(gen = (struct crossgen *)calloc(1, sizeof(struct crossgen))))
+        return NULL;
+    if (options)
+        gen->options = *options;
+    else
+        crossgen_default_options(&gen->options);
+
+    if (gen->options.mode < CROSSGEN_MODE_FULL || gen->options.mode > CROSSGEN_MODE_RANDOM || \
+            gen->options.threads < 1 || gen->options.beam_width < 1 || gen->options.deadline < 0 || \
+            gen->options.max_width < 0 || gen->options.max_height < 0 || \
+            (gen->options.max_ratio && gen->options.max_ratio < 1) || gen->options.top < 0 || \
+            (CROSSGEN_MODE_BEAM == gen->options.mode && gen->options.threads > 1) || \
+            gen->options.restarts < 0 || \
+            gen->options.export_depth < 0 || gen->options.export_sample < 0 || \
+            (gen->options.export_file && \
+             (CROSSGEN_MODE_FULL != gen->options.mode || gen->options.threads > 1)))
+    {
+        free(gen);
+        return NULL;
+    }
+    if (read_fold_letters(gen))
+    {
+        free(gen->fold_map);
+        free(gen);
+        return NULL;
+    }
+    if (gen->options.export_file && \
+            !(gen->export_buf = (struct crossgen_export_node *)malloc(EXPORT_BUFFER * sizeof(struct crossgen_export_node))))
+    {
+        free(gen->fold_map);
+        free(gen);
+        return NULL;
+    }
+    gen->search_mode  = gen->options.mode;
+    gen->threadnum    = gen->options.threads;
+    gen->beam_width   = gen->options.beam_width;
+    gen->time_limit   = gen->options.deadline;
+    gen->restarts     = gen->options.restarts || gen->time_limit > 0 ? gen->options.restarts : RANDOM_RESTARTS;
+    gen->top          = gen->options.top > 1 ? gen->options.top : 1;
+    for (i = 0; i < CROSSGEN_SCORES; i++)
+        gen->scoring |= gen->options.weights[i] != 0;
+    // A bigger crossword is always better if the area has a positive weight
+    gen->score_bounded = gen->options.weights[CROSSGEN_SCORE_AREA] <= 0;
+    gen->box_search   = gen->options.max_width || gen->options.max_height;
+    gen->max_width    = gen->options.max_width ? gen->options.max_width : INT_MAX;
+    gen->max_height   = gen->options.max_height ? gen->options.max_height : INT_MAX;
+    // The beam and the rollouts are chosen by the bounds of the nodes
+    gen->bound_search = gen->options.bound || CROSSGEN_MODE_BEAM == gen->search_mode || \
+        CROSSGEN_MODE_RANDOM == gen->search_mode;
+    gen->stats.depth  = -1;
+    return gen;
+}
+
+// Drop the statistics of the previous run
+static void clear_stats(struct crossgen *gen)
+{
+    free(gen->stats.depth_nodes);
+    free(gen->stats.root_time);
+    memset(&gen->stats, 0, sizeof(struct crossgen_stats));
+    gen->stats.depth = -1;
+}
+
+// Drop the result and the statistics of the previous run
+static void clear_result(struct crossgen *gen)
+{
+    int i;
+
+    // The pairs of the result are the ones of the first layout
+    for (i = 0; i < gen->result.layoutnum; i++)
+        free(gen->result.layouts[i].pairs);
+    free(gen->result.layouts);
+    memset(&gen->result, 0, sizeof(struct crossgen_result));
+    clear_stats(gen);
+    gen->updatable = 0;
+}
+
+// Free the pools and the workers
+static void drop_search(struct crossgen *gen)
+{
+    int i;
+
+    pool_destroy(&gen->node_pool);
+    for (i = 0; gen->workers && i < gen->threadnum; i++)
+        free_worker(&gen->workers[i]);
+    free(gen->workers);
+    gen->workers = NULL;
+    gen->search_size = 0;
+    gen->best_branch = NULL;
+}
+
+/*
+ * Make the pools and the workers for 'wordnum' words unless the ones of the
+ * previous run are big enough
+ */
+static int prepare_search(struct crossgen *gen, const int wordnum)
+{
+    int i, size = wordnum ? wordnum : 1;
+
+    if (gen->workers && size <= gen->search_size)
+        return 0;
+    drop_search(gen);
+    if (pool_init(&gen->node_pool, sizeof(struct strie_pair), 0))
+    {
+        fprintf(stderr, "Error initializing memory pools\n");
+        return 1;
+    }
+    if (!(gen->workers = (struct search_worker *)calloc(gen->threadnum, sizeof(struct search_worker))))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return 1;
+    }
+    gen->search_size = size;
+    for (i = 0; i < gen->threadnum; i++)
+    {
+        if (init_worker(gen, &gen->workers[i], i, size))
+            return 1;
+    }
+    return 0;
+}
+
+// Forget the strie of the run, its memory stays in the pools for the next one
+static void reset_search(struct crossgen *gen)
+{
+    int i;
+
+    pool_reset(&gen->node_pool);
+    for (i = 0; gen->workers && i < gen->threadnum; i++)
+    {
+        clear_grid(&gen->workers[i]);
+        pool_reset(&gen->workers[i].node_pool);
+        pool_reset(&gen->workers[i].cursor_pool);
+    }
+    gen->best_branch = NULL;
+}
+
+/*
+ * Copy the branch into the layout, the root goes first. The crossword that
+ * fits into the box only when turned is turned: (x, y) goes to (-y, -x),
+ * horizontal words become vertical ones and vice versa.
+ */
+static int save_layout(struct crossgen *gen, struct crossgen_layout *layout, struct strie_pair *node)
+{
+    struct crossgen_pair *pair = NULL;
+    int i, turn;
+
+    layout->width  = BOX_WIDTH(node->box);
+    layout->height = BOX_HEIGHT(node->box);
+    turn = layout->width > gen->max_width || layout->height > gen->max_height;
+    if (turn)
+    {
+        layout->width  = BOX_HEIGHT(node->box);
+        layout->height = BOX_WIDTH(node->box);
+    }
+    if (!(layout->pairs = (struct crossgen_pair *)malloc((node->depth + 1) * sizeof(struct crossgen_pair))))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return 1;
+    }
+    layout->pairnum = node->depth + 1;
+    for (; node; node = node->parent)
+    {
+        pair = &layout->pairs[node->depth];
+        for (i = 0; i < 2; i++)
+        {
+            pair->word[i]     = node->crossed_word[i];
+            pair->letter[i]   = node->crossed_word_letter[i];
+            pair->orient[i]   = turn ? -node->word_orient[i] : node->word_orient[i];
+            pair->coord[i][0] = turn ? -node->word_coord[i][1] : node->word_coord[i][0];
+            pair->coord[i][1] = turn ? -node->word_coord[i][0] : node->word_coord[i][1];
+        }
+    }
+    return 0;
+}
+
+/*
+ * Count the words, the crossings and the letters of the layout. The search
+ * keeps them only with the weights, the result has them anyway.
+ */
+static int count_layout(struct crossgen *gen, struct crossgen_layout *layout)
+{
+    struct grid_word *placed = NULL;
+    int *words = NULL;
+    int i, j, k, num = 0;
+
+    if (!(placed = (struct grid_word *)malloc(2 * layout->pairnum * sizeof(struct grid_word))) || \
+            !(words = (int *)malloc(2 * layout->pairnum * sizeof(int))))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        free(placed);
+        return 1;
+    }
+    for (i = 0; i < layout->pairnum; i++)
+    {
+        for (k = 0; k < 2; k++)
+        {
+            for (j = 0; j < num && words[j] != layout->pairs[i].word[k]; j++)
+                ;
+            if (j < num)
+                continue;
+            words[num] = layout->pairs[i].word[k];
+            placed[num].x = layout->pairs[i].coord[k][0];
+            placed[num].y = layout->pairs[i].coord[k][1];
+            placed[num].orient = layout->pairs[i].orient[k];
+            placed[num].len = gen->words[words[num]].wordlen;
+            num++;
+        }
+    }
+    layout->words = num;
+    layout->crossings = 0;
+    layout->letters = 0;
+    for (i = 0; i < num; i++)
+    {
+        layout->letters += placed[i].len;
+        for (j = 0; j < i; j++)
+        {
+            if (cells_cross(&placed[j], placed[i].x, placed[i].y, placed[i].orient, placed[i].len))
+                layout->crossings++;
+        }
+    }
+    layout->letters -= layout->crossings;
+    layout->score = gen->scoring ? score_of(gen, layout->pairnum, layout->words, layout->crossings, \
+            layout->letters, (long long)layout->width * layout->height) : layout->pairnum;
+    free(placed);
+    free(words);
+    return 0;
+}
+
+// Copy the branches into the result, the best one first
+static int save_result(struct crossgen *gen, struct strie_pair **nodes, int num)
+{
+    int i;
+
+    if (!num)
+        return 0;
+    if (!(gen->result.layouts = (struct crossgen_layout *)calloc(num, sizeof(struct crossgen_layout))))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return 1;
+    }
+    gen->result.layoutnum = num;
+    for (i = 0; i < num; i++)
+    {
+        if (save_layout(gen, &gen->result.layouts[i], nodes[i]) || count_layout(gen, &gen->result.layouts[i]))
+            return 1;
+    }
+    gen->result.pairnum = gen->result.layouts[0].pairnum;
+    gen->result.pairs   = gen->result.layouts[0].pairs;
+    gen->result.width   = gen->result.layouts[0].width;
+    gen->result.height  = gen->result.layouts[0].height;
+    return 0;
+}
+
+static int compare_kept(const void *a, const void *b, void *arg)
+{
+    const struct crossgen *gen = (const struct crossgen *)arg;
+    const struct top_layout *ta = *(const struct top_layout *const *)a;
+    const struct top_layout *tb = *(const struct top_layout *const *)b;
+
+    return compare_top(gen, ta->branch, ta->area, tb);
+}
+
+/*
+ * Choose the 'top' best of the crosswords kept by the workers into nodes[],
+ * the best first. Several workers may keep the same crossword. Returns the
+ * number of the crosswords, -1 if out of memory.
+ */
+static int choose_top(struct crossgen *gen, struct strie_pair **nodes)
+{
+    struct top_layout **all = NULL;
+    int i, j, k, num = 0, total = 0;
+
+    for (i = 0; i < gen->threadnum; i++)
+        total += gen->workers[i].topnum;
+    if (!(all = (struct top_layout **)malloc((total ? total : 1) * sizeof(struct top_layout *))))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return -1;
+    }
+    for (i = 0, k = 0; i < gen->threadnum; i++)
+    {
+        for (j = 0; j < gen->workers[i].topnum; j++)
+            all[k++] = &gen->workers[i].top[j];
+    }
+    qsort_r(all, total, sizeof(struct top_layout *), compare_kept, gen);
+    for (i = 0; i < total && num < gen->top; i++)
+    {
+        for (j = 0; j < i && all[j]->shape != all[i]->shape; j++)
+            ;
+        if (j == i)
+            nodes[num++] = all[i]->branch;
+    }
+    free(all);
+    return num;
+}
+
+/*
+ * The best branch till something better is found: the root of the last pair
+ * found. With the size limits it's the last root that fits, if any.
+ */
+static int initial_best(struct crossgen *gen)
+{
+    int word, index;
+
+    gen->best_branch = NULL;
+    if (gen->last_pair < 0)
+        return 0;
+    word  = gen->pairs[gen->last_pair].crossed_word[1];
+    index = gen->last_pair - gen->words[word].firstpair;
+    while (1)
+    {
+        if (!(gen->best_branch = make_root(gen, &gen->node_pool, word, index)))
+            return 1;
+        if (layout_fits(gen, gen->best_branch->box))
+            return 0;
+        pool_unalloc(&gen->node_pool, gen->best_branch);
+        gen->best_branch = NULL;
+        // Every pair is in the list of its first word, that is not after
+        // the last pair's one
+        while (--index < 0)
+        {
+            if (--word < 0)
+                return 0;
+            index = gen->words[word].childnum;
+        }
+    }
+}
+
+/*
+ * Build the pairs of the words without a search, crossgen_run() builds the
+ * missing ones anyway. The statistics of the previous run are dropped, the
+ * new ones get the number of the pairs and the time.
+ */
+int crossgen_build_pairs(struct crossgen *gen)
+{
+    struct timespec phase_start;
+
+    clear_stats(gen);
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+    if (build_pairs(gen, gen->wordnum))
+    {
+        fprintf(stderr, "Error building pairs between words\n");
+        return 1;
+    }
+    gen->stats.pairs_time = seconds_since(&phase_start);
+    gen->stats.pairs = gen->pairnum;
+    return 0;
+}
+
+/*
+ * Search the best crossword of the generator's words. The strie is dropped
+ * when the search is over, only the result and the statistics are kept
+ * till the next run. The memory of the strie, the pairs and the workers is
+ * kept too, so the next run on as many words or fewer doesn't allocate it
+ * again. The pairs are kept as well: only the words added since the last
+ * run are compared.
+ */
+int crossgen_run(struct crossgen *gen)
+{
+    struct timespec phase_start;
+    struct strie_pair **top = NULL;
+    int i, topnum, wordnum = gen->wordnum, ret = 1;
+
+    clear_result(gen);
+    gen->last_pair = -1;
+    gen->best_branch = NULL;
+    if (prepare_search(gen, wordnum))
+    {
+        drop_search(gen);
+        return 1;
+    }
+    if (gen->options.export_file && start_export(gen))
+        goto out;
+
+    // Build inital word pairs that we'll be using a lot later
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+    if (build_pairs(gen, wordnum))
+    {
+        fprintf(stderr, "Error building pairs between words\n");
+        goto out;
+    }
+    if (gen->bound_search && build_bounds(gen, wordnum))
+        goto out;
+    gen->stats.pairs_time = seconds_since(&phase_start);
+    gen->stats.pairs = gen->pairnum;
+    if (initial_best(gen))
+        goto out;
+
+    for (i = 0; i < gen->threadnum; i++)
+        reset_worker(&gen->workers[i], wordnum);
+    if (gen->top > 1 && gen->best_branch && keep_top(&gen->workers[0], gen->best_branch))
+        goto out;
+
+    atomic_store(&gen->best_score, gen->best_branch ? NODE_SCORE(gen, gen->best_branch) : LLONG_MIN);
+    clock_gettime(CLOCK_MONOTONIC, &gen->search_start);
+
+    // Fill the tree with all possible pairs. Scan all the words.
+    if (CROSSGEN_MODE_BEAM == gen->search_mode)
+    {
+        if (beam_search(&gen->workers[0], wordnum))
+            goto out;
+    }
+    else if (CROSSGEN_MODE_RANDOM == gen->search_mode)
+    {
+        if (random_search(gen, wordnum))
+            goto out;
+    }
+    else if (gen->threadnum > 1)
+    {
+        if (parallel_search(gen, wordnum))
+            goto out;
+    }
+    else
+    {
+        if (!(gen->stats.root_time = (double *)calloc(wordnum ? wordnum : 1, sizeof(double))))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            goto out;
+        }
+        for (i = 0; i < wordnum; i++)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &phase_start);
+#ifdef DEBUG
+            if (CROSSGEN_MODE_FULL == gen->search_mode)
+                printf("\n--------------------------------\nword[%d]=%s\n--------------------------------\n", i, TEXT(gen, i));
+#endif
+            if (CROSSGEN_MODE_STREAM == gen->search_mode)
+            {
+                if (stream_branch(&gen->workers[0], wordnum, i))
+                    goto out;
+            }
+            else if (build_branch(&gen->workers[0], wordnum, i))
+            {
+                goto out;
+            }
+            gen->stats.root_time[i] = seconds_since(&phase_start);
+        }
+    }
+    gen->stats.search_time = search_time(gen);
+
+    // Choose the best of the workers' branches
+    for (i = 0; i < gen->threadnum; i++)
+    {
+        if (gen->workers[i].best && \
+                (!gen->best_branch || compare_branches(gen, gen->workers[i].best, gen->best_branch) < 0))
+            gen->best_branch = gen->workers[i].best;
+        if (collect_stats(gen, &gen->workers[i]))
+            goto out;
+    }
+    if (gen->top > 1)
+    {
+        if (!(top = (struct strie_pair **)malloc(gen->top * sizeof(struct strie_pair *))))
+        {
+            fprintf(stderr, "Not enough memory!\n");
+            goto out;
+        }
+        if (-1 == (topnum = choose_top(gen, top)))
+            goto out;
+        gen->best_branch = topnum ? top[0] : NULL;
+    }
+    else
+    {
+        top = &gen->best_branch;
+        topnum = gen->best_branch ? 1 : 0;
+    }
+    if (gen->best_branch)
+        gen->stats.depth = gen->best_branch->depth;
+    if (save_result(gen, top, topnum))
+        goto out;
+    gen->updatable = 1;
+    ret = 0;
+
+out:
+    if (gen->top > 1)
+        free(top);
+    if (gen->options.export_file && flush_export(gen))
+    {
+        gen->updatable = 0;
+        ret = 1;
+    }
+    // Drop the strie: it lives in the pools
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+    reset_search(gen);
+    gen->stats.free_time = seconds_since(&phase_start);
+    return ret;
+}
+
+// The box of the crossword's words
+static void layout_box(const struct crossgen *gen, const struct crossgen_layout *layout, int box[2][2])
+{
+    int i, k;
+
+    box[0][0] = box[0][1] = INT_MAX;
+    box[1][0] = box[1][1] = INT_MIN;
+    for (i = 0; i < layout->pairnum; i++)
+    {
+        for (k = 0; k < 2; k++)
+        {
+            box_add(box, layout->pairs[i].coord[k][0], layout->pairs[i].coord[k][1], \
+                    layout->pairs[i].orient[k], gen->words[layout->pairs[i].word[k]].wordlen);
+        }
+    }
+}
+
+/*
+ * Size, words, crossings, letters and score of a changed crossword. The
+ * crossword that fits into the box only when turned is turned, as
+ * save_layout() does it.
+ */
+static int finish_layout(struct crossgen *gen, struct crossgen_layout *layout)
+{
+    struct crossgen_pair *pair = NULL;
+    int i, k, tmp, box[2][2];
+
+    if (!layout->pairnum)
+    {
+        layout->width = layout->height = 0;
+        layout->words = layout->crossings = layout->letters = 0;
+        layout->score = 0;
+        return 0;
+    }
+    layout_box(gen, layout, box);
+    layout->width  = BOX_WIDTH(box);
+    layout->height = BOX_HEIGHT(box);
+    if (layout->width > gen->max_width || layout->height > gen->max_height)
+    {
+        for (i = 0; i < layout->pairnum; i++)
+        {
+            pair = &layout->pairs[i];
+            for (k = 0; k < 2; k++)
+            {
+                pair->orient[k] = -pair->orient[k];
+                tmp = pair->coord[k][0];
+                pair->coord[k][0] = -pair->coord[k][1];
+                pair->coord[k][1] = -tmp;
+            }
+        }
+        layout->width  = BOX_HEIGHT(box);
+        layout->height = BOX_WIDTH(box);
+    }
+    return count_layout(gen, layout);
+}
+
+/*
+ * Drop the word from the crossword: its pairs go, and so do the pairs that
+ * were joined to the crossword only through it. The rest stays in place,
+ * the first pair left is the root. The later words are numbered one less.
+ */
+static int cut_layout(struct crossgen *gen, struct crossgen_layout *layout, int word)
+{
+    struct crossgen_pair *kept = NULL, *pair = NULL;
+    char *placed = NULL, *taken = NULL;
+    int i, k, num = 0, changed;
+
+    if (!layout->pairnum)
+        return 0;
+    if (!(kept = (struct crossgen_pair *)malloc(layout->pairnum * sizeof(struct crossgen_pair))) || \
+            !(placed = (char *)calloc(gen->wordnum, 1)) || \
+            !(taken = (char *)calloc(layout->pairnum, 1)))
+    {
+        free(kept);
+        free(placed);
+        return 1;
+    }
+    // A pair goes after the pairs that place one of its words
+    do
+    {
+        changed = 0;
+        for (i = 0; i < layout->pairnum; i++)
+        {
+            pair = &layout->pairs[i];
+            if (taken[i] || pair->word[0] == word || pair->word[1] == word || \
+                    (num && !placed[pair->word[0]] && !placed[pair->word[1]]))
+            {
+                continue;
+            }
+            placed[pair->word[0]] = placed[pair->word[1]] = 1;
+            taken[i] = 1;
+            kept[num++] = *pair;
+            changed = 1;
+        }
+    }
+    while (changed);
+
+    for (i = 0; i < num; i++)
+    {
+        for (k = 0; k < 2; k++)
+            kept[i].word[k] -= kept[i].word[k] > word;
+    }
+    free(layout->pairs);
+    layout->pairs = kept;
+    layout->pairnum = num;
+    free(placed);
+    free(taken);
+    return 0;
+}
+
+// Key of the shape of a crossword of the result, see shape_key()
+static unsigned long long result_shape(const struct crossgen_layout *layout, int box[2][2])
+{
+    struct shape_word words[2 * layout->pairnum];
+    int i, k, num = 0;
+
+    for (i = 0; i < layout->pairnum; i++)
+    {
+        for (k = 0; k < 2; k++)
+        {
+            words[num].word   = layout->pairs[i].word[k];
+            words[num].orient = layout->pairs[i].orient[k];
+            words[num].x      = layout->pairs[i].coord[k][0];
+            words[num].y      = layout->pairs[i].coord[k][1];
+            num++;
+        }
+    }
+    return shape_key(words, num, box);
+}
+
+// The better crossword first, the way compare_top() orders them
+static int compare_layouts(const struct crossgen_layout *a, const struct crossgen_layout *b)
+{
+    if (a->score != b->score)
+        return a->score > b->score ? -1 : 1;
+    if (a->pairnum != b->pairnum)
+        return b->pairnum - a->pairnum;
+    return a->width * a->height - b->width * b->height;
+}
+
+/*
+ * Put the changed crosswords of the result in order: the best first, the
+ * way compare_top() orders them. The empty ones, the ones that don't meet
+ * the size limits and the repeated ones go.
+ */
+static void tidy_result(struct crossgen *gen)
+{
+    struct crossgen_layout *layouts = gen->result.layouts, tmp;
+    unsigned long long shapes[gen->result.layoutnum ? gen->result.layoutnum : 1];
+    unsigned long long shape;
+    int i, j, num = 0, box[2][2];
+
+    for (i = 0; i < gen->result.layoutnum; i++)
+    {
+        layout_box(gen, &layouts[i], box);
+        if (!layouts[i].pairnum || !layout_fits(gen, box))
+        {
+            free(layouts[i].pairs);
+            continue;
+        }
+        shape = result_shape(&layouts[i], box);
+        for (j = 0; j < num && shapes[j] != shape; j++)
+            ;
+        if (j < num)
+        {
+            // Keep the better one in the place of the first one
+            if (compare_layouts(&layouts[i], &layouts[j]) < 0)
+            {
+                tmp = layouts[j];
+                layouts[j] = layouts[i];
+                layouts[i] = tmp;
+            }
+            free(layouts[i].pairs);
+            continue;
+        }
+        shapes[num] = shape;
+        layouts[num++] = layouts[i];
+    }
+
+    // Few crosswords are kept, a stable insertion sort is enough
+    for (i = 1; i < num; i++)
+    {
+        tmp = layouts[i];
+        for (j = i; j > 0 && compare_layouts(&tmp, &layouts[j - 1]) < 0; j--)
+            layouts[j] = layouts[j - 1];
+        layouts[j] = tmp;
+    }
+
+    gen->result.layoutnum = num;
+    gen->result.pairnum = num ? layouts[0].pairnum : 0;
+    gen->result.pairs   = num ? layouts[0].pairs : NULL;
+    gen->result.width   = num ? layouts[0].width : 0;
+    gen->result.height  = num ? layouts[0].height : 0;
+    gen->stats.depth    = num ? layouts[0].pairnum - 1 : -1;
+}
+
+// A place for a missing word, see best_attachment()
+struct attachment {
+    int     word;
+    int     x, y;
+    short   orient;
+    long long score;
+    int     area;
+};
+
+/*
+ * Find the best place for one of the words missing in the crossword placed
+ * on the grid. A word goes across one of the crossword's words it has a
+ * pair with and must not conflict with the others, the same way
+ * check_pair() places it. The place with the best score wins, then the one
+ * with the smaller box. A crossword that meets the size limits must still
+ * meet them with the word, one out of proportion may only grow within the
+ * box limits. Returns 0 if no word fits anywhere.
+ */
+static int best_attachment(struct crossgen *gen, struct grid *grid, const struct crossgen_layout *layout, \
+        int box[2][2], struct attachment *best)
+{
+    const struct cross_pair *pair = NULL;
+    struct grid_word *near = NULL;
+    int word, n, i, k, x, y, len, num, crossed, area, found = 0, fits = layout_fits(gen, box);
+    int newbox[2][2];
+    long long score;
+    short orient;
+
+    for (word = 0; word < gen->wordnum; word++)
+    {
+        if (grid_word_placed(grid, word))
+            continue;
+        len = gen->words[word].wordlen;
+        for (n = 0; n < gen->words[word].childnum; n++)
+        {
+            pair = &gen->pairs[gen->words[word].firstpair + n];
+            k = pair->crossed_word[0] == word ? 1 : 0;
+            if (!grid_word_placed(grid, pair->crossed_word[k]))
+                continue;
+            orient = place_by_pair(&grid->placed[pair->crossed_word[k]], pair, k, &x, &y);
+            memcpy(newbox, box, sizeof(newbox));
+            box_add(newbox, x, y, orient, len);
+            if (fits ? !layout_fits(gen, newbox) : gen->box_search && !box_fits(gen, newbox))
+                continue;
+            gen->stats.nodes++;
+
+            num = grid_near_words(grid, x, y, orient, len, MINDISTANCE - 1);
+            for (i = 0, crossed = 0; i < num; i++)
+            {
+                near = &grid->placed[grid->near[i]];
+                if (words_conflict(gen, grid->near[i], near->x, near->y, near->orient, word, x, y, orient))
+                    break;
+                crossed += cells_cross(near, x, y, orient, len);
+            }
+            if (i < num)
+                continue;
+
+            area = BOX_WIDTH(newbox) * BOX_HEIGHT(newbox);
+            score = gen->scoring ? score_of(gen, layout->pairnum + crossed, layout->words + 1, \
+                    layout->crossings + crossed, layout->letters + len - crossed, area) : \
+                layout->pairnum + crossed;
+            if (!found || score > best->score || (score == best->score && area < best->area))
+            {
+                best->word   = word;
+                best->x      = x;
+                best->y      = y;
+                best->orient = orient;
+                best->score  = score;
+                best->area   = area;
+                found = 1;
+            }
+        }
+    }
+    return found;
+}
+
+/*
+ * Put the word on the grid and add its pairs with every word it crosses
+ * to the crossword
+ */
+static int attach_word(struct crossgen *gen, struct grid *grid, struct crossgen_layout *layout, \
+        int box[2][2], const struct attachment *place)
+{
+    struct crossgen_pair *tmp = NULL, *pair = NULL;
+    const struct grid_word *a = NULL, *b = NULL;
+    int i, k, num, crossed = 0, len = gen->words[place->word].wordlen;
+
+    if (grid_place(grid, place->word, place->x, place->y, place->orient, len))
+        return 1;
+    box_add(box, place->x, place->y, place->orient, len);
+    num = grid_near_words(grid, place->x, place->y, place->orient, len, 0);
+    if (!(tmp = (struct crossgen_pair *)realloc(layout->pairs, (layout->pairnum + num) * sizeof(struct crossgen_pair))))
+        return 1;
+    layout->pairs = tmp;
+    for (i = 0; i < num; i++)
+    {
+        if (grid->near[i] == place->word || \
+                !cells_cross(&grid->placed[grid->near[i]], place->x, place->y, place->orient, len))
+        {
+            continue;
+        }
+        pair = &layout->pairs[layout->pairnum++];
+        pair->word[0] = place->word < grid->near[i] ? place->word : grid->near[i];
+        pair->word[1] = place->word < grid->near[i] ? grid->near[i] : place->word;
+        a = &grid->placed[pair->word[0]];
+        b = &grid->placed[pair->word[1]];
+        // The letters in the cell where the words cross
+        pair->letter[0] = 1 == a->orient ? b->x - a->x : a->y - b->y;
+        pair->letter[1] = 1 == a->orient ? b->y - a->y : a->x - b->x;
+        for (k = 0; k < 2; k++)
+        {
+            a = &grid->placed[pair->word[k]];
+            pair->orient[k]   = a->orient;
+            pair->coord[k][0] = a->x;
+            pair->coord[k][1] = a->y;
+        }
+        crossed++;
+    }
+    layout->words++;
+    layout->crossings += crossed;
+    layout->letters += len - crossed;
+    return 0;
+}
+
+/*
+ * Attach the words missing in the crossword one by one, the best place of
+ * all of them first, while any of them fits. The crossword is put on the
+ * grid for that and taken off when done. If it ends out of the size
+ * limits, it goes back to the last words it met them with: the pairs of
+ * the words attached are added at the end.
+ */
+static int attach_words(struct crossgen *gen, struct grid *grid, struct crossgen_layout *layout)
+{
+    struct attachment place;
+    struct crossgen_pair *pair = NULL;
+    int i, k, word, box[2][2], fitted, ret = 1;
+
+    memset(&place, 0, sizeof(struct attachment));
+    if (finish_layout(gen, layout))
+        return 1;
+    layout_box(gen, layout, box);
+    for (i = 0; i < layout->pairnum; i++)
+    {
+        pair = &layout->pairs[i];
+        for (k = 0; k < 2; k++)
+        {
+            if (!grid_word_placed(grid, pair->word[k]) && \
+                    grid_place(grid, pair->word[k], pair->coord[k][0], pair->coord[k][1], pair->orient[k], \
+                        gen->words[pair->word[k]].wordlen))
+            {
+                goto out;
+            }
+        }
+    }
+    fitted = layout_fits(gen, box) ? layout->pairnum : -1;
+    while (best_attachment(gen, grid, layout, box, &place))
+    {
+        if (attach_word(gen, grid, layout, box, &place))
+            goto out;
+        if (layout_fits(gen, box))
+            fitted = layout->pairnum;
+    }
+    if (fitted >= 0)
+        layout->pairnum = fitted;
+    ret = 0;
+
+out:
+    for (word = 0; word < gen->wordnum; word++)
+    {
+        if (grid_word_placed(grid, word))
+            grid_remove(grid, word);
+    }
+    if (ret)
+        fprintf(stderr, "Not enough memory!\n");
+    return ret || finish_layout(gen, layout);
+}
+
+/*
+ * Bring the result of the last run up to date with the words added and
+ * removed since then without a new search. The pairs of the new words are
+ * added to the ones kept, and every crossword kept gets the words it lacks
+ * attached one by one: the place with the best score of all the words
+ * first, as long as any word fits. If no crossword is left, the search's
+ * first root is the start. A full search may find better crosswords,
+ * crossgen_run() makes it; without a run before, crossgen_update() makes
+ * it too.
+ */
+int crossgen_update(struct crossgen *gen)
+{
+    struct timespec phase_start;
+    int i, ret = 1;
+
+    if (!gen->updatable)
+        return crossgen_run(gen);
+    clear_stats(gen);
+    gen->result.timed_out = 0;
+    if (prepare_search(gen, gen->wordnum))
+    {
+        drop_search(gen);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+    if (build_pairs(gen, gen->wordnum))
+    {
+        fprintf(stderr, "Error building pairs between words\n");
+        goto out;
+    }
+    gen->stats.pairs_time = seconds_since(&phase_start);
+    gen->stats.pairs = gen->pairnum;
+
+    clock_gettime(CLOCK_MONOTONIC, &gen->search_start);
+    if (!gen->result.layoutnum)
+    {
+        if (initial_best(gen))
+            goto out;
+        if (gen->best_branch)
+        {
+            free(gen->result.layouts);
+            if (!(gen->result.layouts = (struct crossgen_layout *)calloc(1, sizeof(struct crossgen_layout))))
+            {
+                fprintf(stderr, "Not enough memory!\n");
+                goto out;
+            }
+            gen->result.layoutnum = 1;
+            if (save_layout(gen, &gen->result.layouts[0], gen->best_branch))
+                goto out;
+        }
+    }
+    for (i = 0; i < gen->result.layoutnum; i++)
+    {
+        if (attach_words(gen, &gen->workers[0].grid, &gen->result.layouts[i]))
+            goto out;
+    }
+    tidy_result(gen);
+    gen->stats.search_time = search_time(gen);
+    ret = 0;
+
+out:
+    reset_search(gen);
+    return ret;
+}
+
+const struct crossgen_result *crossgen_result(const struct crossgen *gen)
+{
+    return &gen->result;
+}
+
+const struct crossgen_stats *crossgen_stats(const struct crossgen *gen)
+{
+    return &gen->stats;
+}
+
+void crossgen_free(struct crossgen *gen)
+{
+    if (!gen)
+        return;
+    clear_result(gen);
+    drop_search(gen);
+    drop_cache(gen);
+    free(gen->export_buf);
+    free(gen->pairs);
+    free(gen->partners_left);
+    free(gen->root_partners);
+    free(gen->root_crossings);
+    free(gen->root_letters);
+    free(gen->words);
+    free(gen->word_pool);
+    free(gen->fold_map);
+    free(gen);
+}
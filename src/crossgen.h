@@ -0,0 +1,301 @@
+/*
+ * Crossword Generator library
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef CROSSGEN_H
+#define CROSSGEN_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A generator holds everything one search needs: the words, their pairs,
+ * the search workers and the result. Generators don't share any state, so
+ * any number of them may run at once on different threads. A generator
+ * itself is used by one thread at a time. A generator may run any number
+ * of times on different words, the memory of a run is reused by the next one.
+ *
+ *     struct crossgen_options options;
+ *     struct crossgen *gen;
+ *
+ *     crossgen_default_options(&options);
+ *     if (!(gen = crossgen_new(&options)))
+ *         ...
+ *     if (crossgen_load_words(gen, list, num) || crossgen_run(gen))
+ *         ...
+ *     result = crossgen_result(gen);
+ *     ...
+ *     crossgen_free(gen);
+ *
+ * After a run the words may be changed by crossgen_add_word() and
+ * crossgen_remove_word(), and crossgen_update() brings the result up to
+ * date in a fraction of the time of a new run: the crosswords kept get
+ * the new words attached one by one where they fit best, without a search.
+ * crossgen_run() searches the best crossword of the changed words anew.
+ *
+ * A big dictionary takes long to read and to compare, crossgen_save_cache()
+ * writes its words with an index of their letters to a file once, and
+ * crossgen_load_cache() maps the file, or any number of its first words,
+ * and builds their pairs from the index without comparing the words. The
+ * file grows with the letters of the words, the pairs of the words taken
+ * still grow with the square of their number. The processes that map the
+ * same file share its words.
+ *
+ * The words are read as UTF-8. Every letter becomes a code from 1 to
+ * CROSSGEN_LETTERS, one byte long, in the order the letters first appear
+ * in the words, and the search compares only the codes. Letters are folded
+ * to lower case, and to the letters without diacritics if asked, before
+ * they get their codes, see crossgen_options.fold. crossgen_word() gives
+ * the folded word in UTF-8, crossgen_letter() a letter of the code.
+ */
+
+// Search modes
+#define CROSSGEN_MODE_FULL   0  // build the whole strie in memory
+#define CROSSGEN_MODE_STREAM 1  // keep only the current branch and the best one
+#define CROSSGEN_MODE_BEAM   2  // expand only the best nodes of every strie level
+#define CROSSGEN_MODE_RANDOM 3  // randomized greedy rollouts from seeded restarts
+
+#define CROSSGEN_REJECT_REASONS 14  // see crossgen_reject_name()
+
+#define CROSSGEN_LETTERS    253 // different letters of the words of a generator
+
+// Letter folding, see crossgen_options.fold
+#define CROSSGEN_FOLD_CASE  1   // upper case Latin, Greek, Cyrillic and Armenian letters to lower case
+#define CROSSGEN_FOLD_MARKS 2   // letters with diacritics to their base letters, e.g. 'é' to 'e'
+
+/*
+ * What makes a crossword better, see crossgen_options.weights and
+ * crossgen_score_name()
+ */
+#define CROSSGEN_SCORE_PAIRS     0  // crossed pairs
+#define CROSSGEN_SCORE_WORDS     1  // words placed
+#define CROSSGEN_SCORE_CROSSINGS 2  // cells where two words cross
+#define CROSSGEN_SCORE_LETTERS   3  // cells with a letter
+#define CROSSGEN_SCORE_AREA      4  // cells of the box
+#define CROSSGEN_SCORE_DENSITY   5  // cells with a letter per 1000 cells of the box
+#define CROSSGEN_SCORES          6
+
+struct crossgen_options {
+    int     mode;
+    int     threads;        // number of search threads, beam search uses one
+    int     bound;          // cut off the subtrees that can't beat the best branch
+    int     beam_width;     // nodes of a level expanded by the first beam pass
+    double  deadline;       // seconds the beam or random search may take, 0 - no limit
+    /*
+     * The random search runs 'restarts' rollouts, 0 - till the deadline or
+     * 100 if there's none. Restart r always takes the same random choices
+     * for the same seed on any thread, so the result depends only on the
+     * seed and the number of the restarts done.
+     */
+    unsigned long long seed;
+    long    restarts;
+    /*
+     * The crossword must fit into a max_width x max_height box, either as
+     * it is or turned by 90 degrees, and its longer side must be at most
+     * max_ratio times the shorter one. 0 - no limit.
+     */
+    int     max_width;
+    int     max_height;
+    double  max_ratio;
+    /*
+     * Keep the 'top' best crosswords instead of one: the ones with more
+     * crossed pairs first, then the ones with a smaller box. A crossword
+     * found again in another place or turned is kept once. 0 - only the best.
+     */
+    int     top;
+    /*
+     * The best crossword has the highest sum of weight * value of every
+     * CROSSGEN_SCORE_*, e.g. a negative weight of the area prefers smaller
+     * crosswords. All 0 - the most crossed pairs.
+     */
+    int     weights[CROSSGEN_SCORES];
+    /*
+     * Write the strie to the file as it's searched, see struct
+     * crossgen_export_header. The full search on one thread only.
+     */
+    FILE   *export_file;
+    int     export_depth;   // only the nodes up to this depth, 0 - all
+    int     export_sample;  // only the subtrees of every N-th root, 0 - all
+    /*
+     * CROSSGEN_FOLD_* flags, CROSSGEN_FOLD_CASE by default. 'fold_letters'
+     * is UTF-8 pairs of letters, the first letter of a pair is taken as the
+     * second one after the other folding, e.g. "ёе" for Russian puzzles.
+     */
+    int     fold;
+    const char *fold_letters;
+    /*
+     * Called by the beam and the random search every time it finds a better
+     * crossword, 'width' is the beam width or the restart that found it. The
+     * random search calls it from any of its threads.
+     */
+    void  (*progress)(int pairnum, double seconds, int width, void *arg);
+    void   *progress_arg;
+};
+
+// A pair of crossed words of the crossword
+struct crossgen_pair {
+    int     word[2];
+    int     letter[2];      // the crossed letters of the words
+    short   orient[2];      // 1 - horisontal; -1 - vertical
+    int     coord[2][2];    // coordinates of the beginning of the words
+};
+
+// One of the crosswords kept
+struct crossgen_layout {
+    int     pairnum;
+    struct crossgen_pair *pairs;    // the first pair is the root of the branch
+    int     width;          // size of the crossword
+    int     height;
+    int     words;          // words placed
+    int     crossings;      // cells where two words cross
+    int     letters;        // cells with a letter
+    long long score;        // by the weights, the number of pairs if there are none
+};
+
+struct crossgen_result {
+    int     pairnum;        // 0 if the words don't cross at all
+    struct crossgen_pair *pairs;    // the first pair is the root of the branch
+    int     timed_out;      // the deadline passed, the crossword may be not the best
+    int     width;          // size of the crossword
+    int     height;
+    int     layoutnum;      // number of the crosswords kept, up to options.top
+    struct crossgen_layout *layouts;    // the best one first, it's the crossword above
+};
+
+struct crossgen_stats {
+    int     pairs;          // number of the pairs of all the words
+    int     depth;          // depth of the best branch, -1 if none
+    long    nodes;
+    long    pruned;         // nodes cut off by the branch-and-bound search
+    long    rejects[CROSSGEN_REJECT_REASONS];   // pairs check_pair() rejected and why
+    long   *depth_nodes;    // number of the nodes created at every depth
+    int     depth_nodes_len;
+    double  pairs_time;     // build_pairs() and build_bounds()
+    double *root_time;      // search of every root word, single thread only
+    double  search_time;
+    double  free_time;      // dropping the strie
+    long    exported;       // nodes written to options.export_file
+    long    restarts;       // rollouts done by the random search
+};
+
+/*
+ * The strie export: a struct crossgen_export_header, then a struct
+ * crossgen_export_node for every node of the searched subtrees in
+ * pre-order, so a node's parent is the last node before it that is one
+ * level higher. The numbers are in the byte order of the machine that
+ * wrote the file. A file has the nodes of one run. 'striedump' converts
+ * the file to DOT or JSON.
+ */
+#define CROSSGEN_EXPORT_MAGIC      "CGSTRIE"
+#define CROSSGEN_EXPORT_VERSION    1
+#define CROSSGEN_EXPORT_BYTE_ORDER 0x01020304
+
+struct crossgen_export_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t node_size;     // sizeof(struct crossgen_export_node)
+    int32_t  wordnum;
+};
+
+struct crossgen_export_node {
+    int32_t  depth;
+    int32_t  word[2];
+    int32_t  coord[2][2];   // coordinates of the beginning of the words
+    int16_t  letter[2];     // the crossed letters of the words
+    int8_t   orient[2];     // 1 - horisontal; -1 - vertical
+    int8_t   reserved[2];
+};
+
+void  crossgen_default_options(struct crossgen_options *options);
+struct crossgen *crossgen_new(const struct crossgen_options *options);
+void  crossgen_free(struct crossgen *gen);
+
+void  crossgen_clear_words(struct crossgen *gen);
+int   crossgen_add_word(struct crossgen *gen, const char *word, int len);
+int   crossgen_remove_word(struct crossgen *gen, int word);
+int   crossgen_load_words(struct crossgen *gen, const char *const *list, int num);
+int   crossgen_load_file(struct crossgen *gen, FILE *fwords);
+int   crossgen_save_cache(struct crossgen *gen, const char *path);
+int   crossgen_load_cache(struct crossgen *gen, const char *path, int num);
+int   crossgen_word_count(const struct crossgen *gen);
+const char *crossgen_word(const struct crossgen *gen, int word);
+int   crossgen_word_length(const struct crossgen *gen, int word);
+const unsigned char *crossgen_word_codes(const struct crossgen *gen, int word);
+int   crossgen_find_word(const struct crossgen *gen, const char *word, int len);
+int   crossgen_letter_code(struct crossgen *gen, const char *text, int len, int *code);
+const char *crossgen_letter(const struct crossgen *gen, int code, int upper);
+
+int   crossgen_build_pairs(struct crossgen *gen);
+int   crossgen_run(struct crossgen *gen);
+int   crossgen_update(struct crossgen *gen);
+const struct crossgen_result *crossgen_result(const struct crossgen *gen);
+const struct crossgen_stats *crossgen_stats(const struct crossgen *gen);
+const char *crossgen_reject_name(int reason);
+const char *crossgen_score_name(int score);
+
+/*
+ * Template fill: instead of a freeform layout, fill a fixed grid with the
+ * words of a generator. The template is 'height' rows of 'width' cells,
+ * row by row: CROSSGEN_FILL_BLACK - black square, CROSSGEN_FILL_EMPTY -
+ * empty cell, any other one is the code of the letter given, see
+ * crossgen_letter_code(). Every run of two or more white cells across or down is a
+ * slot that takes one word, a word is used at most once. The filler reads
+ * the words of the generator, so the generator must outlive it and keep
+ * its words.
+ *
+ *     struct crossgen_fill *fill;
+ *
+ *     if (!(fill = crossgen_fill_new(gen)) || crossgen_fill_run(fill, cells, width, height, 0))
+ *         ...
+ *     result = crossgen_fill_result(fill);
+ *     ...
+ *     crossgen_fill_free(fill);
+ */
+#define CROSSGEN_FILL_BLACK 255
+#define CROSSGEN_FILL_EMPTY 254
+
+struct crossgen_slot {
+    int     row, col;       // the first cell, counted from the top left corner
+    short   orient;         // 1 - across; -1 - down
+    int     len;
+    int     word;           // word of the generator, -1 if the slot is not filled
+};
+
+struct crossgen_fill_result {
+    int     filled;         // every slot got a word
+    int     timed_out;      // the deadline passed before the template was filled
+    int     width, height;
+    unsigned char *cells;   // the filled template, the fullest fill found if not filled
+    int     slotnum;
+    struct crossgen_slot *slots;    // across and down slots in the reading order
+    long    nodes;          // words tried
+    long    backtracks;     // words taken back
+    long    restarts;       // times the search started again with other words first
+    double  index_time;     // crossgen_fill_new()
+    double  search_time;
+};
+
+struct crossgen_fill *crossgen_fill_new(const struct crossgen *gen);
+void  crossgen_fill_free(struct crossgen_fill *fill);
+int   crossgen_fill_run(struct crossgen_fill *fill, const unsigned char *cells, int width, int height, \
+        double deadline);
+const struct crossgen_fill_result *crossgen_fill_result(const struct crossgen_fill *fill);
+
+#endif /* CROSSGEN_H */
@@ -0,0 +1,1150 @@
+/*
+ * Crossword Generator template filler
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "crossgen.h"
+
+#define FILL_LETTERS     256    // every letter code, see crossgen_letter_code()
+#define FILL_NO_SCORE    (1 << 20)  // score of a letter no crossing word has
+#define FILL_CHECK_NODES 4096   // words tried between two looks at the clock
+#define FILL_FIRST_CUTOFF 4096L // words tried before the first restart
+#define FILL_NOISE       512    // noise of the scores after a restart, see order_values()
+
+/*
+ * The filler is a constraint solver: every slot is a variable, its domain
+ * is the set of the words that still fit it. A set of words is a bitset over
+ * the words of one length, and for every position and letter the bucket of
+ * the length has the set of its words with this letter at this position. So
+ * when a word goes into a slot, the domain of a crossing slot is cut down by
+ * a single AND with the set of its letter at the crossing (forward
+ * checking). Then every changed domain is checked against the domains of
+ * its crossing slots: a word is dropped if the crossing slot has no word
+ * with its letter at the crossing, until no domain changes (arc
+ * consistency). The search goes on with the slot that has the fewest words
+ * left.
+ *
+ * When no word fits a slot, the search doesn't just take back the last word:
+ * it goes straight back to the latest slot that took part in the failure
+ * (conflict-directed backjumping). Every domain knows the filled slots it
+ * was cut down by, the conflict set of a slot gathers them from its own
+ * domain and the domains its words emptied, together with the slots that
+ * took the words it can't reuse.
+ */
+
+// Words of one length
+struct fill_bucket {
+    int     num;            // number of words
+    int     nwords;         // 64-bit words in a set of the bucket
+    int    *entries;        // words of the generator, the most flexible first
+    unsigned long long *all;    // every word of the bucket
+    unsigned long long *used;   // the words already in the grid
+    int    *used_by;        // the slot of every used word
+    int    *used_list;      // the used words in the order they were taken
+    int     used_num;
+    unsigned long long **index; /* len * FILL_LETTERS sets: the words with
+                                   the letter at the position, NULL if none */
+    unsigned char *text;    // the words one after another in the order of the entries
+    unsigned char *letters; // len * FILL_LETTERS: the letters found at every position
+    int    *nletters;       // number of the letters at every position
+    int    *count_at;       /* len * FILL_LETTERS: place of the letter at the
+                               position in the letter counts of a slot, -1 if
+                               no word has it there */
+    int     ncounts;        // number of the letter counts of a slot
+};
+
+struct fill_slot {
+    int     len;
+    int     crossings;      // number of the crossed slots
+    struct fill_bucket *bucket;     // NULL if there are no words this long
+    int    *cross;          // for every letter: the crossing slot, -1 if none
+    int    *cross_pos;      // for every letter: its position in the crossing slot
+    unsigned long long *domain;     // the words that still fit the slot
+    int    *counts;         // number of the words of the domain with every letter at every position
+    int     size;           // number of the words of the domain
+    int     count;          // number of the words of the domain that are not used
+    int     entry;          // entry of the bucket in the slot, -1 if none
+    int     depth;          // the search depth the slot was filled at
+    int     saved_depth;    // the search depth the domain was last saved at
+    int     queued;         // the domain is to be checked against the crossing ones
+    unsigned long long *reasons;    // the filled slots the domain was cut down by
+    unsigned long long *conflicts;  // the filled slots to blame if no word fits
+};
+
+// A domain cut down by a word, see save_domain()
+struct fill_undo {
+    int     slot;
+    int     size;
+    int     count;
+    int     saved_depth;
+};
+
+// A dictionary word while the buckets are being built
+struct fill_word {
+    const char *word;
+    int     index;
+    int     score;
+};
+
+// A word to try in a slot, see fill_search()
+struct fill_value {
+    int     entry;
+    int     score;
+};
+
+struct crossgen_fill {
+    const struct crossgen *gen;
+    struct fill_bucket *buckets;    // by word length
+    int     maxlen;
+    double  index_time;
+
+    /*
+     * The current run
+     */
+    struct fill_slot *slots;
+    int    *cross_pool;     // the cross[] and cross_pos[] arrays of all the slots
+    unsigned long long *domain_pool;
+    int    *counts_pool;
+    struct fill_undo *undo; // the domains to restore when a word is taken back
+    int     undo_len;
+    int     undo_size;
+    unsigned long long *saved;  // their words, reasons and letter counts, one domain after another
+    size_t  saved_len;
+    size_t  saved_size;
+    int    *queue;          // the changed domains, see propagate()
+    unsigned long long *dropped;    // the words cut_domain() drops
+    struct fill_value *values;      // the words to try at every depth, one depth after another
+    int     values_len;
+    int     values_size;
+    int     nomem;
+    unsigned long long *conflict_pool;  // reasons and conflicts of all the slots
+    int     setwords;       // 64-bit words in a set of slots
+    int     jump;           // the slot to go back to, -1 - the template can't be filled
+    int    *best;           // the entries of the fullest fill found
+    int     best_depth;
+    long    cutoff;         // the number of the words tried to restart the search at
+    unsigned long long random;      // xorshift64* state of the noise of the scores
+    double  deadline;
+    struct timespec start;
+    struct crossgen_fill_result result;
+};
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// log2(x) in 1/256 units, the fraction is linear between the powers of 2
+static int log2_256(unsigned x)
+{
+    int e = 31 - __builtin_clz(x);
+
+    return e * 256 + (e >= 8 ? (x >> (e - 8)) & 0xff : (x << (8 - e)) & 0xff);
+}
+
+// The value that leaves the most words to the crossing slots first
+// xorshift64*, the same fill on every platform
+static unsigned long long next_random(struct crossgen_fill *fill)
+{
+    fill->random ^= fill->random >> 12;
+    fill->random ^= fill->random << 25;
+    fill->random ^= fill->random >> 27;
+    return fill->random * 0x2545F4914F6CDD1DULL;
+}
+
+static int compare_values(const void *a, const void *b)
+{
+    const struct fill_value *va = (const struct fill_value *)a;
+    const struct fill_value *vb = (const struct fill_value *)b;
+
+    if (va->score != vb->score)
+        return vb->score - va->score;
+    return va->entry - vb->entry;
+}
+
+static int compare_words(const void *a, const void *b)
+{
+    const struct fill_word *wa = (const struct fill_word *)a;
+    const struct fill_word *wb = (const struct fill_word *)b;
+    int diff = strcmp(wa->word, wb->word);
+
+    return diff ? diff : wa->index - wb->index;
+}
+
+static int compare_scores(const void *a, const void *b)
+{
+    const struct fill_word *wa = (const struct fill_word *)a;
+    const struct fill_word *wb = (const struct fill_word *)b;
+
+    if (wa->score != wb->score)
+        return wb->score - wa->score;
+    return wa->index - wb->index;
+}
+
+/*
+ * Make the bucket of the words of length 'len'. The same word is taken
+ * once. A word is the more flexible the more words of the bucket have its
+ * letters at the same positions: its score is the sum of the logarithms of
+ * these numbers, i.e. the words that leave more choice to the crossing
+ * slots are tried first.
+ */
+static int build_bucket(struct fill_bucket *bucket, struct fill_word *words, int num, int len)
+{
+    int i, k, p, *counts = NULL;
+    unsigned long long **set;
+
+    qsort(words, num, sizeof(struct fill_word), compare_words);
+    for (i = k = 0; i < num; i++)
+    {
+        if (!k || strcmp(words[i].word, words[k - 1].word))
+            words[k++] = words[i];
+    }
+    num = k;
+
+    if (!(counts = (int *)calloc(len * FILL_LETTERS, sizeof(int))))
+        return 1;
+    for (i = 0; i < num; i++)
+    {
+        for (p = 0; p < len; p++)
+            counts[p * FILL_LETTERS + (unsigned char)words[i].word[p]]++;
+    }
+    for (i = 0; i < num; i++)
+    {
+        words[i].score = 0;
+        for (p = 0; p < len; p++)
+            words[i].score += log2_256(counts[p * FILL_LETTERS + (unsigned char)words[i].word[p]]);
+    }
+    free(counts);
+    qsort(words, num, sizeof(struct fill_word), compare_scores);
+
+    bucket->num    = num;
+    bucket->nwords = (num + 63) / 64;
+    if (!(bucket->entries = (int *)malloc(num * sizeof(int))) || \
+            !(bucket->all = (unsigned long long *)calloc(bucket->nwords, sizeof(unsigned long long))) || \
+            !(bucket->used = (unsigned long long *)calloc(bucket->nwords, sizeof(unsigned long long))) || \
+            !(bucket->used_by = (int *)malloc(num * sizeof(int))) || \
+            !(bucket->used_list = (int *)malloc(num * sizeof(int))) || \
+            !(bucket->index = (unsigned long long **)calloc(len * FILL_LETTERS, sizeof(unsigned long long *))) || \
+            !(bucket->text = (unsigned char *)malloc(num * len)) || \
+            !(bucket->letters = (unsigned char *)malloc(len * FILL_LETTERS)) || \
+            !(bucket->nletters = (int *)calloc(len, sizeof(int))) || \
+            !(bucket->count_at = (int *)malloc(len * FILL_LETTERS * sizeof(int))))
+    {
+        return 1;
+    }
+    for (i = 0; i < len * FILL_LETTERS; i++)
+        bucket->count_at[i] = -1;
+    for (i = 0; i < num; i++)
+    {
+        bucket->entries[i] = words[i].index;
+        bucket->all[i / 64] |= 1ULL << (i % 64);
+        memcpy(bucket->text + i * len, words[i].word, len);
+        for (p = 0; p < len; p++)
+        {
+            set = &bucket->index[p * FILL_LETTERS + (unsigned char)words[i].word[p]];
+            if (!*set)
+            {
+                if (!(*set = (unsigned long long *)calloc(bucket->nwords, sizeof(unsigned long long))))
+                    return 1;
+                bucket->letters[p * FILL_LETTERS + bucket->nletters[p]++] = words[i].word[p];
+                bucket->count_at[p * FILL_LETTERS + (unsigned char)words[i].word[p]] = bucket->ncounts++;
+            }
+            (*set)[i / 64] |= 1ULL << (i % 64);
+        }
+    }
+    return 0;
+}
+
+static void free_run(struct crossgen_fill *fill)
+{
+    free(fill->slots);
+    free(fill->cross_pool);
+    free(fill->domain_pool);
+    free(fill->counts_pool);
+    free(fill->undo);
+    free(fill->saved);
+    free(fill->conflict_pool);
+    free(fill->queue);
+    free(fill->dropped);
+    free(fill->values);
+    free(fill->best);
+    free(fill->result.cells);
+    free(fill->result.slots);
+    fill->slots = NULL;
+    fill->cross_pool = NULL;
+    fill->domain_pool = NULL;
+    fill->counts_pool = NULL;
+    fill->undo = NULL;
+    fill->saved = NULL;
+    fill->conflict_pool = NULL;
+    fill->queue = NULL;
+    fill->dropped = NULL;
+    fill->values = NULL;
+    fill->values_len = 0;
+    fill->values_size = 0;
+    fill->undo_size = 0;
+    fill->saved_size = 0;
+    fill->nomem = 0;
+    fill->best = NULL;
+    memset(&fill->result, 0, sizeof(struct crossgen_fill_result));
+}
+
+void crossgen_fill_free(struct crossgen_fill *fill)
+{
+    int len, i;
+
+    if (!fill)
+        return;
+    free_run(fill);
+    for (len = 0; fill->buckets && len <= fill->maxlen; len++)
+    {
+        for (i = 0; fill->buckets[len].index && i < len * FILL_LETTERS; i++)
+            free(fill->buckets[len].index[i]);
+        free(fill->buckets[len].index);
+        free(fill->buckets[len].entries);
+        free(fill->buckets[len].all);
+        free(fill->buckets[len].used);
+        free(fill->buckets[len].used_by);
+        free(fill->buckets[len].used_list);
+        free(fill->buckets[len].text);
+        free(fill->buckets[len].letters);
+        free(fill->buckets[len].nletters);
+        free(fill->buckets[len].count_at);
+    }
+    free(fill->buckets);
+    free(fill);
+}
+
+/*
+ * Index the words of the generator for filling templates. Returns NULL if
+ * there's not enough memory.
+ */
+struct crossgen_fill *crossgen_fill_new(const struct crossgen *gen)
+{
+    struct crossgen_fill *fill = NULL;
+    struct fill_word *words = NULL;
+    struct timespec start;
+    int i, len, num, wordnum = crossgen_word_count(gen);
+    int *lens = NULL, *first = NULL;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!(fill = (struct crossgen_fill *)calloc(1, sizeof(struct crossgen_fill))))
+        goto nomem;
+    fill->gen = gen;
+    if (!(lens = (int *)malloc((wordnum ? wordnum : 1) * sizeof(int))) || \
+            !(words = (struct fill_word *)malloc((wordnum ? wordnum : 1) * sizeof(struct fill_word))))
+        goto nomem;
+    for (i = 0; i < wordnum; i++)
+    {
+        lens[i] = crossgen_word_length(gen, i);
+        if (lens[i] > fill->maxlen)
+            fill->maxlen = lens[i];
+    }
+
+    // Group the words by length
+    if (!(fill->buckets = (struct fill_bucket *)calloc(fill->maxlen + 1, sizeof(struct fill_bucket))) || \
+            !(first = (int *)calloc(fill->maxlen + 2, sizeof(int))))
+        goto nomem;
+    for (i = 0; i < wordnum; i++)
+        first[lens[i] + 1]++;
+    for (len = 1; len <= fill->maxlen + 1; len++)
+        first[len] += first[len - 1];
+    for (i = 0; i < wordnum; i++)
+    {
+        words[first[lens[i]]].word  = (const char *)crossgen_word_codes(gen, i);
+        words[first[lens[i]]].index = i;
+        first[lens[i]]++;
+    }
+    // first[len] is the end of the words of length 'len' now
+    for (len = 1; len <= fill->maxlen; len++)
+    {
+        num = first[len] - first[len - 1];
+        if (num && build_bucket(&fill->buckets[len], words + first[len - 1], num, len))
+            goto nomem;
+    }
+    free(lens);
+    free(words);
+    free(first);
+    fill->index_time = seconds_since(&start);
+    return fill;
+
+nomem:
+    fprintf(stderr, "Not enough memory!\n");
+    free(lens);
+    free(words);
+    free(first);
+    crossgen_fill_free(fill);
+    return NULL;
+}
+
+// Add (sign 1) or take away (sign -1) the letters of the words of the set to the letter counts
+static void count_letters(struct fill_slot *slot, const unsigned long long *set, int sign)
+{
+    struct fill_bucket *bucket = slot->bucket;
+    const unsigned char *word;
+    unsigned long long bits;
+    int i, p;
+
+    for (i = 0; i < bucket->nwords; i++)
+    {
+        for (bits = set[i]; bits; bits &= bits - 1)
+        {
+            word = bucket->text + (i * 64 + __builtin_ctzll(bits)) * slot->len;
+            for (p = 0; p < slot->len; p++)
+                slot->counts[bucket->count_at[p * FILL_LETTERS + word[p]]] += sign;
+        }
+    }
+}
+
+// Number of the words of the domain that are not used
+static int count_domain(struct fill_slot *slot)
+{
+    struct fill_bucket *bucket = slot->bucket;
+    int i, count = slot->size;
+
+    for (i = 0; i < bucket->used_num; i++)
+    {
+        if (slot->domain[bucket->used_list[i] / 64] & (1ULL << (bucket->used_list[i] % 64)))
+            count--;
+    }
+    return count;
+}
+
+/*
+ * Keep only the words of the domain that have the letter at the position,
+ * or drop them if 'keep' is 0. The letter counts tell how many words go and
+ * they are updated by the smaller part: the words dropped or the words kept.
+ */
+static void cut_domain(unsigned long long *dropped, struct fill_slot *slot, int pos, unsigned char c, int keep)
+{
+    struct fill_bucket *bucket = slot->bucket;
+    unsigned long long *domain = slot->domain, *set = bucket->index[pos * FILL_LETTERS + c];
+    int i, at = bucket->count_at[pos * FILL_LETTERS + c];
+    int with = -1 == at ? 0 : slot->counts[at];
+    int nkept = keep ? with : slot->size - with;
+
+    if (nkept < slot->size - nkept)
+    {
+        for (i = 0; i < bucket->nwords; i++)
+            domain[i] &= !set ? 0 : keep ? set[i] : ~set[i];
+        memset(slot->counts, 0, bucket->ncounts * sizeof(int));
+        count_letters(slot, domain, 1);
+    }
+    else if (nkept < slot->size)
+    {
+        for (i = 0; i < bucket->nwords; i++)
+        {
+            dropped[i] = domain[i] & (keep ? ~set[i] : set[i]);
+            domain[i] &= ~dropped[i];
+        }
+        count_letters(slot, dropped, -1);
+    }
+    slot->size = nkept;
+}
+
+#define WHITE(cells, width, row, col) (CROSSGEN_FILL_BLACK != (cells)[(row) * (width) + (col)])
+
+/*
+ * Find the slots of the template and their crossings and make their
+ * domains: the words of their length with the given letters.
+ */
+static int build_slots(struct crossgen_fill *fill)
+{
+    struct crossgen_fill_result *result = &fill->result;
+    struct crossgen_slot *out = NULL;
+    struct fill_slot *slot = NULL;
+    struct fill_bucket *bucket = NULL;
+    int width = result->width, height = result->height;
+    int row, col, s, p, i, cell, letters = 0, nwords = 0, ncounts = 0, maxwords = 0;
+    int *cell_slot = NULL, *cell_pos = NULL;
+    unsigned long long *domain;
+
+    // Slots start at the cells that begin a run of two or more white cells
+    for (row = 0; row < height; row++)
+    {
+        for (col = 0; col < width; col++)
+        {
+            if (!WHITE(result->cells, width, row, col))
+                continue;
+            if ((!col || !WHITE(result->cells, width, row, col - 1)) && \
+                    col + 1 < width && WHITE(result->cells, width, row, col + 1))
+                result->slotnum++;
+            if ((!row || !WHITE(result->cells, width, row - 1, col)) && \
+                    row + 1 < height && WHITE(result->cells, width, row + 1, col))
+                result->slotnum++;
+        }
+    }
+    if (!(result->slots = (struct crossgen_slot *)calloc(result->slotnum + 1, sizeof(struct crossgen_slot))) || \
+            !(fill->slots = (struct fill_slot *)calloc(result->slotnum + 1, sizeof(struct fill_slot))) || \
+            !(fill->best = (int *)malloc((result->slotnum + 1) * sizeof(int))) || \
+            !(cell_slot = (int *)malloc(2 * width * height * sizeof(int))) || \
+            !(cell_pos = (int *)malloc(2 * width * height * sizeof(int))))
+    {
+        goto nomem;
+    }
+    for (i = 0; i < 2 * width * height; i++)
+        cell_slot[i] = -1;
+
+    // Number the slots in the reading order, across before down
+    for (row = 0, s = 0; row < height; row++)
+    {
+        for (col = 0; col < width; col++)
+        {
+            if (!WHITE(result->cells, width, row, col))
+                continue;
+            if ((!col || !WHITE(result->cells, width, row, col - 1)) && \
+                    col + 1 < width && WHITE(result->cells, width, row, col + 1))
+            {
+                out = &result->slots[s];
+                out->row = row;
+                out->col = col;
+                out->orient = 1;
+                for (p = 0; col + p < width && WHITE(result->cells, width, row, col + p); p++)
+                {
+                    cell_slot[2 * (row * width + col + p)] = s;
+                    cell_pos[2 * (row * width + col + p)] = p;
+                }
+                out->len = p;
+                s++;
+            }
+            if ((!row || !WHITE(result->cells, width, row - 1, col)) && \
+                    row + 1 < height && WHITE(result->cells, width, row + 1, col))
+            {
+                out = &result->slots[s];
+                out->row = row;
+                out->col = col;
+                out->orient = -1;
+                for (p = 0; row + p < height && WHITE(result->cells, width, row + p, col); p++)
+                {
+                    cell_slot[2 * ((row + p) * width + col) + 1] = s;
+                    cell_pos[2 * ((row + p) * width + col) + 1] = p;
+                }
+                out->len = p;
+                s++;
+            }
+        }
+    }
+
+    for (s = 0; s < result->slotnum; s++)
+    {
+        fill->slots[s].len = result->slots[s].len;
+        fill->slots[s].entry = -1;
+        result->slots[s].word = -1;
+        letters += result->slots[s].len;
+        if (result->slots[s].len <= fill->maxlen && fill->buckets[result->slots[s].len].num)
+        {
+            fill->slots[s].bucket = &fill->buckets[result->slots[s].len];
+            nwords += fill->slots[s].bucket->nwords;
+            ncounts += fill->slots[s].bucket->ncounts;
+            if (fill->slots[s].bucket->nwords > maxwords)
+                maxwords = fill->slots[s].bucket->nwords;
+        }
+    }
+    if (!(fill->cross_pool = (int *)malloc(2 * (letters + 1) * sizeof(int))) || \
+            !(fill->domain_pool = (unsigned long long *)malloc((nwords + 1) * sizeof(unsigned long long))) || \
+            !(fill->counts_pool = (int *)malloc((ncounts + 1) * sizeof(int))) || \
+            !(fill->dropped = (unsigned long long *)malloc((maxwords + 1) * sizeof(unsigned long long))))
+        goto nomem;
+
+    for (s = 0, letters = 0, nwords = 0, ncounts = 0; s < result->slotnum; s++)
+    {
+        slot = &fill->slots[s];
+        out = &result->slots[s];
+        slot->cross = fill->cross_pool + 2 * letters;
+        slot->cross_pos = slot->cross + out->len;
+        letters += out->len;
+        for (p = 0; p < out->len; p++)
+        {
+            if (1 == out->orient)
+                cell = 2 * (out->row * width + out->col + p) + 1;
+            else
+                cell = 2 * ((out->row + p) * width + out->col);
+            slot->cross[p] = cell_slot[cell];
+            slot->cross_pos[p] = cell_pos[cell];
+            if (-1 != slot->cross[p])
+                slot->crossings++;
+        }
+        if (!(bucket = slot->bucket))
+            continue;
+
+        slot->domain = domain = fill->domain_pool + nwords;
+        nwords += bucket->nwords;
+        slot->counts = fill->counts_pool + ncounts;
+        ncounts += bucket->ncounts;
+        memcpy(slot->domain, bucket->all, bucket->nwords * sizeof(unsigned long long));
+        memset(slot->counts, 0, bucket->ncounts * sizeof(int));
+        count_letters(slot, slot->domain, 1);
+        slot->size = bucket->num;
+        for (p = 0; p < out->len; p++)
+        {
+            cell = (1 == out->orient) ? out->row * width + out->col + p : (out->row + p) * width + out->col;
+            if (CROSSGEN_FILL_EMPTY != result->cells[cell])
+                cut_domain(fill->dropped, slot, p, result->cells[cell], 1);
+        }
+        slot->count = slot->size;
+    }
+
+    fill->setwords = (result->slotnum + 63) / 64;
+    if (!(fill->conflict_pool = (unsigned long long *)calloc(2 * result->slotnum * fill->setwords + 1, \
+                    sizeof(unsigned long long))) || \
+            !(fill->queue = (int *)malloc((result->slotnum + 1) * sizeof(int))))
+        goto nomem;
+    for (s = 0; s < result->slotnum; s++)
+    {
+        fill->slots[s].reasons = fill->conflict_pool + 2 * s * fill->setwords;
+        fill->slots[s].conflicts = fill->slots[s].reasons + fill->setwords;
+        fill->slots[s].saved_depth = -1;
+    }
+    free(cell_slot);
+    free(cell_pos);
+    return 0;
+
+nomem:
+    fprintf(stderr, "Not enough memory!\n");
+    free(cell_slot);
+    free(cell_pos);
+    return 1;
+}
+
+// The unfilled slot with the fewest words left, the most crossed of them
+static struct fill_slot *pick_slot(struct crossgen_fill *fill)
+{
+    struct fill_slot *slot, *best = NULL;
+    int s;
+
+    for (s = 0; s < fill->result.slotnum; s++)
+    {
+        slot = &fill->slots[s];
+        if (-1 != slot->entry)
+            continue;
+        if (!best || slot->count < best->count || \
+                (slot->count == best->count && slot->crossings > best->crossings))
+            best = slot;
+    }
+    return best;
+}
+
+#define SET_ADD(set, i) ((set)[(i) / 64] |= 1ULL << ((i) % 64))
+#define SET_DEL(set, i) ((set)[(i) / 64] &= ~(1ULL << ((i) % 64)))
+#define SET_HAS(set, i) ((set)[(i) / 64] & (1ULL << ((i) % 64)))
+
+// Blame the slots that took the words of the domain
+static void blame_users(unsigned long long *set, struct fill_bucket *bucket, unsigned long long *domain)
+{
+    int i, entry;
+
+    for (i = 0; i < bucket->used_num; i++)
+    {
+        entry = bucket->used_list[i];
+        if (SET_HAS(domain, entry))
+            SET_ADD(set, bucket->used_by[entry]);
+    }
+}
+
+/*
+ * The slot 'slot' took a word and the domain of 'other' got empty: blame
+ * the slots the domain was cut down by
+ */
+static void blame(struct crossgen_fill *fill, struct fill_slot *slot, struct fill_slot *other)
+{
+    int i;
+
+    if (!slot)
+        return;
+    for (i = 0; i < fill->setwords; i++)
+        slot->conflicts[i] |= other->reasons[i];
+    blame_users(slot->conflicts, other->bucket, other->domain);
+}
+
+// 64-bit words a saved domain takes
+#define SAVED_LEN(fill, slot) ((slot)->bucket->nwords + (fill)->setwords + \
+        ((slot)->bucket->ncounts * sizeof(int) + 7) / 8)
+
+/*
+ * Keep the domain to restore it when the word of 'depth' is taken back, it's
+ * kept once for every depth. Returns 1 if there's not enough memory.
+ */
+static int save_domain(struct crossgen_fill *fill, struct fill_slot *slot, int depth)
+{
+    size_t len = SAVED_LEN(fill, slot), size;
+    struct fill_undo *undo;
+    unsigned long long *tmp;
+
+    if (slot->saved_depth == depth)
+        return 0;
+    if (fill->undo_len == fill->undo_size)
+    {
+        size = fill->undo_size ? fill->undo_size * 2 : 256;
+        if (!(undo = (struct fill_undo *)realloc(fill->undo, size * sizeof(struct fill_undo))))
+            return fill->nomem = 1;
+        fill->undo = undo;
+        fill->undo_size = size;
+    }
+    if (fill->saved_len + len > fill->saved_size)
+    {
+        for (size = fill->saved_size ? fill->saved_size * 2 : 16384; fill->saved_len + len > size; size *= 2)
+            ;
+        if (!(tmp = (unsigned long long *)realloc(fill->saved, size * sizeof(unsigned long long))))
+            return fill->nomem = 1;
+        fill->saved = tmp;
+        fill->saved_size = size;
+    }
+    undo = &fill->undo[fill->undo_len++];
+    undo->slot  = slot - fill->slots;
+    undo->size  = slot->size;
+    undo->count = slot->count;
+    undo->saved_depth = slot->saved_depth;
+    memcpy(fill->saved + fill->saved_len, slot->domain, slot->bucket->nwords * sizeof(unsigned long long));
+    memcpy(fill->saved + fill->saved_len + slot->bucket->nwords, slot->reasons, \
+            fill->setwords * sizeof(unsigned long long));
+    memcpy(fill->saved + fill->saved_len + slot->bucket->nwords + fill->setwords, slot->counts, \
+            slot->bucket->ncounts * sizeof(int));
+    fill->saved_len += len;
+    slot->saved_depth = depth;
+    return 0;
+}
+
+// The queue is a ring, a slot is queued once at a time
+static void push_queue(struct crossgen_fill *fill, int *tail, int s)
+{
+    if (!fill->slots[s].queued)
+    {
+        fill->slots[s].queued = 1;
+        fill->queue[*tail] = s;
+        *tail = (*tail + 1) % (fill->result.slotnum + 1);
+    }
+}
+
+/*
+ * Drop the words of the crossing slot that have a letter at the crossing
+ * no word of the slot has. Returns 1 if the domain of the crossing slot has
+ * changed.
+ */
+static int revise(struct crossgen_fill *fill, struct fill_slot *slot, int p, int depth)
+{
+    struct fill_slot *other = &fill->slots[slot->cross[p]];
+    struct fill_bucket *bucket = other->bucket;
+    int k, at, q = slot->cross_pos[p], changed = 0;
+    unsigned char c;
+
+    for (k = 0; k < bucket->nletters[q]; k++)
+    {
+        c = bucket->letters[q * FILL_LETTERS + k];
+        if (!other->counts[bucket->count_at[q * FILL_LETTERS + c]])
+            continue;
+        at = slot->bucket->count_at[p * FILL_LETTERS + c];
+        if (-1 != at && slot->counts[at])
+            continue;
+        if (!changed && save_domain(fill, other, depth))
+            return 0;
+        changed = 1;
+        cut_domain(fill->dropped, other, q, c, 0);
+    }
+    return changed;
+}
+
+/*
+ * Check the queued domains against the crossing ones till no domain
+ * changes. Returns 0 if a domain gets empty, the slots to blame for it go
+ * to the conflict set of 'slot', the slot that has just taken a word.
+ */
+static int propagate(struct crossgen_fill *fill, struct fill_slot *slot, int tail, int depth)
+{
+    struct fill_slot *cur, *other;
+    int head = 0, p, i, ret = 1;
+
+    while (head != tail)
+    {
+        cur = &fill->slots[fill->queue[head]];
+        cur->queued = 0;
+        head = (head + 1) % (fill->result.slotnum + 1);
+        for (p = 0; ret && p < cur->len; p++)
+        {
+            if (-1 == cur->cross[p] || -1 != fill->slots[cur->cross[p]].entry)
+                continue;
+            other = &fill->slots[cur->cross[p]];
+            if (!revise(fill, cur, p, depth))
+            {
+                if (fill->nomem)
+                    ret = 0;
+                continue;
+            }
+            for (i = 0; i < fill->setwords; i++)
+                other->reasons[i] |= cur->reasons[i];
+            if (!(other->count = count_domain(other)))
+            {
+                blame(fill, slot, other);
+                ret = 0;
+            }
+            else
+            {
+                push_queue(fill, &tail, cur->cross[p]);
+            }
+        }
+        if (!ret)
+            break;
+    }
+    // Leave the queue empty for the next word
+    for (; head != tail; head = (head + 1) % (fill->result.slotnum + 1))
+        fill->slots[fill->queue[head]].queued = 0;
+    return ret;
+}
+
+/*
+ * Put the word into the slot and cut down the domains of the crossing
+ * slots that are not filled yet. Returns 0 if a domain gets empty, the
+ * slots to blame for it go to the conflict set of the slot.
+ */
+static int assign(struct crossgen_fill *fill, struct fill_slot *slot, int entry)
+{
+    const unsigned char *word = crossgen_word_codes(fill->gen, slot->bucket->entries[entry]);
+    struct fill_slot *other;
+    int p, s = slot - fill->slots, tail = 0;
+
+    slot->entry = entry;
+    slot->bucket->used[entry / 64] |= 1ULL << (entry % 64);
+    slot->bucket->used_by[entry] = s;
+    slot->bucket->used_list[slot->bucket->used_num++] = entry;
+    for (p = 0; p < slot->len; p++)
+    {
+        if (-1 == slot->cross[p] || -1 != fill->slots[slot->cross[p]].entry)
+            continue;
+        other = &fill->slots[slot->cross[p]];
+        if (save_domain(fill, other, slot->depth))
+            return 0;
+        SET_ADD(other->reasons, s);
+        cut_domain(fill->dropped, other, slot->cross_pos[p], word[p], 1);
+        if (!(other->count = count_domain(other)))
+        {
+            blame(fill, slot, other);
+            return 0;
+        }
+        push_queue(fill, &tail, slot->cross[p]);
+    }
+    return propagate(fill, slot, tail, slot->depth);
+}
+
+// Take the word back and restore the domains it cut down
+static void take_back(struct crossgen_fill *fill, struct fill_slot *slot, int undo_mark)
+{
+    struct fill_undo *undo;
+    struct fill_slot *other;
+
+    while (fill->undo_len > undo_mark)
+    {
+        undo = &fill->undo[--fill->undo_len];
+        other = &fill->slots[undo->slot];
+        fill->saved_len -= SAVED_LEN(fill, other);
+        memcpy(other->domain, fill->saved + fill->saved_len, other->bucket->nwords * sizeof(unsigned long long));
+        memcpy(other->reasons, fill->saved + fill->saved_len + other->bucket->nwords, \
+                fill->setwords * sizeof(unsigned long long));
+        memcpy(other->counts, fill->saved + fill->saved_len + other->bucket->nwords + fill->setwords, \
+                other->bucket->ncounts * sizeof(int));
+        other->size  = undo->size;
+        other->count = undo->count;
+        other->saved_depth = undo->saved_depth;
+    }
+    slot->bucket->used[slot->entry / 64] &= ~(1ULL << (slot->entry % 64));
+    slot->bucket->used_num--;
+    slot->entry = -1;
+}
+
+/*
+ * No word fits the slot: blame the slots that cut down its domain too, go
+ * back to the latest slot to blame and hand it the rest of them.
+ */
+static void jump_back(struct crossgen_fill *fill, struct fill_slot *slot)
+{
+    unsigned long long *set = slot->conflicts, bits;
+    struct fill_slot *back = NULL;
+    int i, s;
+
+    for (i = 0; i < fill->setwords; i++)
+        set[i] |= slot->reasons[i];
+    if (slot->bucket)
+        blame_users(set, slot->bucket, slot->domain);
+    SET_DEL(set, slot - fill->slots);
+    for (i = 0; i < fill->setwords; i++)
+    {
+        for (bits = set[i]; bits; bits &= bits - 1)
+        {
+            s = i * 64 + __builtin_ctzll(bits);
+            if (!back || fill->slots[s].depth > back->depth)
+                back = &fill->slots[s];
+        }
+    }
+    if (!back)
+    {
+        fill->jump = -1;
+        return;
+    }
+    fill->jump = back - fill->slots;
+    SET_DEL(set, fill->jump);
+    for (i = 0; i < fill->setwords; i++)
+        back->conflicts[i] |= set[i];
+}
+
+/*
+ * Put the words the slot may take on the value stack, the word that leaves
+ * the most words to the crossing slots first: the score of a word is the
+ * sum of log2 of the number of the words of every empty crossing slot with
+ * its letter at the crossing. After a restart the scores get some noise, so
+ * the search tries other words first. Returns the number of the words, -1
+ * if out of memory.
+ */
+static int order_values(struct crossgen_fill *fill, struct fill_slot *slot)
+{
+    const struct fill_bucket *bucket = slot->bucket;
+    const struct fill_slot *other;
+    struct fill_value *value;
+    const unsigned char *text;
+    unsigned long long bits;
+    int i, p, at, num = 0, size, score;
+
+    if (fill->values_len + slot->count > fill->values_size)
+    {
+        for (size = fill->values_size ? fill->values_size * 2 : 4096; fill->values_len + slot->count > size; size *= 2)
+            ;
+        if (!(value = (struct fill_value *)realloc(fill->values, size * sizeof(struct fill_value))))
+        {
+            fill->nomem = 1;
+            return -1;
+        }
+        fill->values = value;
+        fill->values_size = size;
+    }
+    value = fill->values + fill->values_len;
+    for (i = 0; i < bucket->nwords; i++)
+    {
+        bits = slot->domain[i] & ~bucket->used[i];
+        while (bits)
+        {
+            value[num].entry = i * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            text = bucket->text + (size_t)value[num].entry * slot->len;
+            for (p = 0, score = 0; p < slot->len; p++)
+            {
+                if (-1 == slot->cross[p] || -1 != fill->slots[slot->cross[p]].entry)
+                    continue;
+                other = &fill->slots[slot->cross[p]];
+                at = other->bucket->count_at[slot->cross_pos[p] * FILL_LETTERS + text[p]];
+                // A word no crossing word fits goes last, assign() blames the crossing slot
+                score += (-1 == at || !other->counts[at]) ? -FILL_NO_SCORE : log2_256(other->counts[at]);
+            }
+            if (fill->result.restarts)
+                score += next_random(fill) % FILL_NOISE;
+            value[num++].score = score;
+        }
+    }
+    if (num)
+        qsort(value, num, sizeof(struct fill_value), compare_values);
+    return num;
+}
+
+/*
+ * Fill the rest of the slots, 'depth' of them are filled already. Returns
+ * 1 if the template is filled, 0 if it can't be (fill->jump is the slot to
+ * go back to), -1 if the deadline has passed or out of memory, -2 if the
+ * search is to restart: every word is taken back then.
+ */
+static int fill_search(struct crossgen_fill *fill, int depth)
+{
+    struct fill_slot *slot = NULL;
+    int k, s, num, base, entry, mark, ret;
+
+    if (depth > fill->best_depth)
+    {
+        fill->best_depth = depth;
+        for (s = 0; s < fill->result.slotnum; s++)
+            fill->best[s] = fill->slots[s].entry;
+    }
+    if (depth == fill->result.slotnum)
+        return 1;
+
+    slot = pick_slot(fill);
+    s = slot - fill->slots;
+    slot->depth = depth;
+    memset(slot->conflicts, 0, fill->setwords * sizeof(unsigned long long));
+    if (-1 == (num = order_values(fill, slot)))
+        return -1;
+    // The words deeper are put after these ones and dropped before the next one is tried
+    base = fill->values_len;
+    fill->values_len += num;
+    for (k = 0; k < num; k++)
+    {
+        entry = fill->values[base + k].entry;
+        if (!(++fill->result.nodes % FILL_CHECK_NODES) && fill->deadline > 0 && \
+                seconds_since(&fill->start) >= fill->deadline)
+        {
+            fill->result.timed_out = 1;
+            return -1;
+        }
+        if (fill->result.nodes >= fill->cutoff)
+        {
+            fill->values_len = base;
+            return -2;
+        }
+        mark = fill->undo_len;
+        if (assign(fill, slot, entry))
+        {
+            if (-2 == (ret = fill_search(fill, depth + 1)))
+            {
+                take_back(fill, slot, mark);
+                fill->values_len = base;
+                return ret;
+            }
+            if (ret)
+                return ret;
+            // A deeper slot failed for the reasons that don't involve this one
+            if (fill->jump != s)
+            {
+                take_back(fill, slot, mark);
+                fill->values_len = base;
+                return 0;
+            }
+        }
+        if (fill->nomem)
+            return -1;
+        take_back(fill, slot, mark);
+        fill->result.backtracks++;
+    }
+    fill->values_len = base;
+    jump_back(fill, slot);
+    return 0;
+}
+
+/*
+ * Fill the template with the words, stop after 'deadline' seconds if it's
+ * not 0. Returns 1 if the template is wrong or there's not enough memory;
+ * whether the template is filled is told by the result.
+ */
+int crossgen_fill_run(struct crossgen_fill *fill, const unsigned char *cells, int width, int height, \
+        double deadline)
+{
+    struct crossgen_fill_result *result = &fill->result;
+    struct crossgen_slot *out;
+    const unsigned char *word;
+    int s, p, len, tail, ret;
+    long cutoff;
+
+    free_run(fill);
+    if (!cells || width < 1 || height < 1 || deadline < 0)
+        return 1;
+    clock_gettime(CLOCK_MONOTONIC, &fill->start);
+    fill->deadline = deadline;
+    fill->undo_len = 0;
+    fill->saved_len = 0;
+    fill->best_depth = -1;
+    for (len = 1; len <= fill->maxlen; len++)
+    {
+        if (!fill->buckets[len].num)
+            continue;
+        memset(fill->buckets[len].used, 0, fill->buckets[len].nwords * sizeof(unsigned long long));
+        fill->buckets[len].used_num = 0;
+    }
+
+    result->width  = width;
+    result->height = height;
+    result->index_time = fill->index_time;
+    if (!(result->cells = (unsigned char *)malloc(width * height + 1)))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return 1;
+    }
+    memcpy(result->cells, cells, width * height);
+    result->cells[width * height] = '\0';
+    if (build_slots(fill))
+    {
+        free_run(fill);
+        return 1;
+    }
+
+    /*
+     * A slot no word fits, either of its length or with the given letters,
+     * can't be filled: nothing is searched then. The slots of a length no
+     * word has have no bucket at all.
+     */
+    for (s = 0; s < result->slotnum && fill->slots[s].count; s++)
+        ;
+    if (s < result->slotnum)
+    {
+        for (s = 0; s < result->slotnum; s++)
+            fill->best[s] = -1;
+        ret = 0;
+    }
+    else
+    {
+        // The given letters cut down the crossing slots too
+        for (s = 0, tail = 0; s < result->slotnum; s++)
+            push_queue(fill, &tail, s);
+        propagate(fill, NULL, tail, -1);
+
+        /*
+         * A few unlucky words at the top may keep the search busy for ages,
+         * while other words fill the template at once. So the search starts
+         * again with other words first every time it tries a number of words,
+         * and the number grows with every restart, so the search is still
+         * complete.
+         */
+        fill->random = 0x9E3779B97F4A7C15ULL;
+        for (cutoff = FILL_FIRST_CUTOFF; ; cutoff += cutoff / 2)
+        {
+            fill->cutoff = result->nodes + cutoff;
+            if (-2 != (ret = fill_search(fill, 0)))
+                break;
+            result->restarts++;
+        }
+    }
+    result->filled = (1 == ret);
+    if (fill->nomem)
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        free_run(fill);
+        return 1;
+    }
+    for (s = 0; s < result->slotnum; s++)
+    {
+        out = &result->slots[s];
+        if (-1 == fill->best[s])
+            continue;
+        out->word = fill->slots[s].bucket->entries[fill->best[s]];
+        word = crossgen_word_codes(fill->gen, out->word);
+        for (p = 0; p < out->len; p++)
+        {
+            if (1 == out->orient)
+                result->cells[out->row * width + out->col + p] = word[p];
+            else
+                result->cells[(out->row + p) * width + out->col] = word[p];
+        }
+    }
+    result->search_time = seconds_since(&fill->start);
+    return 0;
+}
+
+const struct crossgen_fill_result *crossgen_fill_result(const struct crossgen_fill *fill)
+{
+    return &fill->result;
+}
@@ -0,0 +1,265 @@
+/*
+ * Crossword Generator occupancy grid
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "grid.h"
+
+#define GRID_INIT_SIZE 64
+
+/*
+ * Up to this number of placed words it's cheaper to test the boxes of all
+ * of them at once than to look through the cells around the word
+ */
+#define GRID_BOX_WORDS 64
+
+int grid_init(struct grid *grid, int wordnum)
+{
+    memset(grid, 0, sizeof(struct grid));
+    grid->wordnum = wordnum;
+    if (!(grid->placed = (struct grid_word *)calloc(wordnum ? wordnum : 1, sizeof(struct grid_word))) || \
+            !(grid->seen = (unsigned *)calloc(wordnum ? wordnum : 1, sizeof(unsigned))) || \
+            !(grid->near = (int *)calloc(wordnum ? wordnum : 1, sizeof(int))) || \
+            !(grid->box_word = (int *)calloc(wordnum ? wordnum : 1, sizeof(int))) || \
+            simd_boxes_init(&grid->boxes, wordnum))
+    {
+        grid_free(grid);
+        return 1;
+    }
+    grid->simd = simd_kernels();
+    return 0;
+}
+
+void grid_free(struct grid *grid)
+{
+    free(grid->cells);
+    free(grid->placed);
+    free(grid->seen);
+    free(grid->near);
+    free(grid->box_word);
+    simd_boxes_free(&grid->boxes);
+    memset(grid, 0, sizeof(struct grid));
+}
+
+/*
+ * Make the grid cover the rectangle [x1, x2] x [y1, y2]. The grid grows at
+ * least twice, so the words are copied only a few times per search.
+ */
+int grid_fit(struct grid *grid, int x1, int y1, int x2, int y2)
+{
+    int x0, y0, width, height, row;
+    int *cells = NULL;
+
+    if (grid->cells && x1 >= grid->x0 && y1 >= grid->y0 && \
+            x2 < grid->x0 + grid->width && y2 < grid->y0 + grid->height)
+    {
+        return 0;
+    }
+
+    if (!grid->cells)
+    {
+        width  = x2 - x1 + 1 > GRID_INIT_SIZE ? x2 - x1 + 1 : GRID_INIT_SIZE;
+        height = y2 - y1 + 1 > GRID_INIT_SIZE ? y2 - y1 + 1 : GRID_INIT_SIZE;
+        x0 = x1 - (width - (x2 - x1 + 1)) / 2;
+        y0 = y1 - (height - (y2 - y1 + 1)) / 2;
+    }
+    else
+    {
+        // Keep the old grid inside and add the same space around
+        if (x1 > grid->x0)
+            x1 = grid->x0;
+        if (y1 > grid->y0)
+            y1 = grid->y0;
+        if (x2 < grid->x0 + grid->width - 1)
+            x2 = grid->x0 + grid->width - 1;
+        if (y2 < grid->y0 + grid->height - 1)
+            y2 = grid->y0 + grid->height - 1;
+        width  = 2 * (x2 - x1 + 1);
+        height = 2 * (y2 - y1 + 1);
+        x0 = x1 - (x2 - x1 + 1) / 2;
+        y0 = y1 - (y2 - y1 + 1) / 2;
+    }
+
+    if (!(cells = (int *)malloc(2 * sizeof(int) * width * height)))
+        return 1;
+    memset(cells, 0xff, 2 * sizeof(int) * width * height);
+
+    if (grid->cells)
+    {
+        for (row = 0; row < grid->height; row++)
+        {
+            memcpy(cells + 2 * ((grid->y0 + row - y0) * width + grid->x0 - x0), \
+                    grid->cells + 2 * row * grid->width, \
+                    2 * sizeof(int) * grid->width);
+        }
+        free(grid->cells);
+    }
+    grid->cells  = cells;
+    grid->x0     = x0;
+    grid->y0     = y0;
+    grid->width  = width;
+    grid->height = height;
+    return 0;
+}
+
+// Write the word number to the word cells, 'word' is -1 to clear them
+void grid_fill(struct grid *grid, int word, struct grid_word *pos)
+{
+    int k, dx, dy, index;
+
+    dx = 1 == pos->orient ? 1 : 0;
+    dy = 1 == pos->orient ? 0 : -1;
+    for (k = 0; k < pos->len; k++)
+    {
+        index = 2 * ((pos->y + k * dy - grid->y0) * grid->width + pos->x + k * dx - grid->x0);
+        grid->cells[index + (1 == pos->orient ? 0 : 1)] = word;
+    }
+}
+
+int grid_place(struct grid *grid, int word, int x, int y, short orient, int len)
+{
+    struct grid_word *pos = &grid->placed[word];
+    struct simd_boxes *boxes = &grid->boxes;
+
+    if (pos->refs++)
+        return 0;
+
+    pos->x = x;
+    pos->y = y;
+    pos->orient = orient;
+    pos->len = len;
+    if (1 == orient)
+    {
+        if (grid_fit(grid, x, y, x + len - 1, y))
+        {
+            pos->refs--;
+            return 1;
+        }
+    }
+    else if (grid_fit(grid, x, y - len + 1, x, y))
+    {
+        pos->refs--;
+        return 1;
+    }
+    grid_fill(grid, word, pos);
+
+    pos->box = boxes->num++;
+    grid->box_word[pos->box] = word;
+    boxes->x1[pos->box] = x;
+    boxes->x2[pos->box] = 1 == orient ? x + len - 1 : x;
+    boxes->y1[pos->box] = 1 == orient ? y : y - len + 1;
+    boxes->y2[pos->box] = y;
+    return 0;
+}
+
+void grid_remove(struct grid *grid, int word)
+{
+    struct grid_word *pos = &grid->placed[word];
+    struct simd_boxes *boxes = &grid->boxes;
+    int last;
+
+    if (pos->refs > 0 && !--pos->refs)
+    {
+        grid_fill(grid, -1, pos);
+
+        // The last box takes the place of the word's one
+        last = --boxes->num;
+        boxes->x1[pos->box] = boxes->x1[last];
+        boxes->y1[pos->box] = boxes->y1[last];
+        boxes->x2[pos->box] = boxes->x2[last];
+        boxes->y2[pos->box] = boxes->y2[last];
+        grid->box_word[pos->box] = grid->box_word[last];
+        grid->placed[grid->box_word[pos->box]].box = pos->box;
+        simd_boxes_clear(boxes, last);
+    }
+}
+
+/*
+ * Find all the words which have cells not farther than 'margin' from the
+ * cells of the given word. The numbers of the words are stored in
+ * grid->near, their number is returned. While there are few words on the
+ * grid, their boxes are tested all at once. Otherwise only the cells around
+ * the word are looked through, so the time doesn't depend on the number of
+ * placed words.
+ */
+int grid_near_words(struct grid *grid, int x, int y, short orient, int len, int margin)
+{
+    int x1, y1, x2, y2, cx, cy, k, num = 0;
+    int word;
+
+    if (!grid->cells)
+        return 0;
+
+    if (1 == orient)
+    {
+        x1 = x - margin;
+        x2 = x + len - 1 + margin;
+        y1 = y - margin;
+        y2 = y + margin;
+    }
+    else
+    {
+        x1 = x - margin;
+        x2 = x + margin;
+        y1 = y - len + 1 - margin;
+        y2 = y + margin;
+    }
+
+    if (grid->boxes.num <= GRID_BOX_WORDS)
+    {
+        num = grid->simd->boxes_near(&grid->boxes, x1, y1, x2, y2, grid->near);
+        for (k = 0; k < num; k++)
+            grid->near[k] = grid->box_word[grid->near[k]];
+        return num;
+    }
+
+    if (x1 < grid->x0)
+        x1 = grid->x0;
+    if (y1 < grid->y0)
+        y1 = grid->y0;
+    if (x2 >= grid->x0 + grid->width)
+        x2 = grid->x0 + grid->width - 1;
+    if (y2 >= grid->y0 + grid->height)
+        y2 = grid->y0 + grid->height - 1;
+
+    if (!++grid->stamp)
+    {
+        // The stamp has wrapped around, forget the old ones
+        memset(grid->seen, 0, sizeof(unsigned) * grid->wordnum);
+        grid->stamp = 1;
+    }
+    for (cy = y1; cy <= y2; cy++)
+    {
+        int *cell = grid->cells + 2 * ((cy - grid->y0) * grid->width + x1 - grid->x0);
+        for (cx = x1; cx <= x2; cx++, cell += 2)
+        {
+            for (k = 0; k < 2; k++)
+            {
+                word = cell[k];
+                if (word >= 0 && grid->seen[word] != grid->stamp)
+                {
+                    grid->seen[word] = grid->stamp;
+                    grid->near[num++] = word;
+                }
+            }
+        }
+    }
+    return num;
+}
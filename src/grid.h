@@ -0,0 +1,65 @@
+/*
+ * Crossword Generator occupancy grid
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef GRID_H
+#define GRID_H
+
+#include "simd.h"
+
+// Position of a word on the grid
+struct grid_word {
+    int     x, y;       // coordinates of the beginning of the word
+    short   orient;     // 1 - horisontal; -1 - vertical
+    int     len;
+    int     refs;       // number of times the word has been placed
+    int     box;        // the word's box in grid.boxes
+};
+
+/*
+ * The grid holds the words of one crossword: for every cell it knows which
+ * horizontal and which vertical word go through it. Horizontal words go
+ * right from their beginning, vertical words go down, i.e. their 'y'
+ * decreases. The same word may be placed several times (every pair of a
+ * branch places both its words), it stays on the grid until it's removed
+ * the same number of times. The boxes of the placed words are kept as well,
+ * a few words are found faster by their boxes than by the cells.
+ */
+struct grid {
+    int     x0, y0;         // coordinates of the first cell
+    int     width, height;
+    int    *cells;          // 2 word numbers per cell: horizontal, vertical; -1 if none
+    int     wordnum;
+    struct grid_word *placed;
+    unsigned *seen;         // stamps to report every near word once
+    unsigned stamp;
+    int    *near;           // the result of grid_near_words
+    struct simd_boxes boxes;    // boxes of the placed words
+    int    *box_word;       // the word of every box
+    const struct simd_kernels *simd;
+};
+
+int   grid_init(struct grid *grid, int wordnum);
+void  grid_free(struct grid *grid);
+int   grid_place(struct grid *grid, int word, int x, int y, short orient, int len);
+void  grid_remove(struct grid *grid, int word);
+int   grid_near_words(struct grid *grid, int x, int y, short orient, int len, int margin);
+
+#define grid_word_placed(grid, word) ((grid)->placed[word].refs > 0)
+
+#endif /* GRID_H */
@@ -0,0 +1,200 @@
+/*
+ * Crossword Generator vector kernel benchmark
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "simd.h"
+
+/*
+ * Runs every kernel of every variant the CPU supports on the same random
+ * data and prints one tab separated line per case: nanoseconds per call and
+ * the speedup over the scalar kernel. Exits with 1 if a variant gives a
+ * result other than the scalar one.
+ */
+
+#define WORDS       256         // words compared with each other
+#define WORD_MIN    3
+#define WORD_MAX    12
+#define ALPHABET    8           // as 'wordgen -a 8', many common letters
+#define BOX_ROUNDS  4096        // rectangles tested against every set of boxes
+
+static unsigned long long state = 0x9E3779B97F4A7C15ULL;
+
+static unsigned long long next_random(void)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+static int random_below(int n)
+{
+    return (int)(next_random() % (unsigned long long)n);
+}
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static unsigned char words[WORDS][SIMD_PADDED(WORD_MAX)];
+static int wordlen[WORDS];
+static unsigned masks[WORD_MAX * SIMD_CHUNKS(WORD_MAX)];
+
+/*
+ * Compare every couple of the words, as build_pairs() does. Returns the
+ * number of the crossings, to check the variants against each other.
+ */
+static long match_round(const struct simd_kernels *simd)
+{
+    int i, j;
+    long total = 0;
+
+    for (i = 0; i < WORDS; i++)
+    {
+        for (j = i + 1; j < WORDS; j++)
+            total += simd->match_letters(words[i], wordlen[i], words[j], wordlen[j], masks);
+    }
+    return total;
+}
+
+static void make_boxes(struct simd_boxes *boxes, int num)
+{
+    int i, len, horizontal;
+
+    for (i = 0; i < num; i++)
+    {
+        len = WORD_MIN + random_below(WORD_MAX - WORD_MIN + 1);
+        horizontal = random_below(2);
+        boxes->x1[i] = random_below(40) - 20;
+        boxes->y1[i] = random_below(40) - 20;
+        boxes->x2[i] = boxes->x1[i] + (horizontal ? len - 1 : 0);
+        boxes->y2[i] = boxes->y1[i] + (horizontal ? 0 : len - 1);
+    }
+    boxes->num = num;
+}
+
+/*
+ * Test the rectangles around many words against the boxes. Returns a sum of
+ * the boxes found, to check the variants against each other.
+ */
+static long boxes_round(const struct simd_boxes *boxes, const struct simd_kernels *simd, int *out)
+{
+    int i, k, x, y, num;
+    long total = 0;
+
+    for (i = 0; i < BOX_ROUNDS; i++)
+    {
+        x = i * 7 % 40 - 20;
+        y = i * 13 % 40 - 20;
+        num = simd->boxes_near(boxes, x - 1, y - 1, x + 1 + i % WORD_MAX, y + 1, out);
+        for (k = 0; k < num; k++)
+            total += (long)(out[k] + 1) * (i + 1);
+    }
+    return total;
+}
+
+int main(void)
+{
+    const struct simd_kernels *variants = NULL;
+    struct simd_boxes boxes;
+    struct timespec start;
+    int i, k, v, num, rounds, setnum, *out = NULL;
+    long expected = 0, got;
+    double scalar = 0, t;
+    static const int box_sets[] = {8, 16, 32, 64};
+    char name[32];
+    int ret = 0;
+
+    for (i = 0; i < WORDS; i++)
+    {
+        wordlen[i] = WORD_MIN + random_below(WORD_MAX - WORD_MIN + 1);
+        for (k = 0; k < wordlen[i]; k++)
+            words[i][k] = "etaoinsh"[random_below(ALPHABET)];
+    }
+    if (simd_boxes_init(&boxes, 64) || !(out = (int *)malloc(64 * sizeof(int))))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        return 1;
+    }
+
+    variants = simd_variants(&num);
+    printf("kernel\tvariant\tns_per_call\tspeedup\n");
+
+    // The scalar variant is the last one, go from it to get its time first
+    rounds = 20;
+    for (v = num - 1; v >= 0; v--)
+    {
+        got = match_round(&variants[v]);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < rounds; i++)
+            match_round(&variants[v]);
+        t = seconds_since(&start) * 1e9 / ((double)rounds * WORDS * (WORDS - 1) / 2);
+        if (v == num - 1)
+        {
+            expected = got;
+            scalar = t;
+        }
+        else if (got != expected)
+        {
+            fprintf(stderr, "match_letters: %s gives %ld crossings instead of %ld\n", \
+                    variants[v].name, got, expected);
+            ret = 1;
+        }
+        printf("match_letters\t%s\t%.2f\t%.2f\n", variants[v].name, t, scalar / t);
+    }
+
+    rounds = 200;
+    for (setnum = 0; setnum < (int)(sizeof(box_sets) / sizeof(box_sets[0])); setnum++)
+    {
+        for (i = 0; i < boxes.size; i++)
+            simd_boxes_clear(&boxes, i);
+        make_boxes(&boxes, box_sets[setnum]);
+        snprintf(name, sizeof(name), "boxes_near.%d", box_sets[setnum]);
+        for (v = num - 1; v >= 0; v--)
+        {
+            got = boxes_round(&boxes, &variants[v], out);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (i = 0; i < rounds; i++)
+                boxes_round(&boxes, &variants[v], out);
+            t = seconds_since(&start) * 1e9 / ((double)rounds * BOX_ROUNDS);
+            if (v == num - 1)
+            {
+                expected = got;
+                scalar = t;
+            }
+            else if (got != expected)
+            {
+                fprintf(stderr, "%s: %s finds other boxes\n", name, variants[v].name);
+                ret = 1;
+            }
+            printf("%s\t%s\t%.2f\t%.2f\n", name, variants[v].name, t, scalar / t);
+        }
+    }
+
+    simd_boxes_free(&boxes);
+    free(out);
+    return ret;
+}
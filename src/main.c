@@ -17,679 +17,1141 @@
  * this program; if not, see <http://www.gnu.org/licenses>.
  */
 
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <getopt.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "crossgen.h"
+
+#define STATS_NONE 0
+#define STATS_JSON 1
 
-#define MAXWORDS    10    // maximum number of words to create a crossword from
-#define MAXWORDLEN  15
-
-#define MINDISTANCE 2     /* minimum distance between the crossing words, e.g.
-                           *        0123456
-                           *        |||||||
-                           *        license
-                           *         n    m
-                           *         d<-->a
-                           *         i    i
-                           *         a    l
-                           *
-                           * in this example the distance between the words is
-                           * 6 - 1 = 5
-                           */
-struct strie_pair {
-    short   crossed_word[2];
-    short   crossed_word_letter[2];
-    short   word_orient[2];   // 1 - horisontal; -1 - vertical
-    short   word_coord[2][2]; // coordinates of the beginning of the word
-    short   procreator;       // the number of the root word
-    short   depth;
-    short  *available_first_children; /* an array of len 'wordnum' that holds the
-                                       numbers of each word first pair that can
-                                       be analyzed to create a child */
-    struct strie_pair *firstchild;
-    struct strie_pair *brother;
-    struct strie_pair *parent;
-};
-
-struct cross_elem {
-    char    word[MAXWORDLEN];
-    short   wordlen;
-    short   childnum;    // number of pairs between this words and later words
-    struct  strie_pair *firstchild;
-};
-
-struct cross_elem words[MAXWORDS];
-struct strie_pair *best_branch = NULL;
-
-int build_branch(const short wordnum, struct strie_pair *node);
-struct strie_pair *check_pair(struct strie_pair *main_node, struct strie_pair *check_node);
-int print_strie(struct strie_pair *node);
-int print_branch(struct strie_pair *node);
-int clear_branch(struct strie_pair *node);
-
-int add_child(struct cross_elem *word, struct strie_pair *new_child)
+#define BATCH_NONE  0
+#define BATCH_LINES 1   // words one per line, the sets are separated by blank lines
+#define BATCH_JSON  2   // one JSON array of words per line
+
+static double seconds_since(const struct timespec *start)
 {
-    struct strie_pair *cur_child = NULL;
+    struct timespec now;
 
-    if (!word)
-        return 1;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
 
-    if (!word->firstchild)
-    {
-        word->firstchild = new_child;
-        return 0;
-    }
+/*
+ * The word in UTF-8 with its letter 'upper' in upper case, -1 - none. The
+ * string is allocated, NULL if there's not enough memory.
+ */
+char *word_text(const struct crossgen *gen, int word, int upper)
+{
+    const unsigned char *codes = crossgen_word_codes(gen, word);
+    int k, len = crossgen_word_length(gen, word);
+    char *text = NULL, *end = NULL;
 
-    cur_child = word->firstchild;
-    while (cur_child->brother)
-    {
-        cur_child = cur_child->brother;
-    }
-    cur_child->brother = new_child;
-    return 0;
+    if (!(text = end = (char *)malloc(4 * len + 1)))
+        return NULL;
+    *end = '\0';
+    for (k = 0; k < len; k++)
+        end = stpcpy(end, crossgen_letter(gen, codes[k], k == upper));
+    return text;
 }
 
 /*
- * Take wordnum elements and find all crossings between them
+ * Print the branch of the crossword from the last pair to the root. The
+ * crosswords are numbered if there are several of them.
  */
-int build_pairs(short wordnum)
+int print_branch(const struct crossgen *gen, const struct crossgen_layout *layout, int number, int num)
 {
-    int i, j, k, l;
-    for (i = 0; i < wordnum; i++)
+    int i, k;
+    char *word[2] = {NULL, NULL};
+    const struct crossgen_pair *pair = NULL;
+
+    if (!layout->pairnum)
+        return 0;
+
+    if (num > 1)
+        printf("\nGenerated crossword puzzle %d of %d:\n--------------------------------\n", number + 1, num);
+    else
+        printf("\nGenerated crossword puzzle:\n--------------------------------\n");
+    for (k = layout->pairnum - 1; k >= 0; k--)
     {
-        for (j = i + 1; j < wordnum; j++)
+        pair = &layout->pairs[k];
+        // Mark intersection letters uppercase
+        for (i = 0; i < 2; i++)
         {
-            // Find all crossings between words 'i' and 'j'
-            for (k = 0; k < words[i].wordlen; k++)
+            if (!(word[i] = word_text(gen, pair->word[i], pair->letter[i])))
             {
-                struct strie_pair *schild = NULL;
-                char *tmp_wordpart = words[j].word;
-                while (NULL != (tmp_wordpart = strchr(tmp_wordpart, words[i].word[k])))
-                {
-#ifdef DEBUG
-                    printf("crossing between %s and %s: %c, %d, %d\n", \
-                            words[i].word, \
-                            words[j].word, \
-                            tmp_wordpart[0], \
-                            k, \
-                            tmp_wordpart - words[j].word);
-#endif
-                    // Allocate new children for word[i] and word[j]
-                    for (l = i; l <= j; l = l - i + j)
-                    {
-                        words[l].childnum++;
-                        if (!(schild = (struct strie_pair*)calloc(1, sizeof(struct strie_pair))))
-                        {
-                            fprintf(stderr, "Not enough memory!\n");
-                            return 1;
-                        }
-                        schild->crossed_word[0]    = i;
-                        schild->crossed_word[1]    = j;
-                        schild->crossed_word_letter[0] = k;
-                        schild->crossed_word_letter[1] = tmp_wordpart - words[j].word;
-                        schild->word_orient[0] = 1;
-                        schild->word_orient[1] = -(schild->word_orient[0]);
-                        schild->word_coord[0][0] = 0;
-                        schild->word_coord[0][1] = 0;
-                        schild->word_coord[1][0] = schild->crossed_word_letter[0];
-                        schild->word_coord[1][1] = schild->crossed_word_letter[1];
-                        schild->depth = 0;
-                        schild->procreator = l;
-                        schild->firstchild = NULL;
-                        schild->brother    = NULL;
-                        schild->parent     = NULL;
-                        schild->available_first_children = (short *)calloc(wordnum, sizeof(short));
-                        schild->available_first_children[l] = words[l].childnum;
-
-                        // Add allocated child to the parent
-                        add_child(&words[l], schild);
-                        best_branch = schild;
-                    }
-
-                    tmp_wordpart++;
-                }
+                fprintf(stderr, "Not enough memory!\n");
+                free(word[0]);
+                return 1;
             }
         }
+        printf("Crossed words:\t%d, %s\t-\t%d, %s\n", \
+                pair->word[0], word[0], \
+                pair->word[1], word[1]);
+        printf("Letters:\t%d\t%d\n", \
+                pair->letter[0], \
+                pair->letter[1]);
+        printf("Orient:\t\t%s\t%s\n", \
+                pair->orient[0] == 1 ? "hor" : "ver", \
+                pair->orient[1] == 1 ? "hor" : "ver" );
+        printf("Word coords:\t[%d, %d]\t[%d, %d]\n\n", \
+                pair->coord[0][0], \
+                pair->coord[0][1], \
+                pair->coord[1][0], \
+                pair->coord[1][1]);
+        free(word[0]);
+        free(word[1]);
     }
     return 0;
 }
 
-/* Its goal is to add all children to the current node, move the current node
- * pointer and recursively call itself.
- */
-int build_branch(const short wordnum, struct strie_pair *main_node)
+// Print the crosswords of the result, the best one first
+int print_result(const struct crossgen *gen, const struct crossgen_options *options, int objective)
 {
-    int j;
-    short  cur_word_num, checking_word_num;
-    struct strie_pair *cur_node = main_node;
-    struct strie_pair *tmp_node = NULL;
-    struct strie_pair *schild   = NULL;
-    struct strie_pair *latest_child = NULL;
-    short *cur_available_first_children = NULL;
-
-    while (main_node)
-    {
-        cur_available_first_children = (short *)calloc(wordnum, sizeof(short));
-        memcpy(cur_available_first_children, \
-                main_node->available_first_children, \
-                sizeof(short) * wordnum);
-
-        // cur_node  - the node, which participants we are trying to scan
-        // main_node - the node _to_ which we are trying to add these participants
-        cur_node = main_node;
-        while (cur_node)
-        {
-            for (cur_word_num = 0; cur_word_num < 2; cur_word_num++)
-            {
-                // The global index of the word to check
-                checking_word_num = cur_node->crossed_word[cur_word_num];
-                // We shouldn't allow to search previous words for pairs
-                if (checking_word_num < cur_node->procreator)
-                    break;
-
-                if (!(tmp_node = words[checking_word_num].firstchild))
-                    break;
-
-                for (j = 0; j < cur_available_first_children[checking_word_num]; j++)
-                    tmp_node = tmp_node->brother;
+    const struct crossgen_result *result = crossgen_result(gen);
+    int i;
 
-                while (tmp_node)
-                {
-                    cur_available_first_children[checking_word_num]++;
-                    if (NULL != (schild = check_pair(main_node, tmp_node)))
-                    {
-                        // Add new child to main_node
-                        schild->parent = main_node;
-                        schild->available_first_children = (short *)calloc(wordnum, sizeof(short));
-                        memcpy(schild->available_first_children, \
-                                cur_available_first_children, \
-                                sizeof(short) * wordnum);
-                        // Add child to the parent either as the first
-                        // child or add the brother to the latest child
-                        if (NULL == main_node->firstchild || NULL == latest_child)
-                        {
-                            main_node->firstchild = schild;
-                        }
-                        else
-                        {
-                            latest_child->brother = schild;
-                        }
-                        latest_child = schild;
-                        // Check whether it's better than current best_branch
-                        if (best_branch->depth < schild->depth)
-                            best_branch = schild;
-                    }
-                    tmp_node = tmp_node->brother;
-                }
-            }
-            cur_node = cur_node->parent;
+    for (i = 0; i < result->layoutnum; i++)
+    {
+        if (print_branch(gen, &result->layouts[i], i, result->layoutnum))
+            return 1;
+        if (options->max_width || options->max_height || options->max_ratio || result->layoutnum > 1 || objective)
+            printf("Crossword size:\t%d x %d\n", result->layouts[i].width, result->layouts[i].height);
+        if (objective)
+        {
+            printf("Words: %d, crossings: %d, letters: %d, score: %lld\n", result->layouts[i].words, \
+                    result->layouts[i].crossings, result->layouts[i].letters, result->layouts[i].score);
         }
+    }
+    return 0;
+}
 
-        if (cur_available_first_children)
-            free(cur_available_first_children);
+/*
+ * Read the weights of an objective: comma separated NAME[:WEIGHT], the
+ * weight is 1 if not given. Returns 1 if the objective is wrong.
+ */
+int parse_objective(const char *spec, int *weights)
+{
+    const char *name = spec, *end = NULL;
+    char *tail = NULL;
+    size_t len;
+    long weight;
+    int i;
 
-        // Go down or to the brother or to the first !NULL parent's brother
-        if (main_node->firstchild)
+    memset(weights, 0, CROSSGEN_SCORES * sizeof(int));
+    while (*name)
+    {
+        len = strcspn(name, ":,");
+        for (i = 0; i < CROSSGEN_SCORES; i++)
         {
-            main_node = main_node->firstchild;
+            if (strlen(crossgen_score_name(i)) == len && !strncmp(name, crossgen_score_name(i), len))
+                break;
         }
-        else if (main_node->brother)
+        if (i == CROSSGEN_SCORES)
+            return 1;
+        end = name + len;
+        weight = 1;
+        if (':' == *end)
         {
-            main_node = main_node->brother;
+            weight = strtol(end + 1, &tail, 10);
+            if (tail == end + 1 || weight < INT_MIN || weight > INT_MAX)
+                return 1;
+            end = tail;
         }
-        else if (main_node->parent)
+        if (*end && ',' != *end)
+            return 1;
+        weights[i] = (int)weight;
+        name = *end ? end + 1 : end;
+    }
+    for (i = 0; i < CROSSGEN_SCORES && !weights[i]; i++)
+        ;
+    return i == CROSSGEN_SCORES;
+}
+
+// Report every better crossword the beam or the random search finds
+void print_progress(int pairnum, double seconds, int width, void *arg)
+{
+    const struct crossgen_options *options = (const struct crossgen_options *)arg;
+
+    if (CROSSGEN_MODE_RANDOM == options->mode)
+        printf("Found %d crossed pairs in %.3f s, restart %d\n", pairnum, seconds, width);
+    else
+        printf("Found %d crossed pairs in %.3f s, beam width %d\n", pairnum, seconds, width);
+    fflush(stdout);
+}
+
+long total_rejects(const struct crossgen_stats *stats)
+{
+    long total = 0;
+    int i;
+
+    for (i = 1; i < CROSSGEN_REJECT_REASONS; i++)
+        total += stats->rejects[i];
+    return total;
+}
+
+// Print the statistics as 'bench <name> <value>' lines for bench.sh
+void print_bench(const struct crossgen_stats *stats, const int wordnum, double output_time, long peak_kb)
+{
+    int i;
+
+    printf("bench words %d\n", wordnum);
+    printf("bench pairs %d\n", stats->pairs);
+    printf("bench depth %d\n", stats->depth);
+    printf("bench nodes %ld\n", stats->nodes);
+    printf("bench restarts %ld\n", stats->restarts);
+    printf("bench rejected %ld\n", total_rejects(stats));
+    printf("bench build_pairs %.6f\n", stats->pairs_time);
+    for (i = 0; stats->root_time && i < wordnum; i++)
+        printf("bench build_branch.%d %.6f\n", i, stats->root_time[i]);
+    printf("bench search %.6f\n", stats->search_time);
+    printf("bench output %.6f\n", output_time);
+    printf("bench free %.6f\n", stats->free_time);
+    printf("bench nodes_per_sec %.0f\n", stats->search_time > 0 ? stats->nodes / stats->search_time : 0);
+    printf("bench peak_kb %ld\n", peak_kb);
+}
+
+// Print the statistics as a JSON object
+void print_json_stats(const struct crossgen_stats *stats, const int wordnum, double output_time, long peak_kb)
+{
+    int i, len;
+
+    printf("{\n");
+    printf("  \"words\": %d,\n", wordnum);
+    printf("  \"pairs\": %d,\n", stats->pairs);
+    printf("  \"depth\": %d,\n", stats->depth);
+    printf("  \"nodes\": %ld,\n", stats->nodes);
+    printf("  \"pruned\": %ld,\n", stats->pruned);
+    printf("  \"restarts\": %ld,\n", stats->restarts);
+    printf("  \"rejected\": {\n");
+    printf("    \"total\": %ld", total_rejects(stats));
+    for (i = 1; i < CROSSGEN_REJECT_REASONS; i++)
+        printf(",\n    \"%s\": %ld", crossgen_reject_name(i), stats->rejects[i]);
+    printf("\n  },\n");
+
+    // Trailing zeros are the unused part of the array
+    for (len = stats->depth_nodes_len; len > 0 && !stats->depth_nodes[len - 1]; len--)
+        ;
+    printf("  \"depth_nodes\": [");
+    for (i = 0; i < len; i++)
+        printf("%s%ld", i ? ", " : "", stats->depth_nodes[i]);
+    printf("],\n");
+
+    printf("  \"time\": {\n");
+    printf("    \"build_pairs\": %.6f,\n", stats->pairs_time);
+    printf("    \"search\": %.6f,\n", stats->search_time);
+    printf("    \"roots\": [");
+    for (i = 0; stats->root_time && i < wordnum; i++)
+        printf("%s%.6f", i ? ", " : "", stats->root_time[i]);
+    printf("],\n");
+    printf("    \"output\": %.6f,\n", output_time);
+    printf("    \"free\": %.6f\n", stats->free_time);
+    printf("  },\n");
+    printf("  \"nodes_per_sec\": %.0f,\n", stats->search_time > 0 ? stats->nodes / stats->search_time : 0);
+    printf("  \"peak_kb\": %ld\n", peak_kb);
+    printf("}\n");
+}
+
+/*
+ * Take the words of a JSON array of strings, e.g. ["cat", "coin"]. The
+ * strings are unescaped in place. Returns -1 if the line is not an array
+ * of strings, -2 if a word has wrong letters.
+ */
+int load_json_set(struct crossgen *gen, char *line)
+{
+    char *p = line, *word = NULL, *end = NULL;
+    unsigned code;
+    int n, ret;
+
+    crossgen_clear_words(gen);
+    while (isspace((unsigned char)*p))
+        p++;
+    if ('[' != *p++)
+        return -1;
+    while (isspace((unsigned char)*p))
+        p++;
+    if (']' == *p)
+        p++;
+    while (p[-1] != ']')
+    {
+        while (isspace((unsigned char)*p))
+            p++;
+        if ('"' != *p++)
+            return -1;
+        for (word = end = p; '"' != *p; p++)
         {
-            // Find first parent's brother != NULL
-            tmp_node = main_node->parent;
-            while (tmp_node && !tmp_node->brother)
-                tmp_node = tmp_node->parent;
-            if (tmp_node)
+            if (!*p || (unsigned char)*p < 0x20)
+                return -1;
+            if ('\\' != *p)
             {
-                main_node = tmp_node->brother;
+                *end++ = *p;
+                continue;
             }
-            else
+            switch (*++p)
             {
-                // We've processed all tree for one crossword word
-                return 0;
+                case '"': case '\\': case '/':
+                    *end++ = *p;
+                    break;
+                case 'b': *end++ = '\b'; break;
+                case 'f': *end++ = '\f'; break;
+                case 'n': *end++ = '\n'; break;
+                case 'r': *end++ = '\r'; break;
+                case 't': *end++ = '\t'; break;
+                case 'u':
+                    // A letter of the Basic Multilingual Plane, written in UTF-8
+                    if (1 != sscanf(p + 1, "%4x%n", &code, &n) || 4 != n || !code || \
+                            (code >= 0xD800 && code <= 0xDFFF))
+                        return -1;
+                    if (code < 0x80)
+                        *end++ = code;
+                    else if (code < 0x800)
+                    {
+                        *end++ = 0xC0 | code >> 6;
+                        *end++ = 0x80 | (code & 0x3F);
+                    }
+                    else
+                    {
+                        *end++ = 0xE0 | code >> 12;
+                        *end++ = 0x80 | (code >> 6 & 0x3F);
+                        *end++ = 0x80 | (code & 0x3F);
+                    }
+                    p += 4;
+                    break;
+                default:
+                    return -1;
             }
         }
-        else
-        {
-            // We've processed all tree for one crossword word
-            return 0;
-        }
+        p++;
+        if ((ret = crossgen_add_word(gen, word, end - word)))
+            return ret < 0 ? -2 : 1;
+        while (isspace((unsigned char)*p))
+            p++;
+        if (',' != *p && ']' != *p)
+            return -1;
+        p++;
     }
-    // This code is reached only when all pairs for the word have been
-    // processed
-    return 0;
+    while (isspace((unsigned char)*p))
+        p++;
+    return *p ? -1 : 0;
 }
 
-struct strie_pair *check_pair(struct strie_pair *main_node, struct strie_pair *check_node)
+// Print the pairs of a crossword as a JSON array
+void print_json_pairs(const struct crossgen_pair *pairs, int pairnum)
 {
-    struct strie_pair *cur_node = main_node;
-    struct strie_pair *schild = NULL;
-    struct strie_pair *tmp_node = NULL;
-    short i, j, dist, found;
-
-    // First we need to check whether the same pair already exists in one of
-    // main_node's children
-    for (cur_node = main_node->firstchild; cur_node; cur_node = cur_node->brother)
-    {
-        if ((cur_node->crossed_word[0] == check_node->crossed_word[0]) && \
-            (cur_node->crossed_word[1] == check_node->crossed_word[1]) && \
-            (cur_node->crossed_word_letter[0] == check_node->crossed_word_letter[0]) && \
-            (cur_node->crossed_word_letter[1] == check_node->crossed_word_letter[1]))
-        {
-            return NULL;
-        }
-    }
-    // Now check whether it's the same as one of top node's elder brothers
-    // Note, that this check is not necessary - its removal will not lead to
-    // great 'wrong' branch growth. If the current branch is wrong, it won't
-    // last long after adding one of top node's elder brothers. So this check
-    // may be removed if it wastes too much time.
-    cur_node = main_node;
-    while (cur_node->parent)
-        cur_node = cur_node->parent;
-    if ((cur_node->crossed_word[0] == check_node->crossed_word[0]) && \
-            (cur_node->crossed_word[1] >= check_node->crossed_word[1]))
+    const struct crossgen_pair *pair = NULL;
+    int k;
+
+    printf("[");
+    for (k = 0; k < pairnum; k++)
     {
-        return NULL;
+        pair = &pairs[k];
+        printf("%s{\"words\": [%d, %d], \"letters\": [%d, %d], " \
+                "\"orient\": [\"%s\", \"%s\"], \"coords\": [[%d, %d], [%d, %d]]}", \
+                k ? ", " : "", \
+                pair->word[0], pair->word[1], \
+                pair->letter[0], pair->letter[1], \
+                pair->orient[0] == 1 ? "hor" : "ver", \
+                pair->orient[1] == 1 ? "hor" : "ver", \
+                pair->coord[0][0], pair->coord[0][1], \
+                pair->coord[1][0], pair->coord[1][1]);
     }
-    // Check whether it's the same as one of main_node's or any its parent's
-    // elder brothers
-    for (cur_node = main_node; cur_node; cur_node = cur_node->parent)
+    printf("]");
+}
+
+/*
+ * Print the crossword of a word set as one JSON line. The other crosswords
+ * kept, if any, follow the best one in "layouts".
+ */
+void print_record(int set, const struct crossgen *gen)
+{
+    const struct crossgen_result *result = crossgen_result(gen);
+    const struct crossgen_stats *stats = crossgen_stats(gen);
+    const struct crossgen_layout *layout = NULL;
+    int k;
+
+    printf("{\"set\": %d, \"words\": %d, \"crossed\": %d, \"width\": %d, \"height\": %d, " \
+            "\"nodes\": %ld, \"search\": %.6f, \"timed_out\": %s, \"pairs\": ", \
+            set, crossgen_word_count(gen), result->pairnum, result->width, result->height, \
+            stats->nodes, stats->search_time, result->timed_out ? "true" : "false");
+    print_json_pairs(result->pairs, result->pairnum);
+    if (result->layoutnum > 1)
     {
-        if (cur_node->parent)
+        printf(", \"layouts\": [");
+        for (k = 0; k < result->layoutnum; k++)
         {
-            for (tmp_node = cur_node->parent->firstchild; \
-                    tmp_node != cur_node; \
-                    tmp_node = tmp_node->brother)
-            {
-                if ((tmp_node->crossed_word[0] == check_node->crossed_word[0]) && \
-                        (tmp_node->crossed_word[1] == check_node->crossed_word[1]) && \
-                        (tmp_node->crossed_word_letter[0] == check_node->crossed_word_letter[0]) && \
-                        (tmp_node->crossed_word_letter[1] == check_node->crossed_word_letter[1]))
-                {
-                    return NULL;
-                }
-            }
+            layout = &result->layouts[k];
+            printf("%s{\"crossed\": %d, \"width\": %d, \"height\": %d, \"pairs\": ", \
+                    k ? ", " : "", layout->pairnum, layout->width, layout->height);
+            print_json_pairs(layout->pairs, layout->pairnum);
+            printf("}");
         }
+        printf("]");
     }
+    printf("}\n");
+}
+
+/*
+ * Generate a crossword for every word set of the input and print one
+ * record per set. The generator and its memory are the same for all the
+ * sets. A set that can't be read gets an error record, the next sets are
+ * still generated.
+ */
+int run_batch(struct crossgen *gen, FILE *input, int format)
+{
+    char   *line = NULL;
+    size_t  linesize = 0;
+    ssize_t len;
+    int set = 0, ret = 0, words = 0, skip = 0, last = 0;
 
-    // Check current main node and all its parents
-    for (cur_node = main_node; cur_node; cur_node = cur_node->parent)
+    crossgen_clear_words(gen);
+    while (!ret && !last)
     {
-        // There can be only one pair of certain words. I.e. word 'i' cann't
-        // cross the word 'j' in two places.
-        if (((cur_node->crossed_word[0] == check_node->crossed_word[0]) && \
-            (cur_node->crossed_word[1] == check_node->crossed_word[1])) || \
-            (check_node->crossed_word[0] < cur_node->procreator) || \
-            (check_node->crossed_word[1] < cur_node->procreator))
+        if (-1 == (len = getline(&line, &linesize, input)))
         {
-            if (schild)
-            {
-                free(schild);
-                schild = NULL;
-            }
-            return schild;
+            last = 1;
+            len = 0;
         }
-        // Find same word in two pairs
-        found = 0;
-        for (i = 0; i < 2 && !found; i++)
+        while (len > 0 && isspace((unsigned char)line[len - 1]))
+            len--;
+
+        if (BATCH_JSON == format)
         {
-            for (j = 0; j < 2 && !found; j++)
+            if (!len)
+                continue;
+            line[len] = '\0';
+            if ((ret = load_json_set(gen, line)) < 0)
             {
-                if (cur_node->crossed_word[i] == check_node->crossed_word[j])
-                {
-                    if (!schild)
-                    {
-                        short dx, dy, tmp;
-                        // allocate new child
-                        schild = (struct strie_pair*)calloc(1, sizeof(struct strie_pair));
-                        memcpy(schild, check_node, sizeof(struct strie_pair));
-                        schild->depth = main_node->depth + 1;
-                        schild->procreator = main_node->procreator;
-                        schild->brother = NULL; // because it's the brother of the original pair
-                        if (schild->word_orient[j] != cur_node->word_orient[i])
-                        {
-                            tmp = schild->word_coord[j][0];
-                            schild->word_coord[j][0] = -schild->word_coord[j][1];
-                            schild->word_coord[j][1] = -tmp;
-                            tmp = schild->word_coord[(j - 1) * (j - 1)][0];
-                            schild->word_coord[(j - 1) * (j - 1)][0] = -schild->word_coord[(j - 1) * (j - 1)][1];
-                            schild->word_coord[(j - 1) * (j - 1)][1] = -tmp;
-                        }
-                        schild->word_orient[j] = cur_node->word_orient[i];
-                        schild->word_orient[(j - 1) * (j - 1)] = -(schild->word_orient[j]);
-                        dx = cur_node->word_coord[i][0] - schild->word_coord[j][0] ;
-                        dy = cur_node->word_coord[i][1] - schild->word_coord[j][1] ;
-                        schild->word_coord[0][0] += dx;
-                        schild->word_coord[0][1] += dy;
-                        schild->word_coord[1][0] += dx;
-                        schild->word_coord[1][1] += dy;
-                    }
-                    // schild now exists, we need to verify orientation and MINDISTANCE
-                    dist = cur_node->crossed_word_letter[i] - check_node->crossed_word_letter[j];
-                    dist = dist < 0 ? -dist : dist;
-                    if ((dist < MINDISTANCE) || (cur_node->word_orient[i] != schild->word_orient[j]))
-                    {
-                        free(schild);
-                        schild = NULL;
-                        return schild;
-                    }
-                    found = 1;
-                }
+                printf("{\"set\": %d, \"error\": \"%s\"}\n", set++, -1 == ret ? \
+                        "not a JSON array of strings" : "wrong letters in a word");
+                ret = 0;
+                continue;
             }
         }
-    }
-
-    // Detect whether our newly added word crosses other words in 'wrong' letters
-    if (schild)
-    {
-        for (cur_node = main_node; cur_node; cur_node = cur_node->parent)
+        else if (len)
         {
-            for (i = 0; i < 2; i++)
+            // The rest of a set with a wrong word is skipped
+            if (!skip && (ret = crossgen_add_word(gen, line, len)) < 0)
             {
-                for (j = 0; j < 2; j++)
-                {
-                    short xa = cur_node->word_coord[i][0];
-                    short ya = cur_node->word_coord[i][1];
-                    short la = words[cur_node->crossed_word[i]].wordlen;
-                    short xb = schild->word_coord[j][0];
-                    short yb = schild->word_coord[j][1];
-                    short lb = words[schild->crossed_word[j]].wordlen;
-                    // If the new word is already in the crossword, its
-                    // position should be the same
-                    if (cur_node->crossed_word[i] == schild->crossed_word[j])
-                    {
-                        if ((cur_node->word_orient[i] != schild->word_orient[j]) || \
-                                (xa != xb) || (ya != yb))
-                        {
-                            free(schild);
-                            schild = NULL;
-                            return schild;
-                        }
-                    }
-                    else
-                    {
-                        // Check intersection based on orientation
-                        if (1 == cur_node->word_orient[i])
-                        {
-                            if (1 == schild->word_orient[j])
-                            {
-                                // Both horizontal - they should have no intersections
-                                dist = ya - yb;
-                                dist = dist < 0 ? -dist : dist;
-                                if (!((dist >= MINDISTANCE) || \
-                                            (xb >= xa + la - 1 + MINDISTANCE) || \
-                                            (xa >= xb + lb - 1 + MINDISTANCE)))
-                                {
-                                    free(schild);
-                                    schild = NULL;
-                                    return schild;
-                                }
-                            }
-                            else
-                            {
-                                // The word in the crossword (a) - horizontal,
-                                // the new word (b) - vertical
-                                if (!((xa >= xb + MINDISTANCE) || \
-                                        (xb >= xa + la - 1 + MINDISTANCE) || \
-                                        (ya >= yb + MINDISTANCE) || \
-                                        (ya <= yb - lb + 1 - MINDISTANCE)))
-                                {
-                                    // Determine the letter position in each word
-                                    short apos = xb - xa;
-                                    short bpos = yb - ya;
-                                    if ((apos >= la) || (bpos >= lb) || \
-                                            (words[cur_node->crossed_word[i]].word[apos] != words[schild->crossed_word[j]].word[bpos]))
-                                    {
-                                        free(schild);
-                                        schild = NULL;
-                                        return schild;
-                                    }
-                                }
-                            }
-                        }
-                        else
-                        {
-                            if (1 == schild->word_orient[j])
-                            {
-                                // Original (a) - vertical
-                                // New (b) - horizontal
-                                if (!((xb >= xa + MINDISTANCE) || \
-                                            (xa >= xb + lb -1 + MINDISTANCE) || \
-                                            (yb >= ya + MINDISTANCE) || \
-                                            (yb <= ya - la + 1 - MINDISTANCE)))
-                                {
-                                    // Determine the letter position in each word
-                                    short bpos = xa - xb;
-                                    short apos = ya - yb;
-                                    if ((apos >= la) || (bpos >= lb) || \
-                                            (words[cur_node->crossed_word[i]].word[apos] != words[schild->crossed_word[j]].word[bpos]))
-                                    {
-                                        free(schild);
-                                        schild = NULL;
-                                        return schild;
-                                    }
-                                }
-                            }
-                            else
-                            {
-                                // Both are vertical - there should be no intersections
-                                dist = xa - xb;
-                                dist = dist < 0 ? -dist : dist;
-                                if (!((dist >= MINDISTANCE) || \
-                                            (yb <= ya - la + 1 - MINDISTANCE) || \
-                                            (ya <= yb - lb + 1 - MINDISTANCE)))
-                                {
-                                    free(schild);
-                                    schild = NULL;
-                                    return schild;
-                                }
-                            }
-                        }
-                        // If we reach this code, it means that 'i' and 'j'
-                        // words cross. Should detect whether this crossing is
-                        // legal, i.e. crossed letter is the same in both words
-                    }
-                }
+                printf("{\"set\": %d, \"error\": \"wrong letters in a word\"}\n", set++);
+                crossgen_clear_words(gen);
+                skip = 1;
+                ret = 0;
             }
+            words = !skip;
+            continue;
+        }
+        else if (!words)
+        {
+            skip = 0;
+            continue;
         }
-    }
 
-    return schild;
+        if (!ret && !(ret = crossgen_run(gen)))
+            print_record(set++, gen);
+        crossgen_clear_words(gen);
+        words = 0;
+    }
+    free(line);
+    return ret;
 }
 
-int print_strie(struct strie_pair *node)
+/*
+ * Read a template, one row per line, all the rows are of the same length:
+ * '#' - black square, '.' - empty cell, any other UTF-8 letter is given.
+ * The cells are the codes of crossgen_fill_run(), the new letters get
+ * their codes from the generator. Returns NULL if the template is wrong or
+ * there's not enough memory.
+ */
+unsigned char *load_template(struct crossgen *gen, FILE *input, int *width, int *height)
 {
-    int i;
-    struct strie_pair *tmp_node = NULL;
+    char   *line = NULL;
+    unsigned char *cells = NULL, *tmp = NULL;
+    size_t  linesize = 0, size = 0, need;
+    ssize_t len;
+    int     i, n, code, num;
 
-    if (!node)
-        return 0;
-
-    printf("Crossed words: %d, %d\n", node->crossed_word[0], node->crossed_word[1]);
-    printf("Crossed words letters: %d, %d\n", node->crossed_word_letter[0], node->crossed_word_letter[1]);
-    printf("Orient: %d, %d\n", node->word_orient[0], node->word_orient[1]);
-    printf("Depth: %d\n", node->depth);
-    printf("Word coords: [%d, %d]; [%d, %d]\n", node->word_coord[0][0], node->word_coord[0][1], node->word_coord[1][0], node->word_coord[1][1]);
-
-    // Go down or to the brother or to the first !NULL parent's brother
-    if (node->firstchild)
-    {
-        printf("\nCHILD:\n");
-        print_strie(node->firstchild);
-    }
-    else if (node->brother)
-    {
-        printf("\nBROTHER:\n");
-        print_strie(node->brother);
-    }
-    else if (node->parent)
+    *width = *height = 0;
+    while (-1 != (len = getline(&line, &linesize, input)))
     {
-        // Find first parent's brother != NULL
-        tmp_node = node->parent;
-        i = 1;
-        while (tmp_node && !tmp_node->brother)
+        while (len > 0 && isspace((unsigned char)line[len - 1]))
+            len--;
+        if (!len)
+            continue;
+        // A row has at most 'len' cells, a letter may take several bytes
+        need = (size_t)(*height + 1) * (len > *width ? len : *width);
+        if (need > size)
         {
-            tmp_node = tmp_node->parent;
-            i++;
+            size = need * 2;
+            if (!(tmp = (unsigned char *)realloc(cells, size)))
+            {
+                fprintf(stderr, "Not enough memory!\n");
+                goto fail;
+            }
+            cells = tmp;
         }
-        if (tmp_node)
+        for (i = 0, num = 0; i < len; i += n, num++)
         {
-            printf("\nPARENT #%d BROTHER:\n", i);
-            print_strie(tmp_node->brother);
+            n = 1;
+            if ('#' == line[i])
+                code = CROSSGEN_FILL_BLACK;
+            else if ('.' == line[i])
+                code = CROSSGEN_FILL_EMPTY;
+            else if (!(n = crossgen_letter_code(gen, line + i, len - i, &code)))
+            {
+                fprintf(stderr, "Wrong template cell in row %d: %.*s\n", *height + 1, (int)len, line);
+                goto fail;
+            }
+            if (!*height || num < *width)
+                cells[(size_t)*height * *width + num] = code;
         }
-        else
+        if (*height && num != *width)
         {
-            // We've processed all tree for one crossword word
-            return 0;
+            fprintf(stderr, "Template rows must be of the same length\n");
+            goto fail;
         }
+        *width = num;
+        (*height)++;
+    }
+    if (!*height)
+    {
+        fprintf(stderr, "The template is empty\n");
+        goto fail;
     }
+    free(line);
+    return cells;
 
-    return 0;
+fail:
+    free(line);
+    free(cells);
+    return NULL;
 }
 
-// Print the branch from the current node to the root
-int print_branch(struct strie_pair *node)
+// Print the filled template and its words, across and down ones
+void print_fill(const struct crossgen *gen, const struct crossgen_fill_result *result)
 {
-    int i, index;
-    struct strie_pair *cur_node = node;
+    const struct crossgen_slot *slot = NULL;
+    int row, col, s, number, orient, cell;
 
-    if (!node)
-        return 0;
-
-    printf("\nGenerated crossword puzzle:\n--------------------------------\n");
-    while (cur_node)
+    printf("\nTemplate %d x %d, %d slots", result->width, result->height, result->slotnum);
+    if (result->filled)
+        printf(", filled in %.3f s\n", result->search_time);
+    else if (result->timed_out)
+        printf(", time is out, the fullest fill found:\n");
+    else
+        printf(", can't be filled, the fullest fill found:\n");
+    printf("--------------------------------\n");
+    for (row = 0; row < result->height; row++)
     {
-        // Mark intersection letters uppercase
-        for (i = 0; i < 2; i++)
+        for (col = 0; col < result->width; col++)
         {
-            index = cur_node->crossed_word_letter[i];
-            words[cur_node->crossed_word[i]].word[index] = \
-                toupper(words[cur_node->crossed_word[i]].word[index]);
+            cell = result->cells[row * result->width + col];
+            fputs(CROSSGEN_FILL_BLACK == cell ? "#" : CROSSGEN_FILL_EMPTY == cell ? "." : \
+                    crossgen_letter(gen, cell, 0), stdout);
         }
-        printf("Crossed words:\t%d, %s\t-\t%d, %s\n", \
-                cur_node->crossed_word[0], \
-                words[cur_node->crossed_word[0]].word, \
-                cur_node->crossed_word[1], \
-                words[cur_node->crossed_word[1]].word);
-        printf("Letters:\t%d\t%d\n", \
-                cur_node->crossed_word_letter[0], \
-                cur_node->crossed_word_letter[1]);
-        printf("Orient:\t\t%s\t%s\n", \
-                cur_node->word_orient[0] == 1 ? "hor" : "ver", \
-                cur_node->word_orient[1] == 1 ? "hor" : "ver" );
-        printf("Word coords:\t[%d, %d]\t[%d, %d]\n\n", \
-                cur_node->word_coord[0][0], \
-                cur_node->word_coord[0][1], \
-                cur_node->word_coord[1][0], \
-                cur_node->word_coord[1][1]);
+        printf("\n");
+    }
 
-        // Mark intersection letters lowercase back
-        for (i = 0; i < 2; i++)
+    // Slots that start in the same cell share the number
+    for (orient = 1; orient >= -1; orient -= 2)
+    {
+        printf("\n%s:\n", 1 == orient ? "Across" : "Down");
+        for (s = 0, number = 0; s < result->slotnum; s++)
         {
-            index = cur_node->crossed_word_letter[i];
-            words[cur_node->crossed_word[i]].word[index] = \
-                tolower(words[cur_node->crossed_word[i]].word[index]);
+            slot = &result->slots[s];
+            if (!s || slot->row != slot[-1].row || slot->col != slot[-1].col)
+                number++;
+            if (slot->orient != orient)
+                continue;
+            printf("%3d [%d, %d]\t%s\n", number, slot->row, slot->col, \
+                    -1 == slot->word ? "-" : crossgen_word(gen, slot->word));
         }
+    }
+    printf("\nWords tried: %ld, taken back: %ld, restarts: %ld\n", result->nodes, result->backtracks, \
+            result->restarts);
+}
+
+/*
+ * Fill the template of the file with the words of the generator
+ */
+int run_fill(struct crossgen *gen, const char *path, double deadline, int bench_output)
+{
+    struct crossgen_fill *fill = NULL;
+    const struct crossgen_fill_result *result = NULL;
+    struct rusage resources;
+    FILE *ftemplate = NULL;
+    unsigned char *cells = NULL;
+    int width, height;
+
+    if (!(ftemplate = fopen(path, "r")))
+    {
+        fprintf(stderr, "Can't open %s\n", path);
+        return 1;
+    }
+    cells = load_template(gen, ftemplate, &width, &height);
+    fclose(ftemplate);
+    if (!cells)
+        return 1;
+    if (!(fill = crossgen_fill_new(gen)) || crossgen_fill_run(fill, cells, width, height, deadline))
+    {
+        free(cells);
+        crossgen_fill_free(fill);
+        return 1;
+    }
+    result = crossgen_fill_result(fill);
+    print_fill(gen, result);
 
-        cur_node = cur_node->parent;
+    if (bench_output)
+    {
+        getrusage(RUSAGE_SELF, &resources);
+        printf("bench words %d\n", crossgen_word_count(gen));
+        printf("bench slots %d\n", result->slotnum);
+        printf("bench filled %d\n", result->filled);
+        printf("bench nodes %ld\n", result->nodes);
+        printf("bench backtracks %ld\n", result->backtracks);
+        printf("bench restarts %ld\n", result->restarts);
+        printf("bench index %.6f\n", result->index_time);
+        printf("bench search %.6f\n", result->search_time);
+        printf("bench peak_kb %ld\n", resources.ru_maxrss);
     }
+    free(cells);
+    crossgen_fill_free(fill);
     return 0;
 }
 
-// Free the allocated memory
-int clear_branch(struct strie_pair *node)
+/*
+ * Change the words by the edits of the standard input, one per line: +WORD
+ * adds the word, -WORD removes it, '!' searches the best crossword anew.
+ * The crossword is brought up to date and printed after every edit.
+ */
+int run_edit(struct crossgen *gen, const struct crossgen_options *options, int objective)
 {
-    struct strie_pair *cur_node = node;
-    struct strie_pair *next_node = NULL;
-
-    if (!node)
-        return 0;
+    char   *line = NULL;
+    size_t  linesize = 0;
+    ssize_t len;
+    struct timespec start;
+    int i, ret = 0;
 
-    while (cur_node)
+    while (!ret && -1 != (len = getline(&line, &linesize, stdin)))
     {
-        while (cur_node->firstchild)
-            cur_node = cur_node->firstchild;
+        while (len > 0 && ('\n' == line[len - 1] || '\r' == line[len - 1]))
+            line[--len] = '\0';
+        if (!len)
+            continue;
 
-        if (!(next_node = cur_node->brother))
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if ('+' == line[0] && len > 1)
         {
-            next_node = cur_node->parent;
-            // If we are not in the root children...
-            if (next_node)
+            ret = crossgen_add_word(gen, line + 1, len - 1) || crossgen_update(gen);
+        }
+        else if ('-' == line[0] && len > 1)
+        {
+            if (-1 == (i = crossgen_find_word(gen, line + 1, len - 1)))
             {
-                // ...set parent's firstchild to NULL not to process
-                // already freed child
-                next_node->firstchild = NULL;
+                fprintf(stderr, "No word %s\n", line + 1);
+                continue;
             }
+            ret = crossgen_remove_word(gen, i) || crossgen_update(gen);
         }
+        else if (!strcmp(line, "!"))
+        {
+            ret = crossgen_run(gen);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown edit: %s\n", line);
+            continue;
+        }
+        if (ret)
+            break;
 
-        if (cur_node->available_first_children)
-            free(cur_node->available_first_children);
-        free(cur_node);
-
-        cur_node = next_node;
+        printf("\nEdit %s: %d words, done in %.3f ms\n", line, crossgen_word_count(gen), \
+                seconds_since(&start) * 1e3);
+        if (crossgen_result(gen)->timed_out)
+            printf("Time is out, the crossword may be not the best one\n");
+        ret = print_result(gen, options, objective);
     }
+    free(line);
+    return ret;
+}
 
-    return 0;
+int usage(const char *name)
+{
+    printf("Usage: %s [options] <file with a list of words>\n", name);
+    printf("       %s --batch=FMT [options] [file with word sets]\n", name);
+    printf("       %s --template=FILE [options] <file with a list of words>\n", name);
+    printf("       %s --edit [options] <file with a list of words>\n", name);
+    printf("       %s --cache=FILE [options]\n", name);
+    printf("\nOptions:\n");
+    printf("  -m, --mode=MODE   search mode:\n");
+    printf("                      full   - keep the whole strie in memory (default)\n");
+    printf("                      stream - keep only the current and the best branch\n");
+    printf("                      beam   - expand only the most promising nodes, widen\n");
+    printf("                               the beam until the search is exhaustive or\n");
+    printf("                               the deadline passes\n");
+    printf("                      random - randomized greedy rollouts on all the\n");
+    printf("                               threads until the restarts are done or\n");
+    printf("                               the deadline passes\n");
+    printf("  -j, --jobs=N      search on N threads (default 1)\n");
+    printf("  -b, --bound       skip the subtrees that can't be better than the best\n");
+    printf("                    branch found so far\n");
+    printf("  -w, --width=N     nodes of every level the first beam pass expands\n");
+    printf("                    (default 64)\n");
+    printf("  -d, --deadline=S  stop the beam or random search or the template fill\n");
+    printf("                    after S seconds\n");
+    printf("  -g, --seed=N      seed of the random search (default 0)\n");
+    printf("  -R, --restarts=N  rollouts of the random search (default 100, or till\n");
+    printf("                    the deadline if there is one)\n");
+    printf("  -W, --max-width=N\n");
+    printf("  -H, --max-height=N\n");
+    printf("                    the crossword must fit into a box N letters wide and\n");
+    printf("                    N letters high, as it is or turned by 90 degrees\n");
+    printf("  -r, --ratio=R     the longer side of the crossword is at most R times\n");
+    printf("                    the shorter one\n");
+    printf("  -k, --top=K       keep the K best crosswords and print them all, the\n");
+    printf("                    ones with more crossed pairs first, then the smaller\n");
+    printf("                    ones; the same crossword is printed once\n");
+    printf("  -o, --objective=SPEC\n");
+    printf("                    what makes a crossword better: comma separated\n");
+    printf("                    NAME[:WEIGHT], the highest sum of the weighted values\n");
+    printf("                    wins (default pairs); names: pairs, words, crossings,\n");
+    printf("                    letters, area, density (letters per 1000 cells of the\n");
+    printf("                    box), e.g. words:2,area:-1\n");
+    printf("  -p, --pairs-only  only build the pairs of the words and print their\n");
+    printf("                    number, with -B their time\n");
+    printf("  -B, --bench       print the phase times, node counts and peak memory\n");
+    printf("                    as 'bench <name> <value>' lines\n");
+    printf("  -s, --stats=json  print the search statistics in JSON at the end: pairs\n");
+    printf("                    rejected for every reason, nodes at every depth,\n");
+    printf("                    phase times and peak memory\n");
+    printf("  -a, --batch=FMT   generate a crossword for every word set of the file or\n");
+    printf("                    the standard input and print one JSON line per set:\n");
+    printf("                      lines - one word per line, the sets are separated\n");
+    printf("                              by blank lines\n");
+    printf("                      json  - one JSON array of words per line\n");
+    printf("  -T, --template=FILE\n");
+    printf("                    fill the template of the file with the words, one row\n");
+    printf("                    per line: '#' - black square, '.' - empty cell, a\n");
+    printf("                    letter - the letter given\n");
+    printf("  -e, --edit        after the crossword is printed, read edits from the\n");
+    printf("                    standard input, one per line: +WORD adds the word,\n");
+    printf("                    -WORD removes it, '!' searches anew; the crossword is\n");
+    printf("                    brought up to date and printed after every edit\n");
+    printf("  -c, --cache=FILE  take the words from the cache file made by paircache\n");
+    printf("                    instead of a list of words, the pairs are built from\n");
+    printf("                    its letter index\n");
+    printf("  -n, --words=N     take only the first N words of the cache\n");
+    printf("  -x, --export=FILE write the searched strie to the file, 'striedump'\n");
+    printf("                    converts it to DOT or JSON; the full search on one\n");
+    printf("                    thread only\n");
+    printf("  -D, --export-depth=N\n");
+    printf("                    export only the nodes up to depth N\n");
+    printf("  -S, --export-sample=N\n");
+    printf("                    export only the subtrees of every N-th root\n");
+    printf("  -C, --keep-case   tell upper and lower case letters apart\n");
+    printf("  -M, --fold-marks  take the letters with diacritics as their base\n");
+    printf("                    letters, e.g. 'é' as 'e'\n");
+    printf("  -L, --fold-letters=PAIRS\n");
+    printf("                    take the first letter of every pair as the second\n");
+    printf("                    one, e.g. 'ёе'\n");
+    printf("  -h, --help        show this help\n");
+    return 1;
 }
 
 int main(int argc, char **argv)
 {
-    int i, j, wordnum = 0;
+    int i, opt, wordnum = 0, bench_output = 0, stats_format = STATS_NONE, batch = BATCH_NONE, objective = 0;
+    int edit = 0, cache_words = 0, pairs_only = 0;
+    const char *export = NULL;
+    double output_time;
+    struct timespec phase_start;
+    struct rusage resources;
+    struct crossgen_options options;
+    struct crossgen *gen = NULL;
+    const struct crossgen_result *result = NULL;
+    const struct crossgen_stats *stats = NULL;
     FILE *fwords = NULL;
+    const char *template = NULL;
+    const char *cache = NULL;
+    static struct option long_options[] = {
+        {"mode", required_argument, NULL, 'm'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"bound", no_argument,      NULL, 'b'},
+        {"width", required_argument, NULL, 'w'},
+        {"deadline", required_argument, NULL, 'd'},
+        {"seed", required_argument, NULL, 'g'},
+        {"restarts", required_argument, NULL, 'R'},
+        {"max-width", required_argument, NULL, 'W'},
+        {"max-height", required_argument, NULL, 'H'},
+        {"ratio", required_argument, NULL, 'r'},
+        {"top", required_argument,  NULL, 'k'},
+        {"objective", required_argument, NULL, 'o'},
+        {"pairs-only", no_argument, NULL, 'p'},
+        {"bench", no_argument,      NULL, 'B'},
+        {"stats", required_argument, NULL, 's'},
+        {"batch", required_argument, NULL, 'a'},
+        {"template", required_argument, NULL, 'T'},
+        {"edit", no_argument,       NULL, 'e'},
+        {"cache", required_argument, NULL, 'c'},
+        {"words", required_argument, NULL, 'n'},
+        {"export", required_argument, NULL, 'x'},
+        {"export-depth", required_argument, NULL, 'D'},
+        {"export-sample", required_argument, NULL, 'S'},
+        {"keep-case", no_argument,  NULL, 'C'},
+        {"fold-marks", no_argument, NULL, 'M'},
+        {"fold-letters", required_argument, NULL, 'L'},
+        {"help", no_argument,       NULL, 'h'},
+        {NULL,   0,                 NULL, 0}
+    };
+
+    crossgen_default_options(&options);
+    options.progress = print_progress;
+    options.progress_arg = &options;
+    while (-1 != (opt = getopt_long(argc, argv, "m:j:bw:d:g:R:W:H:r:k:o:pBs:a:T:ec:n:x:D:S:CML:h", long_options, NULL)))
+    {
+        switch (opt)
+        {
+            case 'm':
+                if (!strcmp(optarg, "full"))
+                    options.mode = CROSSGEN_MODE_FULL;
+                else if (!strcmp(optarg, "stream"))
+                    options.mode = CROSSGEN_MODE_STREAM;
+                else if (!strcmp(optarg, "beam"))
+                    options.mode = CROSSGEN_MODE_BEAM;
+                else if (!strcmp(optarg, "random"))
+                    options.mode = CROSSGEN_MODE_RANDOM;
+                else
+                {
+                    fprintf(stderr, "Unknown search mode: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'j':
+                if ((options.threads = atoi(optarg)) < 1)
+                {
+                    fprintf(stderr, "Wrong number of threads: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'b':
+                options.bound = 1;
+                break;
+            case 'w':
+                if ((options.beam_width = atoi(optarg)) < 1)
+                {
+                    fprintf(stderr, "Wrong beam width: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'd':
+                if ((options.deadline = atof(optarg)) <= 0)
+                {
+                    fprintf(stderr, "Wrong deadline: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'g':
+                options.seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'R':
+                if ((options.restarts = atol(optarg)) < 1)
+                {
+                    fprintf(stderr, "Wrong number of restarts: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'W':
+                if ((options.max_width = atoi(optarg)) < 1)
+                {
+                    fprintf(stderr, "Wrong maximum width: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'H':
+                if ((options.max_height = atoi(optarg)) < 1)
+                {
+                    fprintf(stderr, "Wrong maximum height: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'r':
+                if ((options.max_ratio = atof(optarg)) < 1)
+                {
+                    fprintf(stderr, "Wrong aspect ratio: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'k':
+                if ((options.top = atoi(optarg)) < 1)
+                {
+                    fprintf(stderr, "Wrong number of crosswords: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'o':
+                if (parse_objective(optarg, options.weights))
+                {
+                    fprintf(stderr, "Wrong objective: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                objective = 1;
+                break;
+            case 'p':
+                pairs_only = 1;
+                break;
+            case 'B':
+                bench_output = 1;
+                break;
+            case 's':
+                if (strcmp(optarg, "json"))
+                {
+                    fprintf(stderr, "Unknown statistics format: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                stats_format = STATS_JSON;
+                break;
+            case 'a':
+                if (!strcmp(optarg, "lines"))
+                    batch = BATCH_LINES;
+                else if (!strcmp(optarg, "json"))
+                    batch = BATCH_JSON;
+                else
+                {
+                    fprintf(stderr, "Unknown word sets format: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'T':
+                template = optarg;
+                break;
+            case 'e':
+                edit = 1;
+                break;
+            case 'c':
+                cache = optarg;
+                break;
+            case 'n':
+                if ((cache_words = atoi(optarg)) < 1)
+                {
+                    fprintf(stderr, "Wrong number of words: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'x':
+                export = optarg;
+                break;
+            case 'D':
+                if ((options.export_depth = atoi(optarg)) < 1)
+                {
+                    fprintf(stderr, "Wrong export depth: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'S':
+                if ((options.export_sample = atoi(optarg)) < 1)
+                {
+                    fprintf(stderr, "Wrong export sample: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'C':
+                options.fold &= ~CROSSGEN_FOLD_CASE;
+                break;
+            case 'M':
+                options.fold |= CROSSGEN_FOLD_MARKS;
+                break;
+            case 'L':
+                options.fold_letters = optarg;
+                break;
+            default:
+                return usage(argv[0]);
+        }
+    }
+
+    if (batch ? optind + 1 < argc : optind + !cache != argc)
+        return usage(argv[0]);
+    if ((batch && cache) || (cache_words && !cache))
+    {
+        fprintf(stderr, "A cache gives the words of one crossword, -n takes its first words\n");
+        return usage(argv[0]);
+    }
+    if (batch && (bench_output || stats_format))
+    {
+        fprintf(stderr, "Statistics are not printed in batch mode\n");
+        return usage(argv[0]);
+    }
+    if (template && (batch || stats_format))
+    {
+        fprintf(stderr, "A template is filled with one word list and without statistics\n");
+        return usage(argv[0]);
+    }
+    if (edit && (batch || template))
+    {
+        fprintf(stderr, "Edits change one word list of a freeform crossword\n");
+        return usage(argv[0]);
+    }
+    if (export && (batch || template || edit || CROSSGEN_MODE_FULL != options.mode || options.threads > 1))
+    {
+        fprintf(stderr, "The strie is exported by the full search on one thread\n");
+        return usage(argv[0]);
+    }
+    if (pairs_only && (batch || template || edit || export || stats_format))
+    {
+        fprintf(stderr, "Only the pairs are built, nothing is searched\n");
+        return usage(argv[0]);
+    }
+    if (CROSSGEN_MODE_BEAM == options.mode && options.threads > 1)
+    {
+        fprintf(stderr, "Beam search runs on a single thread\n");
+        return usage(argv[0]);
+    }
+    // Nothing but the records goes to the output in batch mode
+    if (batch)
+        options.progress = NULL;
+    if (export && !(options.export_file = fopen(export, "wb")))
+    {
+        fprintf(stderr, "Can't open %s\n", export);
+        return 1;
+    }
+    if (!(gen = crossgen_new(&options)))
+    {
+        // The other options are checked already
+        if (options.fold_letters)
+            fprintf(stderr, "Wrong letters to fold: %s\n", options.fold_letters);
+        else
+            fprintf(stderr, "Not enough memory!\n");
+        return 1;
+    }
+
+    if (batch)
+    {
+        if (optind == argc || !strcmp(argv[optind], "-"))
+        {
+            fwords = stdin;
+        }
+        else if (!(fwords = fopen(argv[optind], "r")))
+        {
+            fprintf(stderr, "Can't open %s\n", argv[optind]);
+            crossgen_free(gen);
+            return 1;
+        }
+        i = run_batch(gen, fwords, batch);
+        if (fwords != stdin)
+            fclose(fwords);
+        crossgen_free(gen);
+        return i;
+    }
 
     printf("Welcome to Crossword Generator v0.1\n");
     printf("===================================\n");
 
-    if (2 != argc)
+    // Read input words
+    if (cache)
     {
-        printf("Usage: %s <file with a list of words>\n", argv[0]);
-        printf("\nMax words: %d\nMax wordlen: %d\n", MAXWORDS, MAXWORDLEN);
-        return 1;
+        if (crossgen_load_cache(gen, cache, cache_words))
+        {
+            crossgen_free(gen);
+            return 1;
+        }
     }
+    else
+    {
+        if (!(fwords = fopen(argv[optind], "r")))
+        {
+            fprintf(stderr, "Can't open %s\n", argv[optind]);
+            crossgen_free(gen);
+            return 1;
+        }
+        if (crossgen_load_file(gen, fwords))
+        {
+            fprintf(stderr, "Error reading words from %s\n", argv[optind]);
+            fclose(fwords);
+            crossgen_free(gen);
+            return 1;
+        }
+        fclose(fwords);
+    }
+    wordnum = crossgen_word_count(gen);
+    if (template)
+    {
+        printf("Dictionary: %d words\n", wordnum);
+        i = run_fill(gen, template, options.deadline, bench_output);
+        crossgen_free(gen);
+        return i;
+    }
+    for (i = 0; i < wordnum; i++)
+        printf("Word #%d: %s, %d\n", i, crossgen_word(gen, i), crossgen_word_length(gen, i));
 
-    // Read input words to the words[] array
-    fwords = fopen(argv[1], "r");
-    for (i = 0; NULL != fgets(words[i].word, MAXWORDLEN, fwords) && i < MAXWORDS; i++)
+    if (pairs_only)
     {
-        // Remove newline symbol
-        words[i].wordlen = strlen(words[i].word) - 1;
-        words[i].word[words[i].wordlen] = '\0';
-        for (j = 0; j < words[i].wordlen; j++)
-            words[i].word[j] = tolower(words[i].word[j]);
-        printf("Word #%d: %s, %d\n", i, words[i].word, words[i].wordlen);
+        if (crossgen_build_pairs(gen))
+        {
+            crossgen_free(gen);
+            return 1;
+        }
+        stats = crossgen_stats(gen);
+        printf("Pairs: %d\n", stats->pairs);
+        getrusage(RUSAGE_SELF, &resources);
+        if (bench_output)
+            print_bench(stats, wordnum, 0, resources.ru_maxrss);
+        crossgen_free(gen);
+        return 0;
     }
-    wordnum = i;
 
-    // Build inital word pairs that we'll be using a lot later
-    if (build_pairs(wordnum))
+    if (crossgen_run(gen))
     {
-        fprintf(stderr, "Error building pairs between words\n");
+        crossgen_free(gen);
         return 1;
     }
-    // Fill the tree with all possible pairs. Scan all the words.
-    for (i = 0; i < wordnum; i++)
-        build_branch(wordnum, words[i].firstchild);
+    result = crossgen_result(gen);
+    stats  = crossgen_stats(gen);
+    if (result->timed_out)
+        printf("Time is out, the crossword may be not the best one\n");
 
-#ifdef DEBUG
-    for (i = 0; i < wordnum; i++)
+    // Print the best branches if any
+    clock_gettime(CLOCK_MONOTONIC, &phase_start);
+    if (print_result(gen, &options, objective))
     {
-        printf("\n--------------------------------\nword[%d]=%s\n--------------------------------\n", i, words[i].word);
-        print_strie(words[i].firstchild);
+        crossgen_free(gen);
+        return 1;
     }
-#endif
+    // The node counts go with the statistics only, the crossword is the output
+    if (bench_output || stats_format)
+    {
+        printf("Nodes created: %ld", stats->nodes);
+        if (options.bound || CROSSGEN_MODE_BEAM == options.mode || CROSSGEN_MODE_RANDOM == options.mode)
+            printf(", cut off: %ld", stats->pruned);
+        if (CROSSGEN_MODE_RANDOM == options.mode)
+            printf(", restarts: %ld", stats->restarts);
+        if (export)
+            printf(", exported: %ld", stats->exported);
+        printf("\n");
+    }
+    output_time = seconds_since(&phase_start);
 
-    // Print the best branch if any
-    print_branch(best_branch);
+    if (edit && run_edit(gen, &options, objective))
+    {
+        crossgen_free(gen);
+        return 1;
+    }
 
-    // Free the memory
-    for (i = 0; i < wordnum; i++)
-        clear_branch(words[i].firstchild);
+    getrusage(RUSAGE_SELF, &resources);
+    if (bench_output)
+        print_bench(stats, wordnum, output_time, resources.ru_maxrss);
+    if (STATS_JSON == stats_format)
+        print_json_stats(stats, wordnum, output_time, resources.ru_maxrss);
+    crossgen_free(gen);
+    if (export && fclose(options.export_file))
+    {
+        fprintf(stderr, "Error writing %s\n", export);
+        return 1;
+    }
 
     return 0;
 }
@@ -0,0 +1,68 @@
+/*
+ * Crossword Generator pair cache builder
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "crossgen.h"
+
+int usage(const char *name)
+{
+    printf("Usage: %s <file with a list of words> <cache file>\n", name);
+    printf("\nWrite the words of the list with an index of their letters to the cache\n");
+    printf("file once, 'crossgen --cache' maps it and builds the pairs of the words\n");
+    printf("it takes from the index instead of comparing the words.\n");
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    struct crossgen_options options;
+    struct crossgen *gen = NULL;
+    struct timespec start, now;
+    FILE *fwords = NULL;
+    int ret = 1;
+
+    if (3 != argc)
+        return usage(argv[0]);
+    if (!(fwords = fopen(argv[1], "r")))
+    {
+        fprintf(stderr, "Can't open %s\n", argv[1]);
+        return 1;
+    }
+    crossgen_default_options(&options);
+    if (!(gen = crossgen_new(&options)))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        fclose(fwords);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!crossgen_load_file(gen, fwords) && !crossgen_save_cache(gen, argv[2]))
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        printf("%d words cached in %s in %.3f s\n", crossgen_word_count(gen), argv[2], \
+                (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9);
+        ret = 0;
+    }
+    fclose(fwords);
+    crossgen_free(gen);
+    return ret;
+}
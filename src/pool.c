@@ -0,0 +1,149 @@
+/*
+ * Crossword Generator memory pool
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+int pool_init(struct pool *pool, size_t item_size, size_t block_items)
+{
+    if (!pool || !item_size)
+        return 1;
+
+    // Keep every item aligned for any type we may store in it. Big items
+    // take whole cache lines, so reading the beginning of an item never
+    // touches two lines.
+    if (item_size >= POOL_CACHE_LINE)
+        item_size = (item_size + POOL_CACHE_LINE - 1) & ~(size_t)(POOL_CACHE_LINE - 1);
+    else
+        item_size = (item_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    memset(pool, 0, sizeof(struct pool));
+    pool->item_size   = item_size;
+    pool->block_items = block_items ? block_items : POOL_BLOCK_ITEMS;
+    return 0;
+}
+
+/*
+ * Take the next item from the current block. Go to the next block (already
+ * allocated one, if the pool was reset, or a new one) when it's full.
+ * The returned item is zeroed just like calloc() would do.
+ */
+void *pool_alloc(struct pool *pool)
+{
+    struct pool_block *block = pool->cur;
+    void *item;
+
+    if (!block || block->used == pool->block_items)
+    {
+        if (block && block->next)
+        {
+            block = block->next;
+        }
+        else
+        {
+            if (posix_memalign((void **)&block, POOL_CACHE_LINE, sizeof(struct pool_block) + \
+                        pool->item_size * pool->block_items))
+            {
+                return NULL;
+            }
+            block->next = NULL;
+            if (pool->cur)
+                pool->cur->next = block;
+            else
+                pool->first = block;
+            pool->nblocks++;
+        }
+        block->used = 0;
+        pool->cur = block;
+    }
+
+    item = block->data + block->used * pool->item_size;
+    block->used++;
+    pool->nitems++;
+    memset(item, 0, pool->item_size);
+    return item;
+}
+
+/*
+ * Give back the item if it's the last one allocated so the next pool_alloc()
+ * reuses it. Any other item stays allocated till the pool is reset.
+ */
+int pool_unalloc(struct pool *pool, void *item)
+{
+    struct pool_block *block = pool->cur;
+
+    if (!block || !block->used || \
+            (char *)item != block->data + (block->used - 1) * pool->item_size)
+    {
+        return 1;
+    }
+    block->used--;
+    pool->nitems--;
+    return 0;
+}
+
+void pool_mark(struct pool *pool, struct pool_mark *mark)
+{
+    mark->block  = pool->cur;
+    mark->used   = pool->cur ? pool->cur->used : 0;
+    mark->nitems = pool->nitems;
+}
+
+/*
+ * Drop all the items allocated after the mark. Blocks are kept for reuse,
+ * so the pool doesn't go to the heap again when it grows back.
+ */
+void pool_rewind(struct pool *pool, struct pool_mark *mark)
+{
+    if (!mark->block)
+    {
+        pool_reset(pool);
+        return;
+    }
+    pool->cur = mark->block;
+    pool->cur->used = mark->used;
+    pool->nitems = mark->nitems;
+}
+
+// Forget all items at once. Allocated blocks are kept for reuse.
+void pool_reset(struct pool *pool)
+{
+    if (pool->first)
+        pool->first->used = 0;
+    pool->cur = pool->first;
+    pool->nitems = 0;
+}
+
+// Return all the blocks to the heap
+void pool_destroy(struct pool *pool)
+{
+    struct pool_block *block = pool->first;
+    struct pool_block *next_block = NULL;
+
+    while (block)
+    {
+        next_block = block->next;
+        free(block);
+        block = next_block;
+    }
+    pool->first = pool->cur = NULL;
+    pool->nblocks = pool->nitems = 0;
+}
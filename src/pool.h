@@ -0,0 +1,65 @@
+/*
+ * Crossword Generator memory pool
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+#define POOL_BLOCK_ITEMS 4096  // default number of items in one pool block
+#define POOL_CACHE_LINE  64    // items of this size or bigger start at a cache line
+
+/*
+ * A pool hands out fixed-size items from big contiguous blocks. Items are
+ * never freed one by one: the last allocated item may be given back (that's
+ * what check_pair does with a rejected candidate), all the items allocated
+ * after a mark may be dropped at once, and the whole pool is either reset,
+ * keeping its blocks for the next run, or destroyed.
+ */
+struct pool_block {
+    struct pool_block *next;
+    size_t  used;           // number of items handed out from this block
+    _Alignas(POOL_CACHE_LINE) char data[];
+};
+
+struct pool {
+    size_t  item_size;
+    size_t  block_items;
+    struct pool_block *first;
+    struct pool_block *cur;  // the block new items are taken from
+    size_t  nblocks;         // number of blocks allocated from the heap
+    size_t  nitems;          // number of items currently handed out
+};
+
+// The position in the pool to rewind to
+struct pool_mark {
+    struct pool_block *block;
+    size_t  used;
+    size_t  nitems;
+};
+
+int   pool_init(struct pool *pool, size_t item_size, size_t block_items);
+void *pool_alloc(struct pool *pool);
+int   pool_unalloc(struct pool *pool, void *item);
+void  pool_mark(struct pool *pool, struct pool_mark *mark);
+void  pool_rewind(struct pool *pool, struct pool_mark *mark);
+void  pool_reset(struct pool *pool);
+void  pool_destroy(struct pool *pool);
+
+#endif /* POOL_H */
@@ -0,0 +1,269 @@
+/*
+ * Crossword Generator vector kernels
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "simd.h"
+
+/*
+ * The x86 kernels are built with the target attribute, so the rest of the
+ * program needs no special flags and runs on any CPU: simd_kernels() checks
+ * the CPU once and takes the best kernels it supports.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Instruction sets, a higher one has all the lower ones
+#define LEVEL_SCALAR    0
+#define LEVEL_SSE2      1
+#define LEVEL_AVX2      2
+
+// Bits of the letters of the chunk 'c' which belong to a word of 'len' letters
+static unsigned chunk_bits(int c, int len)
+{
+    int rest = len - c * SIMD_CHUNK;
+
+    return rest >= SIMD_CHUNK ? ~0u : (1u << rest) - 1;
+}
+
+static int match_letters_scalar(const unsigned char *a, int la, const unsigned char *b, int lb, \
+        unsigned *masks)
+{
+    int k, c, p, end, chunks = SIMD_CHUNKS(lb), total = 0;
+    unsigned m;
+
+    for (k = 0; k < la; k++)
+    {
+        for (c = 0; c < chunks; c++)
+        {
+            m = 0;
+            end = lb - c * SIMD_CHUNK < SIMD_CHUNK ? lb - c * SIMD_CHUNK : SIMD_CHUNK;
+            for (p = 0; p < end; p++)
+            {
+                if (b[c * SIMD_CHUNK + p] == a[k])
+                {
+                    m |= 1u << p;
+                    total++;
+                }
+            }
+            masks[k * chunks + c] = m;
+        }
+    }
+    return total;
+}
+
+static int boxes_near_scalar(const struct simd_boxes *boxes, int x1, int y1, int x2, int y2, int *out)
+{
+    int i, num = 0;
+
+    for (i = 0; i < boxes->num; i++)
+    {
+        if (boxes->x1[i] <= x2 && boxes->x2[i] >= x1 && \
+                boxes->y1[i] <= y2 && boxes->y2[i] >= y1)
+        {
+            out[num++] = i;
+        }
+    }
+    return num;
+}
+
+#ifdef SIMD_X86
+__attribute__((target("sse2")))
+static int match_letters_sse2(const unsigned char *a, int la, const unsigned char *b, int lb, \
+        unsigned *masks)
+{
+    int k, c, chunks = SIMD_CHUNKS(lb), total = 0;
+    unsigned m, valid;
+    __m128i lo, hi, letter;
+
+    for (c = 0; c < chunks; c++)
+    {
+        lo = _mm_loadu_si128((const __m128i *)(b + c * SIMD_CHUNK));
+        hi = _mm_loadu_si128((const __m128i *)(b + c * SIMD_CHUNK + 16));
+        valid = chunk_bits(c, lb);
+        for (k = 0; k < la; k++)
+        {
+            letter = _mm_set1_epi8((char)a[k]);
+            m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(lo, letter)) | \
+                (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(hi, letter)) << 16;
+            m &= valid;
+            masks[k * chunks + c] = m;
+            total += __builtin_popcount(m);
+        }
+    }
+    return total;
+}
+
+__attribute__((target("sse2")))
+static int boxes_near_sse2(const struct simd_boxes *boxes, int x1, int y1, int x2, int y2, int *out)
+{
+    int i, num = 0;
+    unsigned m;
+    __m128i vx1 = _mm_set1_epi32(x1), vy1 = _mm_set1_epi32(y1);
+    __m128i vx2 = _mm_set1_epi32(x2), vy2 = _mm_set1_epi32(y2);
+    __m128i far;
+
+    // A box is near unless it's entirely on one side of the rectangle
+    for (i = 0; i < boxes->num; i += 4)
+    {
+        far = _mm_or_si128( \
+                _mm_or_si128(_mm_cmpgt_epi32(_mm_load_si128((const __m128i *)(boxes->x1 + i)), vx2), \
+                    _mm_cmpgt_epi32(vx1, _mm_load_si128((const __m128i *)(boxes->x2 + i)))), \
+                _mm_or_si128(_mm_cmpgt_epi32(_mm_load_si128((const __m128i *)(boxes->y1 + i)), vy2), \
+                    _mm_cmpgt_epi32(vy1, _mm_load_si128((const __m128i *)(boxes->y2 + i)))));
+        for (m = ~(unsigned)_mm_movemask_ps(_mm_castsi128_ps(far)) & 0xf; m; m &= m - 1)
+            out[num++] = i + __builtin_ctz(m);
+    }
+    return num;
+}
+
+__attribute__((target("avx2,popcnt")))
+static int match_letters_avx2(const unsigned char *a, int la, const unsigned char *b, int lb, \
+        unsigned *masks)
+{
+    int k, c, chunks = SIMD_CHUNKS(lb), total = 0;
+    unsigned m, valid;
+    __m256i word;
+
+    for (c = 0; c < chunks; c++)
+    {
+        word = _mm256_loadu_si256((const __m256i *)(b + c * SIMD_CHUNK));
+        valid = chunk_bits(c, lb);
+        for (k = 0; k < la; k++)
+        {
+            m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(word, _mm256_set1_epi8((char)a[k])));
+            m &= valid;
+            masks[k * chunks + c] = m;
+            total += __builtin_popcount(m);
+        }
+    }
+    return total;
+}
+
+__attribute__((target("avx2")))
+static int boxes_near_avx2(const struct simd_boxes *boxes, int x1, int y1, int x2, int y2, int *out)
+{
+    int i, num = 0;
+    unsigned m;
+    __m256i vx1 = _mm256_set1_epi32(x1), vy1 = _mm256_set1_epi32(y1);
+    __m256i vx2 = _mm256_set1_epi32(x2), vy2 = _mm256_set1_epi32(y2);
+    __m256i far;
+
+    for (i = 0; i < boxes->num; i += 8)
+    {
+        far = _mm256_or_si256( \
+                _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_load_si256((const __m256i *)(boxes->x1 + i)), vx2), \
+                    _mm256_cmpgt_epi32(vx1, _mm256_load_si256((const __m256i *)(boxes->x2 + i)))), \
+                _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_load_si256((const __m256i *)(boxes->y1 + i)), vy2), \
+                    _mm256_cmpgt_epi32(vy1, _mm256_load_si256((const __m256i *)(boxes->y2 + i)))));
+        for (m = ~(unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(far)) & 0xff; m; m &= m - 1)
+            out[num++] = i + __builtin_ctz(m);
+    }
+    return num;
+}
+#endif /* SIMD_X86 */
+
+// The best kernels first
+static const struct simd_kernels variants[] = {
+#ifdef SIMD_X86
+    {"avx2",   LEVEL_AVX2,   match_letters_avx2,   boxes_near_avx2},
+    {"sse2",   LEVEL_SSE2,   match_letters_sse2,   boxes_near_sse2},
+#endif
+    {"scalar", LEVEL_SCALAR, match_letters_scalar, boxes_near_scalar}
+};
+
+#define VARIANTS ((int)(sizeof(variants) / sizeof(variants[0])))
+
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+static int first_variant;   // the best kernels the CPU supports
+
+static void select_variant(void)
+{
+    int level = LEVEL_SCALAR;
+
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        level = LEVEL_AVX2;
+    else if (__builtin_cpu_supports("sse2"))
+        level = LEVEL_SSE2;
+#endif
+    for (first_variant = 0; variants[first_variant].level > level; first_variant++)
+        ;
+}
+
+// The best kernels for this CPU
+const struct simd_kernels *simd_kernels(void)
+{
+    pthread_once(&select_once, select_variant);
+    return &variants[first_variant];
+}
+
+/*
+ * All the kernels this CPU can run, the best ones first and the scalar
+ * ones last. They all give the same results.
+ */
+const struct simd_kernels *simd_variants(int *num)
+{
+    pthread_once(&select_once, select_variant);
+    *num = VARIANTS - first_variant;
+    return &variants[first_variant];
+}
+
+/*
+ * Room for 'size' boxes, all empty. The arrays are aligned for the widest
+ * loads the kernels make.
+ */
+int simd_boxes_init(struct simd_boxes *boxes, int size)
+{
+    int i, *mem = NULL;
+
+    size = (size + SIMD_BOX_LANES - 1) / SIMD_BOX_LANES * SIMD_BOX_LANES;
+    if (!size)
+        size = SIMD_BOX_LANES;
+    if (posix_memalign((void **)&mem, SIMD_BOX_LANES * sizeof(int), 4 * size * sizeof(int)))
+        return 1;
+    boxes->x1 = mem;
+    boxes->y1 = mem + size;
+    boxes->x2 = mem + 2 * size;
+    boxes->y2 = mem + 3 * size;
+    boxes->num = 0;
+    boxes->size = size;
+    for (i = 0; i < size; i++)
+        simd_boxes_clear(boxes, i);
+    return 0;
+}
+
+void simd_boxes_free(struct simd_boxes *boxes)
+{
+    free(boxes->x1);
+    boxes->x1 = boxes->y1 = boxes->x2 = boxes->y2 = NULL;
+    boxes->num = boxes->size = 0;
+}
+
+// Make the box empty, it's near nothing
+void simd_boxes_clear(struct simd_boxes *boxes, int box)
+{
+    boxes->x1[box] = boxes->y1[box] = INT_MAX;
+    boxes->x2[box] = boxes->y2[box] = INT_MIN;
+}
@@ -0,0 +1,70 @@
+/*
+ * Crossword Generator vector kernels
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+ * The words are compared SIMD_CHUNK letters at once. A word given to the
+ * kernels is padded with zero bytes up to a whole number of chunks.
+ */
+#define SIMD_CHUNK          32
+#define SIMD_CHUNKS(len)    (((len) + SIMD_CHUNK - 1) / SIMD_CHUNK)
+#define SIMD_PADDED(len)    (SIMD_CHUNKS(len) * SIMD_CHUNK)
+
+/*
+ * Boxes of the placed words, one array per side. The arrays have room for
+ * a multiple of SIMD_BOX_LANES boxes, the ones after the first 'num' are
+ * empty (x1 > x2) so the kernels may test whole groups.
+ */
+#define SIMD_BOX_LANES      8
+
+struct simd_boxes {
+    int    *x1, *y1, *x2, *y2;
+    int     num;
+    int     size;
+};
+
+/*
+ * A set of kernels for one instruction set:
+ *
+ * match_letters() - for every letter 'k' of the word 'a' and every chunk
+ *     'c' of the padded word 'b', masks[k * SIMD_CHUNKS(lb) + c] gets a bit
+ *     for every letter of the chunk equal to a[k]. Returns the number of
+ *     the equal letters, i.e. the number of the ways the words cross.
+ *
+ * boxes_near() - stores the numbers of the boxes which have a cell in
+ *     [x1, x2] x [y1, y2] to 'out' in increasing order, returns their number.
+ */
+struct simd_kernels {
+    const char *name;
+    int     level;          // instructions the kernels need, see simd.c
+    int   (*match_letters)(const unsigned char *a, int la, const unsigned char *b, int lb, \
+            unsigned *masks);
+    int   (*boxes_near)(const struct simd_boxes *boxes, int x1, int y1, int x2, int y2, int *out);
+};
+
+const struct simd_kernels *simd_kernels(void);
+const struct simd_kernels *simd_variants(int *num);
+
+int   simd_boxes_init(struct simd_boxes *boxes, int size);
+void  simd_boxes_free(struct simd_boxes *boxes);
+void  simd_boxes_clear(struct simd_boxes *boxes, int box);
+
+#endif /* SIMD_H */
@@ -0,0 +1,219 @@
+/*
+ * Crossword Generator strie export converter
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "crossgen.h"
+
+#define FORMAT_STATS 0
+#define FORMAT_DOT   1
+#define FORMAT_JSON  2
+
+#define READ_NODES   4096   // nodes read at once
+
+int usage(const char *name)
+{
+    printf("Usage: %s [options] <strie file>\n", name);
+    printf("\nConvert the strie written by 'crossgen --export'.\n");
+    printf("\nOptions:\n");
+    printf("  -f, --format=FMT  output format:\n");
+    printf("                      stats - nodes and children per node at every\n");
+    printf("                              depth (default)\n");
+    printf("                      dot   - Graphviz graph\n");
+    printf("                      json  - one JSON object per node and line\n");
+    printf("  -d, --depth=N     only the nodes up to depth N\n");
+    printf("  -h, --help        show this help\n");
+    return 1;
+}
+
+// Grow the per depth arrays to hold 'depth', returns 1 if out of memory
+static int grow(long **parents, long **nodes, long **children, int *size, int depth)
+{
+    int newsize = *size;
+    long *tmp = NULL;
+
+    if (depth < *size)
+        return 0;
+    while (newsize <= depth)
+        newsize = newsize ? newsize * 2 : 64;
+    if (!(tmp = (long *)realloc(*parents, newsize * sizeof(long))))
+        return 1;
+    *parents = tmp;
+    if (!(tmp = (long *)realloc(*nodes, newsize * sizeof(long))))
+        return 1;
+    *nodes = tmp;
+    if (!(tmp = (long *)realloc(*children, newsize * sizeof(long))))
+        return 1;
+    *children = tmp;
+    memset(*nodes + *size, 0, (newsize - *size) * sizeof(long));
+    memset(*children + *size, 0, (newsize - *size) * sizeof(long));
+    *size = newsize;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct crossgen_export_header header;
+    struct crossgen_export_node *buf = NULL, *node = NULL;
+    long *parents = NULL;   // the last node of every depth, the parents of the next ones
+    long *nodes = NULL;     // number of the nodes of every depth
+    long *children = NULL;  // number of the nodes of every depth that have children
+    long id = 0, parent;
+    int i, opt, num, size = 0, maxdepth = -1, format = FORMAT_STATS, depth = -1, ret = 1;
+    FILE *fstrie = NULL;
+    static struct option long_options[] = {
+        {"format", required_argument, NULL, 'f'},
+        {"depth",  required_argument, NULL, 'd'},
+        {"help",   no_argument,       NULL, 'h'},
+        {NULL,     0,                 NULL, 0}
+    };
+
+    while (-1 != (opt = getopt_long(argc, argv, "f:d:h", long_options, NULL)))
+    {
+        switch (opt)
+        {
+            case 'f':
+                if (!strcmp(optarg, "stats"))
+                    format = FORMAT_STATS;
+                else if (!strcmp(optarg, "dot"))
+                    format = FORMAT_DOT;
+                else if (!strcmp(optarg, "json"))
+                    format = FORMAT_JSON;
+                else
+                {
+                    fprintf(stderr, "Unknown format: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            case 'd':
+                if ((depth = atoi(optarg)) < 0)
+                {
+                    fprintf(stderr, "Wrong depth: %s\n", optarg);
+                    return usage(argv[0]);
+                }
+                break;
+            default:
+                return usage(argv[0]);
+        }
+    }
+    if (optind + 1 != argc)
+        return usage(argv[0]);
+
+    if (!(fstrie = fopen(argv[optind], "rb")))
+    {
+        fprintf(stderr, "Can't open %s\n", argv[optind]);
+        return 1;
+    }
+    if (1 != fread(&header, sizeof(struct crossgen_export_header), 1, fstrie) || \
+            memcmp(header.magic, CROSSGEN_EXPORT_MAGIC, sizeof(header.magic)) || \
+            CROSSGEN_EXPORT_VERSION != header.version || CROSSGEN_EXPORT_BYTE_ORDER != header.byte_order || \
+            sizeof(struct crossgen_export_node) != header.node_size)
+    {
+        fprintf(stderr, "%s is not a strie export of this version\n", argv[optind]);
+        fclose(fstrie);
+        return 1;
+    }
+    if (!(buf = (struct crossgen_export_node *)malloc(READ_NODES * sizeof(struct crossgen_export_node))))
+    {
+        fprintf(stderr, "Not enough memory!\n");
+        fclose(fstrie);
+        return 1;
+    }
+
+    if (FORMAT_DOT == format)
+        printf("digraph strie {\n    node [shape=box];\n");
+    while (0 < (num = fread(buf, sizeof(struct crossgen_export_node), READ_NODES, fstrie)))
+    {
+        for (i = 0; i < num; i++)
+        {
+            node = &buf[i];
+            if (node->depth < 0 || node->depth > maxdepth + 1)
+            {
+                fprintf(stderr, "%s is damaged\n", argv[optind]);
+                goto out;
+            }
+            if (grow(&parents, &nodes, &children, &size, node->depth))
+            {
+                fprintf(stderr, "Not enough memory!\n");
+                goto out;
+            }
+            maxdepth = node->depth;
+            parents[node->depth] = id;
+            parent = node->depth ? parents[node->depth - 1] : -1;
+            if (-1 != depth && node->depth > depth)
+            {
+                id++;
+                continue;
+            }
+            nodes[node->depth]++;
+            // The node is the first child of its parent
+            if (node->depth && parent == id - 1)
+                children[node->depth - 1]++;
+
+            if (FORMAT_DOT == format)
+            {
+                printf("    n%ld [label=\"%d-%d\\n%d,%d\"];\n", id, node->word[0], node->word[1], \
+                        node->letter[0], node->letter[1]);
+                if (-1 != parent)
+                    printf("    n%ld -> n%ld;\n", parent, id);
+            }
+            else if (FORMAT_JSON == format)
+            {
+                printf("{\"id\": %ld, \"parent\": %ld, \"depth\": %d, \"words\": [%d, %d], " \
+                        "\"letters\": [%d, %d], \"orient\": [%d, %d], \"coords\": [[%d, %d], [%d, %d]]}\n", \
+                        id, parent, node->depth, node->word[0], node->word[1], \
+                        node->letter[0], node->letter[1], node->orient[0], node->orient[1], \
+                        node->coord[0][0], node->coord[0][1], node->coord[1][0], node->coord[1][1]);
+            }
+            id++;
+        }
+    }
+    if (ferror(fstrie))
+    {
+        fprintf(stderr, "Error reading %s\n", argv[optind]);
+        goto out;
+    }
+
+    if (FORMAT_DOT == format)
+    {
+        printf("}\n");
+    }
+    else if (FORMAT_STATS == format)
+    {
+        printf("Words: %d, nodes: %ld\n", header.wordnum, id);
+        printf("depth\tnodes\tinner\tchildren\n");
+        for (i = 0; i < size && nodes[i]; i++)
+        {
+            printf("%d\t%ld\t%ld\t%.2f\n", i, nodes[i], children[i], \
+                    children[i] && i + 1 < size ? (double)nodes[i + 1] / children[i] : 0.0);
+        }
+    }
+    ret = 0;
+
+out:
+    fclose(fstrie);
+    free(buf);
+    free(parents);
+    free(nodes);
+    free(children);
+    return ret;
+}
@@ -0,0 +1,133 @@
+/*
+ * Crossword Generator synthetic word list generator
+ *
+ * Copyright (C) 2012 Denis Kovalev (aikikode@gmail.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+/*
+ * English letters from the most frequent to the least frequent one and
+ * their frequencies in tenths of a percent. The words are made of the first
+ * 'alphabet' letters, so a smaller alphabet gives more common letters
+ * between the words.
+ */
+static const char letters[] = "etaoinshrdlcumwfgypbvkjxqz";
+static const int  weights[] = {
+    127, 91, 82, 75, 70, 67, 63, 61, 60, 43, 40, 28, 28,
+    24, 24, 22, 20, 20, 19, 15, 10, 8, 2, 2, 1, 1
+};
+
+/*
+ * xorshift64* generator: the same seed gives the same list on every
+ * platform, unlike rand()
+ */
+static unsigned long long state;
+
+unsigned long long next_random(void)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+// Random number in [0, n)
+int random_below(int n)
+{
+    return (int)(next_random() % (unsigned long long)n);
+}
+
+int usage(const char *name)
+{
+    printf("Usage: %s [options]\n", name);
+    printf("\nPrint a random list of words for crossgen, one word per line.\n");
+    printf("\nOptions:\n");
+    printf("  -n, --words=N     number of words (default 10)\n");
+    printf("  -l, --min=N       minimum word length (default 3)\n");
+    printf("  -L, --max=N       maximum word length (default 8)\n");
+    printf("  -a, --alphabet=N  use only N most frequent letters, fewer letters give\n");
+    printf("                    more crossings (default 26)\n");
+    printf("  -s, --seed=N      random seed (default 1)\n");
+    printf("  -h, --help        show this help\n");
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    int i, k, c, opt, len, r;
+    int wordnum = 10, minlen = 3, maxlen = 8, alphabet = 26, total = 0;
+    unsigned long long seed = 1;
+    static struct option long_options[] = {
+        {"words",    required_argument, NULL, 'n'},
+        {"min",      required_argument, NULL, 'l'},
+        {"max",      required_argument, NULL, 'L'},
+        {"alphabet", required_argument, NULL, 'a'},
+        {"seed",     required_argument, NULL, 's'},
+        {"help",     no_argument,       NULL, 'h'},
+        {NULL,       0,                 NULL, 0}
+    };
+
+    while (-1 != (opt = getopt_long(argc, argv, "n:l:L:a:s:h", long_options, NULL)))
+    {
+        switch (opt)
+        {
+            case 'n':
+                wordnum = atoi(optarg);
+                break;
+            case 'l':
+                minlen = atoi(optarg);
+                break;
+            case 'L':
+                maxlen = atoi(optarg);
+                break;
+            case 'a':
+                alphabet = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                return usage(argv[0]);
+        }
+    }
+    if (optind != argc || wordnum < 0 || minlen < 1 || maxlen < minlen || \
+            alphabet < 1 || alphabet > 26)
+    {
+        return usage(argv[0]);
+    }
+
+    // A zero state would stay zero forever
+    state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    for (i = 0; i < alphabet; i++)
+        total += weights[i];
+
+    for (i = 0; i < wordnum; i++)
+    {
+        len = minlen + random_below(maxlen - minlen + 1);
+        for (k = 0; k < len; k++)
+        {
+            r = random_below(total);
+            for (c = 0; r >= weights[c]; c++)
+                r -= weights[c];
+            putchar(letters[c]);
+        }
+        putchar('\n');
+    }
+    return 0;
+}